@@ -0,0 +1,140 @@
+#include <chrono>
+#include <cstdio>
+#include "TextEditor.h"
+
+static std::string GenerateBenchmarkText(int aLineCount)
+{
+	// a mix of code, strings, numbers, comments and indentation that every language tokenizes something of
+	static const char* templates[] = {
+		"int value_%d = %d; // running total\n",
+		"\tif (value_%d > %d) { call(\"some text\", 1.5f, 0x1f); }\n",
+		"/* block comment %d\n",
+		"   still inside %d */\n",
+		"SELECT name, id FROM table_%d WHERE id = %d;\n",
+		"\t\treturn value_%d * %d + \xc3\xa9t\xc3\xa9;\n",
+		"#define MACRO_%d(x) ((x) << %d)\n",
+		"\n",
+	};
+	const int templateCount = sizeof(templates) / sizeof(templates[0]);
+
+	std::string text;
+	text.reserve((size_t)aLineCount * 40);
+	char buffer[128];
+	for (int i = 0; i < aLineCount; i++)
+	{
+		int length = snprintf(buffer, sizeof(buffer), templates[i % templateCount], i, i % 97);
+		text.append(buffer, length);
+	}
+	if (!text.empty())
+		text.pop_back(); // aLineCount lines, the last one without a line break
+	return text;
+}
+
+std::string TextEditor::Benchmarks(int aMaxLines)
+{
+	std::string json = "{\n\t\"benchmarks\": [\n";
+	bool first = true;
+	auto measure = [&](const char* aName, const char* aVariant, int aLines, auto&& aAction)
+	{
+		auto start = std::chrono::steady_clock::now();
+		aAction();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		char entry[256];
+		snprintf(entry, sizeof(entry), "%s\t\t{ \"name\": \"%s\", \"variant\": \"%s\", \"lines\": %d, \"ms\": %.3f }",
+			first ? "" : ",\n", aName, aVariant, aLines, ms);
+		json += entry;
+		first = false;
+	};
+
+	bool readOnly = mReadOnly;
+	mReadOnly = false;
+	const char* clipboardText = ImGui::GetClipboardText();
+	std::string clipboard = clipboardText != nullptr ? clipboardText : ""; // paste goes through it
+	const int sizes[] = { 1000, 100000, 1000000 };
+	for (int lines : sizes)
+	{
+		if (lines > aMaxLines)
+			break;
+		std::string text = GenerateBenchmarkText(lines);
+
+		SetLanguageDefinition(LanguageDefinitionId::None);
+		measure("SetText", "", lines, [&]() { SetText(text); });
+
+		for (int id = (int)LanguageDefinitionId::None + 1; id <= (int)LanguageDefinitionId::Hlsl; id++)
+		{
+			SetLanguageDefinition((LanguageDefinitionId)id);
+			measure("ColorizeInternal", GetLanguageDefinitionName(), lines, [&]()
+				{
+					do
+						ColorizeInternal();
+					while (IsColorizationPending());
+				});
+		}
+
+		auto find = [&](const char* aVariant, const char* aPattern, bool aCaseSensitive, bool aRegex)
+		{
+			snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", aPattern);
+			mFindCaseSensitive = aCaseSensitive;
+			mFindUseRegex = aRegex;
+			mFindIndexValid = false; // every variant starts from a cold index
+			measure("RefreshFindResults", aVariant, lines, [&]()
+				{
+					RefreshFindResults(false);
+					WaitForFindResults();
+				});
+		};
+		find("plain", "value_1", true, false);
+		find("case-insensitive", "VALUE_1", false, false);
+		find("regex", "value_[0-9]+ \\*", true, true);
+
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "value_");
+		snprintf(mReplaceBuffer, sizeof(mReplaceBuffer), "%s", "v_");
+		mFindCaseSensitive = true;
+		mFindUseRegex = false;
+		RefreshFindResults(false);
+		measure("ReplaceAll", "", lines, [&]() { ReplaceAll(); });
+		mFindBuffer[0] = '\0';
+		mReplaceBuffer[0] = '\0';
+		RefreshFindResults(false);
+
+		ImGui::SetClipboardText(GenerateBenchmarkText(1000).c_str());
+		ClearSelections();
+		ClearExtraCursors();
+		SetCursorPosition(Coordinates(lines / 2, 0));
+		measure("Paste", "1000 lines", lines, [&]() { Paste(); });
+
+		// one cursor every few lines, up to a thousand
+		int cursorCount = std::min(1000, (int)mLines.size());
+		int step = (int)mLines.size() / cursorCount;
+		SetCursorPosition(Coordinates(0, 0));
+		for (int c = 1; c < cursorCount; c++)
+		{
+			mState.AddCursor();
+			SetCursorPosition(Coordinates(c * step, 0), mState.mCurrentCursor);
+		}
+		OnCursorPositionChanged();
+		measure("Typing", "1000 cursors, 16 characters", lines, [&]()
+			{
+				for (const char* p = "benchmark_typing"; *p != '\0'; p++)
+					EnterCharacter(*p, false);
+			});
+		ClearExtraCursors();
+
+		measure("Undo", "all steps", lines, [&]()
+			{
+				while (CanUndo())
+					Undo();
+			});
+		measure("Redo", "all steps", lines, [&]()
+			{
+				while (CanRedo())
+					Redo();
+			});
+	}
+	mReadOnly = readOnly;
+	ImGui::SetClipboardText(clipboard.c_str());
+
+	json += "\n\t]\n}\n";
+	return json;
+}
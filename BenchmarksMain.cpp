@@ -0,0 +1,19 @@
+#include <cstdio>
+#include <cstdlib>
+#include "TextEditor.h"
+
+// Usage: benchmarks [max lines], 1000000 by default
+int main(int argc, char** argv)
+{
+	int maxLines = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+	// no window is opened, the context is only there for the clipboard paste uses
+	ImGui::CreateContext();
+	{
+		TextEditor editor;
+		std::string json = editor.Benchmarks(maxLines);
+		std::fputs(json.c_str(), stdout);
+	}
+	ImGui::DestroyContext();
+	return 0;
+}
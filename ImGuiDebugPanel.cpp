@@ -32,6 +32,7 @@ void TextEditor::ImGuiDebugPanel(const std::string& panelName)
 		static std::string numberOfRecordsText;
 		numberOfRecordsText = "Number of records: " + std::to_string(mUndoBuffer.size());
 		ImGui::Text("%s", numberOfRecordsText.c_str());
+		ImGui::Text("Memory: %zu / %zu bytes", mUndoMemoryUsage, mUndoMemoryBudget);
 		ImGui::DragInt("Undo index", &mState.mCurrentCursor);
 		for (int i = 0; i < mUndoBuffer.size(); i++)
 		{
@@ -50,9 +51,50 @@ void TextEditor::ImGuiDebugPanel(const std::string& panelName)
 			}
 		}
 	}
+	if (ImGui::CollapsingHeader("Performance"))
+	{
+		const PerformanceStats& stats = mStats;
+		ImGui::Text("Input: %.3f ms", stats.mInputMs);
+		ImGui::Text("Colorize: %.3f ms (tokenizing %.3f ms, %d lines)", stats.mColorizeMs, stats.mColorizeRangeMs, stats.mLinesColorized);
+		ImGui::Text("Colorize backlog: %d lines", stats.mColorizeBacklog);
+		ImGui::Text("Find: %.3f ms", stats.mFindMs);
+		ImGui::Text("Render: %.3f ms", stats.mRenderMs);
+		ImGui::Text("AddText calls: %d, draw commands: %d, vertices: %d", stats.mTextDrawCalls, stats.mDrawCommands, stats.mVertices);
+
+		// oldest frame first: mStatsHistoryNext is the oldest entry once the ring is full, and equals
+		// the size (so wraps to 0) before that
+		struct Plot { const TextEditor* mEditor; float PerformanceStats::* mField; };
+		auto getter = [](void* aData, int aIndex) -> float
+		{
+			const Plot& plot = *(const Plot*)aData;
+			const auto& history = plot.mEditor->mStatsHistory;
+			return history[(plot.mEditor->mStatsHistoryNext + aIndex) % history.size()].*plot.mField;
+		};
+		int count = (int)mStatsHistory.size();
+		Plot plots[] = { { this, &PerformanceStats::mInputMs }, { this, &PerformanceStats::mColorizeMs },
+			{ this, &PerformanceStats::mFindMs }, { this, &PerformanceStats::mRenderMs } };
+		const char* labels[] = { "Input ms", "Colorize ms", "Find ms", "Render ms" };
+		for (int i = 0; i < 4; i++)
+			ImGui::PlotLines(labels[i], getter, &plots[i], count, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+
+		if (ImGui::TreeNode("Memory estimate"))
+		{
+			MemoryStats memory = EstimateMemoryUsage();
+			ImGui::Text("Lines: %zu bytes", memory.mLines);
+			ImGui::Text("Undo: %zu bytes", memory.mUndo);
+			ImGui::Text("Find highlights: %zu bytes", memory.mFindHighlights);
+			ImGui::TreePop();
+		}
+	}
 	if (ImGui::Button("Run unit tests"))
 	{
 		UnitTests();
 	}
+	if (ImGui::Button("Run benchmarks (copies JSON)"))
+	{
+		// on an editor of its own, the suite replaces the text, language and history of the one it runs on
+		TextEditor benchmarkEditor;
+		ImGui::SetClipboardText(benchmarkEditor.Benchmarks(100000).c_str());
+	}
 	ImGui::End();
 }
\ No newline at end of file
@@ -1,3 +1,6 @@
+#include <cstring>
+#include <algorithm>
+
 #include "TextEditor.h"
 
 static bool TokenizeCStyleString(const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end)
@@ -388,6 +391,365 @@ static bool TokenizeLuaStylePunctuation(const char* in_begin, const char* in_end
 	return false;
 }
 
+// The tokenizers below reproduce the token regexes these languages used to be defined with, including
+// the quirks the regexes had (hex numbers split after the leading 0, no integer suffixes), so switching
+// to them does not change any highlighting.
+
+static inline bool IsDecimalDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// [ \t]*#[ \t]*[a-zA-Z_]+
+static bool TokenizeHashPreprocessorDirective(const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end)
+{
+	const char* p = in_begin;
+
+	while (p < in_end && (*p == ' ' || *p == '\t'))
+		p++;
+
+	if (p == in_end || *p != '#')
+		return false;
+	p++;
+
+	while (p < in_end && (*p == ' ' || *p == '\t'))
+		p++;
+
+	const char* name = p;
+	while (p < in_end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || *p == '_'))
+		p++;
+
+	if (p == name)
+		return false;
+
+	out_begin = in_begin;
+	out_end = p;
+	return true;
+}
+
+// q(\\.|[^q])*q where q is the quote character
+static bool TokenizeEscapedString(const char* in_begin, const char* in_end, char quote, const char*& out_begin, const char*& out_end)
+{
+	if (in_begin == in_end || *in_begin != quote)
+		return false;
+
+	const char* p = in_begin + 1;
+	while (p < in_end)
+	{
+		if (*p == quote)
+		{
+			out_begin = in_begin;
+			out_end = p + 1;
+			return true;
+		}
+
+		if (*p == '\\' && p + 1 < in_end)
+			p += 2;
+		else
+			p++;
+	}
+
+	// No unescaped closing quote. The regex then backtracks and may still close the string on an escaped
+	// quote by reading its backslash as a plain character. Replay that search from the line end backwards:
+	// matchFrom[i] is where the match ends when the body is resumed at i, nullptr if it fails.
+	const char* matchFromNext = nullptr; // i + 1
+	const char* matchFromNextNext = nullptr; // i + 2
+	for (p = in_end - 1; p > in_begin; p--)
+	{
+		const char* matchFrom = nullptr;
+		if (*p == '\\' && p + 1 < in_end)
+			matchFrom = matchFromNextNext;
+		if (matchFrom == nullptr && *p != quote)
+			matchFrom = matchFromNext;
+		if (matchFrom == nullptr && *p == quote)
+			matchFrom = p + 1;
+		matchFromNextNext = matchFromNext;
+		matchFromNext = matchFrom;
+	}
+
+	if (matchFromNext == nullptr)
+		return false;
+
+	out_begin = in_begin;
+	out_end = matchFromNext;
+	return true;
+}
+
+// [prefix]?q(\\.|[^q])*q
+static bool TokenizePrefixedEscapedString(const char* in_begin, const char* in_end, const char* prefixes, char quote, const char*& out_begin, const char*& out_end)
+{
+	if (in_begin + 1 < in_end && in_begin[1] == quote && *in_begin != '\0' && std::strchr(prefixes, *in_begin) != nullptr)
+	{
+		if (!TokenizeEscapedString(in_begin + 1, in_end, quote, out_begin, out_end))
+			return false;
+		out_begin = in_begin;
+		return true;
+	}
+
+	return TokenizeEscapedString(in_begin, in_end, quote, out_begin, out_end);
+}
+
+// '\\?[^']'
+static bool TokenizeSingleCharLiteral(const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end)
+{
+	const char* p = in_begin;
+
+	if (*p != '\'')
+		return false;
+
+	if (p + 3 < in_end && p[1] == '\\' && p[2] != '\'' && p[3] == '\'')
+		out_end = p + 4;
+	else if (p + 2 < in_end && p[1] != '\'' && p[2] == '\'')
+		out_end = p + 3;
+	else
+		return false;
+
+	out_begin = in_begin;
+	return true;
+}
+
+// '[^']*'
+static bool TokenizeSqlStyleString(const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end)
+{
+	if (*in_begin != '\'')
+		return false;
+
+	const char* p = in_begin + 1;
+	while (p < in_end && *p != '\'')
+		p++;
+
+	if (p == in_end)
+		return false;
+
+	out_begin = in_begin;
+	out_end = p + 1;
+	return true;
+}
+
+// [+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?
+static bool TokenizeDecimalNumber(const char* in_begin, const char* in_end, bool allowFloatSuffix, const char*& out_begin, const char*& out_end)
+{
+	const char* p = in_begin;
+
+	if (*p == '+' || *p == '-')
+		p++;
+
+	if (p < in_end && IsDecimalDigit(*p))
+	{
+		while (p < in_end && IsDecimalDigit(*p))
+			p++;
+
+		if (p < in_end && *p == '.')
+		{
+			p++;
+			while (p < in_end && IsDecimalDigit(*p))
+				p++;
+		}
+	}
+	else if (p + 1 < in_end && *p == '.' && IsDecimalDigit(p[1]))
+	{
+		p += 2;
+		while (p < in_end && IsDecimalDigit(*p))
+			p++;
+	}
+	else
+		return false;
+
+	if (p < in_end && (*p == 'e' || *p == 'E'))
+	{
+		const char* exponent = p + 1;
+		if (exponent < in_end && (*exponent == '+' || *exponent == '-'))
+			exponent++;
+
+		if (exponent < in_end && IsDecimalDigit(*exponent))
+		{
+			while (exponent < in_end && IsDecimalDigit(*exponent))
+				exponent++;
+			p = exponent;
+		}
+	}
+
+	if (allowFloatSuffix && p < in_end && (*p == 'f' || *p == 'F'))
+		p++;
+
+	out_begin = in_begin;
+	out_end = p;
+	return true;
+}
+
+// same set as TokenizeCStylePunctuation, optionally without ':'
+static bool TokenizeOperatorPunctuation(const char* in_begin, const char* in_end, bool allowColon, const char*& out_begin, const char*& out_end)
+{
+	if (*in_begin == ':' && !allowColon)
+		return false;
+
+	return TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end);
+}
+
+static bool TokenizeWord(const char* in_begin, const char* in_end, const char* word, const char*& out_begin, const char*& out_end)
+{
+	size_t length = std::strlen(word);
+	if ((size_t)(in_end - in_begin) < length || std::strncmp(in_begin, word, length) != 0)
+		return false;
+
+	out_begin = in_begin;
+	out_end = in_begin + length;
+	return true;
+}
+
+static inline char FoldCase(char c)
+{
+	return c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c;
+}
+
+static inline size_t DisplacedSlot(uint64_t aHash, uint32_t aDisplacement, size_t aSlotCount)
+{
+	return ((uint32_t)aHash + aDisplacement * ((uint32_t)(aHash >> 32) | 1u)) & (aSlotCount - 1);
+}
+
+uint64_t TextEditor::LanguageDefinition::KeywordTable::Hash(std::string_view aWord) const
+{
+	uint64_t h = 14695981039346656037ull ^ mSeed;
+	if (mFoldCase)
+	{
+		for (char c : aWord)
+			h = (h ^ (uint8_t)FoldCase(c)) * 1099511628211ull;
+	}
+	else
+	{
+		for (char c : aWord)
+			h = (h ^ (uint8_t)c) * 1099511628211ull;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+void TextEditor::LanguageDefinition::KeywordTable::Build(const LanguageDefinition& aDefinition)
+{
+	mFoldCase = !aDefinition.mCaseSensitive;
+
+	// Case insensitive languages used to upper case the token before looking it up, so only words that
+	// are already upper case in the definition can ever match.
+	std::unordered_map<std::string, uint8_t> classes;
+	auto add = [&](const std::string& aWord, uint8_t aClass) {
+		if (aWord.empty() || (mFoldCase && std::any_of(aWord.begin(), aWord.end(), [](char c) { return FoldCase(c) != c; })))
+			return;
+		classes[aWord] |= aClass;
+	};
+	for (const auto& k : aDefinition.mKeywords)
+		add(k, Keyword);
+	for (const auto& i : aDefinition.mIdentifiers)
+		add(i.first, KnownIdentifier);
+	for (const auto& i : aDefinition.mPreprocIdentifiers)
+		add(i.first, PreprocIdentifier);
+
+	mDisplacements.clear();
+	mSlots.clear();
+	mWords.clear();
+	if (classes.empty())
+		return;
+
+	std::vector<std::pair<std::string, uint8_t>> words(classes.begin(), classes.end());
+	size_t slotCount = 1;
+	while (slotCount < words.size() * 2)
+		slotCount *= 2;
+	const size_t bucketCount = (words.size() + 3) / 4;
+
+	// Hash and displace: words are grouped in small buckets, then each bucket, largest first, gets the
+	// first displacement that moves all of its words into free slots. A fresh seed is tried in the
+	// unlikely case that some bucket runs out of displacements.
+	std::vector<uint64_t> hashes(words.size());
+	std::vector<std::vector<size_t>> buckets;
+	std::vector<bool> taken;
+	std::vector<size_t> bucketSlots;
+	for (mSeed = 0;; mSeed++)
+	{
+		buckets.assign(bucketCount, {});
+		for (size_t i = 0; i < words.size(); i++)
+		{
+			hashes[i] = Hash(words[i].first);
+			buckets[(hashes[i] >> 32) % bucketCount].push_back(i);
+		}
+		std::vector<size_t> order(bucketCount);
+		for (size_t b = 0; b < bucketCount; b++)
+			order[b] = b;
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+		taken.assign(slotCount, false);
+		mDisplacements.assign(bucketCount, 0);
+		bool placedAll = true;
+		for (size_t b : order)
+		{
+			bool placed = false;
+			for (uint32_t d = 0; d <= UINT16_MAX && !placed; d++)
+			{
+				bucketSlots.clear();
+				placed = true;
+				for (size_t i : buckets[b])
+				{
+					size_t slot = DisplacedSlot(hashes[i], d, slotCount);
+					if (taken[slot] || std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())
+					{
+						placed = false;
+						break;
+					}
+					bucketSlots.push_back(slot);
+				}
+				if (placed)
+				{
+					mDisplacements[b] = (uint16_t)d;
+					for (size_t slot : bucketSlots)
+						taken[slot] = true;
+				}
+			}
+			if (!placed)
+			{
+				placedAll = false;
+				break;
+			}
+		}
+		if (placedAll)
+			break;
+	}
+
+	mSlots.assign(slotCount, Slot());
+	for (size_t i = 0; i < words.size(); i++)
+	{
+		uint32_t d = mDisplacements[(hashes[i] >> 32) % bucketCount];
+		auto& slot = mSlots[DisplacedSlot(hashes[i], d, slotCount)];
+		slot.mOffset = (uint32_t)mWords.size();
+		slot.mLength = (uint32_t)words[i].first.size();
+		slot.mClasses = words[i].second;
+		mWords += words[i].first;
+	}
+}
+
+uint8_t TextEditor::LanguageDefinition::KeywordTable::Lookup(std::string_view aWord) const
+{
+	if (mSlots.empty() || aWord.empty())
+		return 0;
+
+	uint64_t h = Hash(aWord);
+	uint32_t d = mDisplacements[(h >> 32) % mDisplacements.size()];
+	const auto& slot = mSlots[DisplacedSlot(h, d, mSlots.size())];
+	if (slot.mLength != aWord.size())
+		return 0;
+
+	const char* word = mWords.data() + slot.mOffset;
+	if (mFoldCase)
+	{
+		for (size_t i = 0; i < aWord.size(); i++)
+		{
+			if (FoldCase(aWord[i]) != word[i])
+				return 0;
+		}
+		return slot.mClasses;
+	}
+	return std::memcmp(word, aWord.data(), aWord.size()) == 0 ? slot.mClasses : 0;
+}
+
 const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Cpp()
 {
 	static bool inited = false;
@@ -451,6 +813,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Cpp()
 
 		langDef.mName = "C++";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -504,15 +868,25 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Hlsl()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([ \t]*#[ \t]*[a-zA-Z_]+)##", PaletteIndex::Preprocessor));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(L?\"(\\.|[^\"])*\")##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(\'\\?[^\']\')##", PaletteIndex::CharLiteral));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?[0-9]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[0-7]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([a-zA-Z_][a-zA-Z0-9_]*)##", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([\[\]\{\}\!\%\^\&\*\(\)\-\+\=\~\|\<\>\?\/\;\,\.])##", PaletteIndex::Punctuation));
+		langDef.mTokenize = [](const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end, PaletteIndex& paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			if (TokenizeHashPreprocessorDirective(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Preprocessor;
+			else if (TokenizePrefixedEscapedString(in_begin, in_end, "L", '"', out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeSingleCharLiteral(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::CharLiteral;
+			else if (TokenizeDecimalNumber(in_begin, in_end, true, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Identifier;
+			else if (TokenizeOperatorPunctuation(in_begin, in_end, false, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -522,6 +896,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Hlsl()
 
 		langDef.mName = "HLSL";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -552,15 +928,25 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Glsl()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([ \t]*#[ \t]*[a-zA-Z_]+)##", PaletteIndex::Preprocessor));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(L?\"(\\.|[^\"])*\")##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(\'\\?[^\']\')##", PaletteIndex::CharLiteral));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?[0-9]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[0-7]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([a-zA-Z_][a-zA-Z0-9_]*)##", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([\[\]\{\}\!\%\^\&\*\(\)\-\+\=\~\|\<\>\?\/\;\,\.])##", PaletteIndex::Punctuation));
+		langDef.mTokenize = [](const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end, PaletteIndex& paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			if (TokenizeHashPreprocessorDirective(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Preprocessor;
+			else if (TokenizePrefixedEscapedString(in_begin, in_end, "L", '"', out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeSingleCharLiteral(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::CharLiteral;
+			else if (TokenizeDecimalNumber(in_begin, in_end, true, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Identifier;
+			else if (TokenizeOperatorPunctuation(in_begin, in_end, false, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -570,6 +956,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Glsl()
 
 		langDef.mName = "GLSL";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -597,14 +985,23 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Python()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##((b|u|f|r)?\"(\\.|[^\"])*\")##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##((b|u|f|r)?'(\\.|[^'])*')##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?[0-9]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[0-7]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([a-zA-Z_][a-zA-Z0-9_]*)##", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([\[\]\{\}\!\%\^\&\*\(\)\-\+\=\~\|\<\>\?\/\;\,\.\:])##", PaletteIndex::Punctuation));
+		langDef.mTokenize = [](const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end, PaletteIndex& paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			if (TokenizePrefixedEscapedString(in_begin, in_end, "bufr", '"', out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizePrefixedEscapedString(in_begin, in_end, "bufr", '\'', out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeDecimalNumber(in_begin, in_end, true, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Identifier;
+			else if (TokenizeOperatorPunctuation(in_begin, in_end, true, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
 
 		langDef.mCommentStart = "\"\"\"";
 		langDef.mCommentEnd = "\"\"\"";
@@ -614,6 +1011,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Python()
 
 		langDef.mName = "Python";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -679,6 +1078,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::C()
 
 		langDef.mName = "C";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -725,14 +1126,23 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Sql()
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(L?\"(\\.|[^\"])*\")##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(\'[^\']*\')##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?[0-9]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[0-7]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([a-zA-Z_][a-zA-Z0-9_]*)##", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([\[\]\{\}\!\%\^\&\*\(\)\-\+\=\~\|\<\>\?\/\;\,\.])##", PaletteIndex::Punctuation));
+		langDef.mTokenize = [](const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end, PaletteIndex& paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			if (TokenizePrefixedEscapedString(in_begin, in_end, "L", '"', out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeSqlStyleString(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeDecimalNumber(in_begin, in_end, true, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Identifier;
+			else if (TokenizeOperatorPunctuation(in_begin, in_end, false, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -742,6 +1152,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Sql()
 
 		langDef.mName = "SQL";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -774,14 +1186,23 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::AngelScrip
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(L?\"(\\.|[^\"])*\")##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(\'\\?[^\']\')##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?[0-9]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[0-7]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([a-zA-Z_][a-zA-Z0-9_]*)##", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([\[\]\{\}\!\%\^\&\*\(\)\-\+\=\~\|\<\>\?\/\;\,\.])##", PaletteIndex::Punctuation));
+		langDef.mTokenize = [](const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end, PaletteIndex& paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			if (TokenizePrefixedEscapedString(in_begin, in_end, "L", '"', out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeSingleCharLiteral(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeDecimalNumber(in_begin, in_end, true, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Identifier;
+			else if (TokenizeOperatorPunctuation(in_begin, in_end, false, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -791,6 +1212,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::AngelScrip
 
 		langDef.mName = "AngelScript";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -861,6 +1284,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Lua()
 
 		langDef.mName = "Lua";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -887,13 +1312,21 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Cs()
 			id.mDeclaration = "Built-in function";
 			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
 		}
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(($|@)?\"(\\.|[^\"])*\")##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?[0-9]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[0-7]+[Uu]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([a-zA-Z_][a-zA-Z0-9_]*)##", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([\[\]\{\}\!\%\^\&\*\(\)\-\+\=\~\|\<\>\?\/\;\,\.])##", PaletteIndex::Punctuation));
+		langDef.mTokenize = [](const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end, PaletteIndex& paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			if (TokenizePrefixedEscapedString(in_begin, in_end, "@", '"', out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeDecimalNumber(in_begin, in_end, true, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Identifier;
+			else if (TokenizeOperatorPunctuation(in_begin, in_end, false, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -903,6 +1336,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Cs()
 
 		langDef.mName = "C#";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -918,10 +1353,21 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Json()
 		langDef.mIdentifiers.clear();
 
 		
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(\"(\\.|[^\"])*\")##", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?)##", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##([\[\]\{\}\!\%\^\&\*\(\)\-\+\=\~\|\<\>\?\/\;\,\.\:])##", PaletteIndex::Punctuation));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>(R"##(false|true)##", PaletteIndex::Keyword));
+		langDef.mTokenize = [](const char* in_begin, const char* in_end, const char*& out_begin, const char*& out_end, PaletteIndex& paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			if (TokenizeEscapedString(in_begin, in_end, '"', out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeDecimalNumber(in_begin, in_end, false, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeOperatorPunctuation(in_begin, in_end, true, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+			else if (TokenizeWord(in_begin, in_end, "false", out_begin, out_end) || TokenizeWord(in_begin, in_end, "true", out_begin, out_end))
+				paletteIndex = PaletteIndex::Keyword;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
 
 		langDef.mCommentStart = "/*";
 		langDef.mCommentEnd = "*/";
@@ -931,6 +1377,8 @@ const TextEditor::LanguageDefinition& TextEditor::LanguageDefinition::Json()
 
 		langDef.mName = "Json";
 
+		langDef.mKeywordTable.Build(langDef);
+
 		inited = true;
 	}
 	return langDef;
@@ -0,0 +1,188 @@
+#include "TextEditor.h"
+
+// ---------- Chunked line storage --------- //
+
+void TextEditor::LineStore::clear()
+{
+	mChunks.clear();
+	mIndex.clear();
+	mIndexDirty = false;
+	mSize = 0;
+	mCacheChunk = 0;
+	mCacheStart = 0;
+}
+
+void TextEditor::LineStore::resize(size_t aCount)
+{
+	if (aCount < mSize)
+		erase(aCount, mSize);
+	while (mSize < aCount)
+		emplace_back();
+}
+
+TextEditor::Line& TextEditor::LineStore::emplace_back(Line&& aLine)
+{
+	if (mChunks.empty() || mChunks.back().size() >= kChunkSize)
+	{
+		mChunks.emplace_back();
+		mChunks.back().reserve(kChunkSize);
+		mIndexDirty = true; // chunk starts before the new one are unchanged, so the cache stays valid
+	}
+	else
+		AddToIndex(mChunks.size() - 1, 1);
+	mChunks.back().push_back(std::move(aLine));
+	mSize++;
+	return mChunks.back().back();
+}
+
+TextEditor::Line& TextEditor::LineStore::insert(size_t aIndex, Line&& aLine)
+{
+	assert(aIndex <= mSize);
+	if (aIndex == mSize)
+		return emplace_back(std::move(aLine));
+
+	Locate(aIndex);
+	auto& chunk = mChunks[mCacheChunk];
+	chunk.insert(chunk.begin() + (aIndex - mCacheStart), std::move(aLine));
+	mSize++;
+	if (chunk.size() > kMaxChunkSize)
+		SplitChunk(mCacheChunk);
+	else
+		AddToIndex(mCacheChunk, 1);
+	return (*this)[aIndex];
+}
+
+void TextEditor::LineStore::erase(size_t aStart, size_t aEnd)
+{
+	assert(aStart <= aEnd && aEnd <= mSize);
+	if (aStart == aEnd)
+		return;
+
+	Locate(aStart);
+	size_t chunkIndex = mCacheChunk;
+	size_t offset = aStart - mCacheStart;
+	size_t remaining = aEnd - aStart;
+	while (remaining > 0)
+	{
+		auto& chunk = mChunks[chunkIndex];
+		size_t count = std::min(remaining, chunk.size() - offset);
+		chunk.erase(chunk.begin() + offset, chunk.begin() + offset + count);
+		remaining -= count;
+		mSize -= count;
+		if (chunk.empty())
+		{
+			mChunks.erase(mChunks.begin() + chunkIndex);
+			mIndexDirty = true;
+		}
+		else
+		{
+			AddToIndex(chunkIndex, -(int)count);
+			chunkIndex++;
+		}
+		offset = 0;
+	}
+
+	if (mIndexDirty)
+	{
+		mCacheChunk = 0;
+		mCacheStart = 0;
+	}
+	if (mCacheChunk < mChunks.size())
+		MergeChunk(mCacheChunk);
+}
+
+void TextEditor::LineStore::LocateSlow(size_t aIndex) const
+{
+	// forward/backward iteration usually just steps into a neighbouring chunk
+	if (aIndex >= mCacheStart && mCacheChunk + 1 < mChunks.size())
+	{
+		size_t nextStart = mCacheStart + mChunks[mCacheChunk].size();
+		if (aIndex - nextStart < mChunks[mCacheChunk + 1].size())
+		{
+			mCacheChunk++;
+			mCacheStart = nextStart;
+			return;
+		}
+	}
+	else if (aIndex < mCacheStart && mCacheChunk > 0 && mCacheStart - aIndex <= mChunks[mCacheChunk - 1].size())
+	{
+		mCacheChunk--;
+		mCacheStart -= mChunks[mCacheChunk].size();
+		return;
+	}
+
+	if (mIndexDirty)
+		RebuildIndex();
+
+	size_t chunkCount = mChunks.size();
+	size_t step = 1;
+	while (step * 2 <= chunkCount)
+		step *= 2;
+	size_t position = 0;
+	size_t remaining = aIndex;
+	for (; step > 0; step /= 2)
+	{
+		if (position + step <= chunkCount && (size_t)mIndex[position + step] <= remaining)
+		{
+			position += step;
+			remaining -= mIndex[position];
+		}
+	}
+	assert(position < chunkCount);
+	mCacheChunk = position;
+	mCacheStart = aIndex - remaining;
+}
+
+void TextEditor::LineStore::RebuildIndex() const
+{
+	size_t chunkCount = mChunks.size();
+	mIndex.assign(chunkCount + 1, 0);
+	for (size_t i = 1; i <= chunkCount; i++)
+	{
+		mIndex[i] += (int)mChunks[i - 1].size();
+		size_t parent = i + (i & (~i + 1));
+		if (parent <= chunkCount)
+			mIndex[parent] += mIndex[i];
+	}
+	mIndexDirty = false;
+}
+
+void TextEditor::LineStore::AddToIndex(size_t aChunk, int aDelta)
+{
+	if (mIndexDirty)
+		return; // rebuilt on next lookup anyway
+	for (size_t i = aChunk + 1; i < mIndex.size(); i += i & (~i + 1))
+		mIndex[i] += aDelta;
+}
+
+void TextEditor::LineStore::SplitChunk(size_t aChunk)
+{
+	auto& chunk = mChunks[aChunk];
+	std::vector<Line> tail;
+	tail.reserve(kChunkSize);
+	size_t half = chunk.size() / 2;
+	for (size_t i = half; i < chunk.size(); i++)
+		tail.push_back(std::move(chunk[i]));
+	chunk.resize(half);
+	mChunks.insert(mChunks.begin() + aChunk + 1, std::move(tail));
+	mIndexDirty = true;
+	mCacheChunk = 0;
+	mCacheStart = 0;
+}
+
+void TextEditor::LineStore::MergeChunk(size_t aChunk)
+{
+	// fold an undersized chunk into its successor so deletions don't leave a trail of tiny chunks
+	if (mChunks[aChunk].size() >= kMinChunkSize || aChunk + 1 >= mChunks.size() ||
+		mChunks[aChunk].size() + mChunks[aChunk + 1].size() > kMaxChunkSize)
+		return;
+	auto& chunk = mChunks[aChunk];
+	auto& next = mChunks[aChunk + 1];
+	chunk.reserve(chunk.size() + next.size());
+	for (auto& line : next)
+		chunk.push_back(std::move(line));
+	mChunks.erase(mChunks.begin() + aChunk + 1);
+	mIndexDirty = true;
+	mCacheChunk = 0;
+	mCacheStart = 0;
+}
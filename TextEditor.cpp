@@ -2,11 +2,44 @@
 #include <string>
 #include <set>
 #include <cstring>
+#include <cstdio>
 #include <cctype>
 #include <cfloat>
-#include <regex>
+#include <deque>
+#include <iterator>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <functional>
 #include <boost/regex.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXT_EDITOR_FIND_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__GNUC__)
+#define TEXT_EDITOR_FIND_NEON
+#include <arm_neon.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "TextEditor.h"
 
 #define IMGUI_SCROLLBAR_WIDTH 14.0f
@@ -17,6 +50,467 @@
 namespace
 {
 	constexpr float FIND_REFRESH_DEFER_SECONDS = 0.12f;
+	constexpr int COLORIZE_JOB_LINES = 1024;
+	constexpr int COLORIZE_MAX_JOBS_IN_FLIGHT = 4;
+	constexpr int COLORIZE_PREFETCH_LINES = 64; // above and below the visible lines, colored along with them
+	constexpr int COLORIZE_BUDGET_CHECK_LINES = 8; // lines tokenized between two looks at the clock
+	constexpr int PARALLEL_COLORIZE_LINES_PER_THREAD = 256; // below this per thread the split is not worth threads
+	constexpr size_t PARALLEL_LOAD_MIN_BYTES = 4 << 20; // below this the newline scan is not worth threads
+	constexpr int AUTOCOMPLETE_MAX_SUGGESTIONS = 100;
+	constexpr int PERFORMANCE_HISTORY_FRAMES = 120;
+	constexpr char SNAPSHOT_MAGIC[8] = { 'T', 'E', 'S', 'N', 'A', 'P', '\r', '\n' };
+	constexpr uint32_t SNAPSHOT_FORMAT_VERSION = 2; // bumped whenever the layout or a built-in tokenizer changes
+	constexpr uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+	// Adds the time spent in its scope, in milliseconds, to a stats field
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(float& aTarget) : mTarget(aTarget), mStart(std::chrono::steady_clock::now()) {}
+		~ScopedTimer() { mTarget += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - mStart).count(); }
+	private:
+		float& mTarget;
+		std::chrono::steady_clock::time_point mStart;
+	};
+
+	class ScopedCount
+	{
+	public:
+		explicit ScopedCount(int& aCounter) : mCounter(aCounter) { ++mCounter; }
+		~ScopedCount() { --mCounter; }
+	private:
+		int& mCounter;
+	};
+
+	// Line::mEntryState bits, the comment scan state carried from one line into the next
+	enum : uint8_t
+	{
+		COMMENT_STATE_MULTILINE_COMMENT = 1 << 0,
+		COMMENT_STATE_STRING = 1 << 1,
+		COMMENT_STATE_CONCATENATE = 1 << 2,
+		COMMENT_STATE_SINGLE_LINE_COMMENT = 1 << 3,
+		COMMENT_STATE_PREPROCESSOR = 1 << 4,
+		COMMENT_STATE_FIRST_CHAR = 1 << 5
+	};
+
+	// FNV-1a, for keying cached geometry and language definitions in snapshots
+	uint64_t HashBytes(const void* aData, size_t aSize, uint64_t aHash = 0xcbf29ce484222325ull)
+	{
+		const unsigned char* bytes = (const unsigned char*)aData;
+		for (size_t i = 0; i < aSize; i++)
+			aHash = (aHash ^ bytes[i]) * 0x100000001b3ull;
+		return aHash;
+	}
+
+	inline int CountTrailingZeros(uint32_t aValue)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, aValue);
+		return (int)index;
+#else
+		return __builtin_ctz(aValue);
+#endif
+	}
+
+	// '(' '[' '{' are kinds 0 to 2, their closing brackets 3 to 5, anything else -1
+	inline int BracketKind(char aChar)
+	{
+		switch (aChar)
+		{
+		case '(': return 0;
+		case '[': return 1;
+		case '{': return 2;
+		case ')': return 3;
+		case ']': return 4;
+		case '}': return 5;
+		default: return -1;
+		}
+	}
+
+	// brackets in strings and comments are text, they neither open nor close anything
+	inline bool IsBracketGlyph(const TextEditor::Glyph& aGlyph)
+	{
+		TextEditor::PaletteIndex color = aGlyph.GetColorIndex();
+		return !aGlyph.mComment && !aGlyph.mMultiLineComment && color != TextEditor::PaletteIndex::String && color != TextEditor::PaletteIndex::CharLiteral;
+	}
+
+	inline char FoldAscii(char aChar)
+	{
+		return (aChar >= 'A' && aChar <= 'Z') ? aChar - 'A' + 'a' : aChar;
+	}
+
+	inline bool LiteralEquals(const char* aText, const char* aNeedle, size_t aLength, bool aCaseSensitive)
+	{
+		if (aCaseSensitive)
+			return std::memcmp(aText, aNeedle, aLength) == 0;
+		for (size_t i = 0; i < aLength; i++)
+		{
+			if (FoldAscii(aText[i]) != FoldAscii(aNeedle[i]))
+				return false;
+		}
+		return true;
+	}
+
+	// First occurrence of aNeedle in [aBegin, aEnd), nullptr if there is none. Sixteen candidate positions are
+	// tested at once on the needle's first and last byte and only those where both agree are compared in full.
+	// Case folding is ASCII only: a letter matches either case once 0x20 is or-ed into the text byte.
+	const char* FindLiteral(const char* aBegin, const char* aEnd, const char* aNeedle, size_t aLength, bool aCaseSensitive)
+	{
+		if (aLength == 0 || (size_t)(aEnd - aBegin) < aLength)
+			return nullptr;
+		const char* lastStart = aEnd - aLength;
+		char first = aNeedle[0];
+		char last = aNeedle[aLength - 1];
+		char firstFold = 0;
+		char lastFold = 0;
+		if (!aCaseSensitive)
+		{
+			if ((first | 0x20) >= 'a' && (first | 0x20) <= 'z')
+			{
+				first |= 0x20;
+				firstFold = 0x20;
+			}
+			if ((last | 0x20) >= 'a' && (last | 0x20) <= 'z')
+			{
+				last |= 0x20;
+				lastFold = 0x20;
+			}
+		}
+
+		const char* p = aBegin;
+#if defined(TEXT_EDITOR_FIND_SSE2)
+		const __m128i firstBytes = _mm_set1_epi8(first);
+		const __m128i lastBytes = _mm_set1_epi8(last);
+		const __m128i firstFoldBits = _mm_set1_epi8(firstFold);
+		const __m128i lastFoldBits = _mm_set1_epi8(lastFold);
+		for (; lastStart - p >= 15; p += 16)
+		{
+			__m128i head = _mm_or_si128(_mm_loadu_si128((const __m128i*)p), firstFoldBits);
+			__m128i tail = _mm_or_si128(_mm_loadu_si128((const __m128i*)(p + aLength - 1)), lastFoldBits);
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, firstBytes), _mm_cmpeq_epi8(tail, lastBytes)));
+			for (; mask != 0; mask &= mask - 1)
+			{
+				const char* candidate = p + CountTrailingZeros(mask);
+				if (LiteralEquals(candidate, aNeedle, aLength, aCaseSensitive))
+					return candidate;
+			}
+		}
+#elif defined(TEXT_EDITOR_FIND_NEON)
+		const uint8x16_t firstBytes = vdupq_n_u8((uint8_t)first);
+		const uint8x16_t lastBytes = vdupq_n_u8((uint8_t)last);
+		const uint8x16_t firstFoldBits = vdupq_n_u8((uint8_t)firstFold);
+		const uint8x16_t lastFoldBits = vdupq_n_u8((uint8_t)lastFold);
+		for (; lastStart - p >= 15; p += 16)
+		{
+			uint8x16_t head = vorrq_u8(vld1q_u8((const uint8_t*)p), firstFoldBits);
+			uint8x16_t tail = vorrq_u8(vld1q_u8((const uint8_t*)(p + aLength - 1)), lastFoldBits);
+			uint8x16_t equal = vandq_u8(vceqq_u8(head, firstBytes), vceqq_u8(tail, lastBytes));
+			// four mask bits per lane, there is no movemask on NEON
+			uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+			while (mask != 0)
+			{
+				int bit = __builtin_ctzll(mask);
+				const char* candidate = p + (bit >> 2);
+				if (LiteralEquals(candidate, aNeedle, aLength, aCaseSensitive))
+					return candidate;
+				mask &= ~(0xFull << (bit & ~3));
+			}
+		}
+#endif
+		for (; p <= lastStart; p++)
+		{
+			if ((char)(*p | firstFold) == first && (char)(p[aLength - 1] | lastFold) == last && LiteralEquals(p, aNeedle, aLength, aCaseSensitive))
+				return p;
+		}
+		return nullptr;
+	}
+
+	// Offset of every '\n' in aData between aFrom and aTo, sixteen bytes at a time.
+	void CollectLineBreaks(const char* aData, size_t aFrom, size_t aTo, std::vector<size_t>& outBreaks)
+	{
+		const char* p = aData + aFrom;
+		const char* end = aData + aTo;
+#if defined(TEXT_EDITOR_FIND_SSE2)
+		const __m128i newline = _mm_set1_epi8('\n');
+		for (; end - p >= 16; p += 16)
+		{
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), newline));
+			for (; mask != 0; mask &= mask - 1)
+				outBreaks.push_back((p - aData) + CountTrailingZeros(mask));
+		}
+#elif defined(TEXT_EDITOR_FIND_NEON)
+		const uint8x16_t newline = vdupq_n_u8((uint8_t)'\n');
+		for (; end - p >= 16; p += 16)
+		{
+			uint8x16_t equal = vceqq_u8(vld1q_u8((const uint8_t*)p), newline);
+			uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+			while (mask != 0)
+			{
+				int bit = __builtin_ctzll(mask);
+				outBreaks.push_back((p - aData) + (bit >> 2));
+				mask &= ~(0xFull << (bit & ~3));
+			}
+		}
+#endif
+		for (; p < end; p++)
+		{
+			if (*p == '\n')
+				outBreaks.push_back(p - aData);
+		}
+	}
+
+	// First byte in [aBegin, aEnd) equal to one of aStops, aEnd if there is none, sixteen bytes at a time.
+	// Fewer stops are given by repeating one.
+	const char* FindAnyOf(const char* aBegin, const char* aEnd, const char (&aStops)[4])
+	{
+		const char* p = aBegin;
+#if defined(TEXT_EDITOR_FIND_SSE2)
+		const __m128i stop0 = _mm_set1_epi8(aStops[0]);
+		const __m128i stop1 = _mm_set1_epi8(aStops[1]);
+		const __m128i stop2 = _mm_set1_epi8(aStops[2]);
+		const __m128i stop3 = _mm_set1_epi8(aStops[3]);
+		for (; aEnd - p >= 16; p += 16)
+		{
+			__m128i bytes = _mm_loadu_si128((const __m128i*)p);
+			__m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, stop0), _mm_cmpeq_epi8(bytes, stop1)),
+				_mm_or_si128(_mm_cmpeq_epi8(bytes, stop2), _mm_cmpeq_epi8(bytes, stop3)));
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(hits);
+			if (mask != 0)
+				return p + CountTrailingZeros(mask);
+		}
+#elif defined(TEXT_EDITOR_FIND_NEON)
+		const uint8x16_t stop0 = vdupq_n_u8((uint8_t)aStops[0]);
+		const uint8x16_t stop1 = vdupq_n_u8((uint8_t)aStops[1]);
+		const uint8x16_t stop2 = vdupq_n_u8((uint8_t)aStops[2]);
+		const uint8x16_t stop3 = vdupq_n_u8((uint8_t)aStops[3]);
+		for (; aEnd - p >= 16; p += 16)
+		{
+			uint8x16_t bytes = vld1q_u8((const uint8_t*)p);
+			uint8x16_t hits = vorrq_u8(vorrq_u8(vceqq_u8(bytes, stop0), vceqq_u8(bytes, stop1)),
+				vorrq_u8(vceqq_u8(bytes, stop2), vceqq_u8(bytes, stop3)));
+			uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+			if (mask != 0)
+				return p + (__builtin_ctzll(mask) >> 2);
+		}
+#endif
+		for (; p < aEnd; p++)
+		{
+			if (*p == aStops[0] || *p == aStops[1] || *p == aStops[2] || *p == aStops[3])
+				return p;
+		}
+		return aEnd;
+	}
+
+	// Calls aUse with the contents of a file, mapped rather than read so the file is never held in a
+	// second buffer. False if the file could not be opened or mapped, otherwise what aUse returned.
+	template<typename TUse>
+	bool UseMappedFile(const char* aPath, TUse&& aUse)
+	{
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(aPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			return false;
+		}
+		if (size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return aUse("", 0);
+		}
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		const char* data = mapping != nullptr ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		bool result = false;
+		if (data != nullptr)
+		{
+			result = aUse(data, (size_t)size.QuadPart);
+			UnmapViewOfFile(data);
+		}
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return result;
+#else
+		int file = open(aPath, O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		if (fstat(file, &info) != 0)
+		{
+			close(file);
+			return false;
+		}
+		size_t size = (size_t)info.st_size;
+		if (size == 0)
+		{
+			close(file);
+			return aUse("", 0);
+		}
+		void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (data == MAP_FAILED)
+			return false;
+		madvise(data, size, MADV_SEQUENTIAL);
+		bool result = aUse((const char*)data, size);
+		munmap(data, size);
+		return result;
+#endif
+	}
+
+	// Output gathered into a fixed buffer so small pieces do not cost a writer call each
+	class BufferedWriter
+	{
+	public:
+		BufferedWriter(TextEditor::TextWriter aWriter, void* aUserData) : mWriter(aWriter), mUserData(aUserData) {}
+		bool Put(const void* aData, size_t aSize)
+		{
+			if (mUsed + aSize > sizeof(mBuffer))
+			{
+				if (!Flush())
+					return false;
+				if (aSize >= sizeof(mBuffer))
+					return mWriter((const char*)aData, aSize, mUserData); // large piece, written straight from where it is
+			}
+			if (aSize > 0) // empty lines have no storage to copy from
+				std::memcpy(mBuffer + mUsed, aData, aSize);
+			mUsed += aSize;
+			return true;
+		}
+		bool Flush()
+		{
+			bool written = mUsed == 0 || mWriter(mBuffer, mUsed, mUserData);
+			mUsed = 0;
+			return written;
+		}
+	private:
+		TextEditor::TextWriter mWriter;
+		void* mUserData;
+		char mBuffer[64 * 1024];
+		size_t mUsed = 0;
+	};
+
+	// A snapshot is this header, then for every line its size in bytes (uint32_t), its comment entry
+	// state and whether it was colored (a byte each), then the text of every line back to back and
+	// the glyphs of every line back to back, the editor state and the undo records. Everything is in
+	// the byte order and Glyph layout of the build that wrote it, which the header is checked against.
+	struct SnapshotHeader
+	{
+		char mMagic[8];
+		uint32_t mFormatVersion;
+		uint32_t mByteOrder;
+		uint64_t mLanguageFingerprint;
+		uint32_t mLanguageId;
+		int32_t mFirstVisibleLine;
+		uint64_t mLineCount;
+		uint64_t mTextSize;
+		int32_t mCheckCommentsFromLine; // comment scan still pending for these lines, -1 for none
+		int32_t mCheckCommentsToLine;
+		uint64_t mUndoCount; // 0 when saved without the history
+		int32_t mUndoIndex;
+		int32_t mTabSize; // cursor and undo columns count tabs with it
+	};
+
+	// Reads in place, every read checked against the end of the data
+	class SnapshotReader
+	{
+	public:
+		SnapshotReader(const char* aData, size_t aSize) : mPosition(aData), mEnd(aData + aSize) {}
+		const char* Take(uint64_t aSize)
+		{
+			if ((uint64_t)(mEnd - mPosition) < aSize)
+				return nullptr;
+			const char* taken = mPosition;
+			mPosition += aSize;
+			return taken;
+		}
+		template<typename T>
+		bool Read(T& aValue)
+		{
+			const char* data = Take(sizeof(T));
+			if (data != nullptr)
+				std::memcpy(&aValue, data, sizeof(T));
+			return data != nullptr;
+		}
+		size_t Remaining() const { return mEnd - mPosition; }
+	private:
+		const char* mPosition;
+		const char* mEnd;
+	};
+
+	bool PutEditorState(BufferedWriter& aOut, const TextEditor::EditorState& aState)
+	{
+		int32_t counts[3] = { aState.mCurrentCursor, aState.mLastAddedCursor, aState.mCurrentCursor + 1 };
+		if (!aOut.Put(counts, sizeof(counts)))
+			return false;
+		for (int c = 0; c <= aState.mCurrentCursor; c++)
+		{
+			const auto& cursor = aState.mCursors[c];
+			int32_t coordinates[4] = { cursor.mInteractiveStart.mLine, cursor.mInteractiveStart.mColumn, cursor.mInteractiveEnd.mLine, cursor.mInteractiveEnd.mColumn };
+			if (!aOut.Put(coordinates, sizeof(coordinates)))
+				return false;
+		}
+		return true;
+	}
+
+	bool ReadEditorState(SnapshotReader& aIn, TextEditor::EditorState& aState)
+	{
+		int32_t counts[3];
+		// mLastAddedCursor may be left past mCurrentCursor when cursors are cleared, see GetLastAddedCursorIndex
+		if (!aIn.Read(counts) || counts[0] < 0 || counts[2] != counts[0] + 1 || counts[1] < 0 ||
+			(uint64_t)counts[2] * 4 * sizeof(int32_t) > aIn.Remaining())
+			return false;
+		aState.mCurrentCursor = counts[0];
+		aState.mLastAddedCursor = counts[1];
+		aState.mCursors.resize(counts[2]);
+		for (auto& cursor : aState.mCursors)
+		{
+			int32_t coordinates[4];
+			aIn.Read(coordinates);
+			if (coordinates[0] < 0 || coordinates[1] < 0 || coordinates[2] < 0 || coordinates[3] < 0)
+				return false;
+			cursor.mInteractiveStart = TextEditor::Coordinates(coordinates[0], coordinates[1]);
+			cursor.mInteractiveEnd = TextEditor::Coordinates(coordinates[2], coordinates[3]);
+		}
+		return true;
+	}
+
+	// Changes whenever the definition would color text differently. Keywords and identifiers are kept
+	// in unordered containers, their hashes are summed so the order they come in does not matter.
+	uint64_t LanguageFingerprint(const TextEditor::LanguageDefinition* aDefinition)
+	{
+		if (aDefinition == nullptr)
+			return 0;
+		uint64_t hash = 0xcbf29ce484222325ull;
+		auto addString = [&](const std::string& aText)
+		{
+			uint64_t size = aText.size();
+			hash = HashBytes(&size, sizeof(size), hash);
+			hash = HashBytes(aText.data(), aText.size(), hash);
+		};
+		addString(aDefinition->mName);
+		addString(aDefinition->mCommentStart);
+		addString(aDefinition->mCommentEnd);
+		addString(aDefinition->mSingleLineComment);
+		uint8_t settings[3] = { (uint8_t)aDefinition->mPreprocChar, aDefinition->mCaseSensitive, aDefinition->mTokenize != nullptr };
+		hash = HashBytes(settings, sizeof(settings), hash);
+		for (const auto& token : aDefinition->mTokenRegexStrings)
+		{
+			addString(token.first);
+			hash = HashBytes(&token.second, sizeof(token.second), hash);
+		}
+		uint64_t words = 0;
+		for (const auto& keyword : aDefinition->mKeywords)
+			words += HashBytes(keyword.data(), keyword.size());
+		for (const auto& identifier : aDefinition->mIdentifiers)
+			words += HashBytes(identifier.first.data(), identifier.first.size()) * 3;
+		for (const auto& identifier : aDefinition->mPreprocIdentifiers)
+			words += HashBytes(identifier.first.data(), identifier.first.size()) * 5;
+		return HashBytes(&words, sizeof(words), hash);
+	}
 }
 
 
@@ -24,15 +518,270 @@ struct TextEditor::RegexList {
     std::vector<std::pair<boost::regex, TextEditor::PaletteIndex>> mValue;
 };
 
+// A run of lines copied on the UI thread for the worker to tokenize. The copies are private to the
+// job, so the worker never touches the document.
+struct TextEditor::ColorizeJob
+{
+	const Document* mOwner = nullptr; // any view of the document may take the results
+	const LanguageDefinition* mLanguageDefinition = nullptr;
+	std::shared_ptr<RegexList> mRegexList; // keeps the regexes alive across a language switch
+	int mFirstLine = 0;
+	uint32_t mLineLayoutVersion = 0; // lines may have moved under the same revision when this changed
+	std::vector<Line> mLines;
+};
+
+struct TextEditor::ColorizeWorker
+{
+	std::mutex mMutex;
+	std::condition_variable mWakeUp;
+	std::deque<ColorizeJob> mQueued;
+	std::vector<ColorizeJob> mFinished;
+	int mBusy = 0;
+	bool mQuit = false;
+	std::thread mThread; // last, so everything above exists before the thread starts
+
+	ColorizeWorker() : mThread([this] { Run(); }) {}
+	~ColorizeWorker()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWakeUp.notify_one();
+		mThread.join();
+	}
+
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		for (;;)
+		{
+			mWakeUp.wait(lock, [this] { return mQuit || !mQueued.empty(); });
+			if (mQuit)
+				return;
+			ColorizeJob job = std::move(mQueued.front());
+			mQueued.pop_front();
+			mBusy++;
+			lock.unlock();
+
+			for (auto& line : job.mLines)
+				ColorizeLine(line, *job.mLanguageDefinition, *job.mRegexList);
+
+			lock.lock();
+			mBusy--;
+			mFinished.push_back(std::move(job));
+		}
+	}
+};
+
+// Threads kept for ColorizeRange while parallel colorization is on. A call hands out slices of its lines
+// to the pool and to the calling thread alike, and returns once every slice is done.
+struct TextEditor::ColorizePool
+{
+	std::mutex mMutex;
+	std::condition_variable mWakeUp;
+	std::condition_variable mSlicesDone;
+	std::function<void(size_t)> mTask; // colorizes one slice, set while a call is in progress
+	size_t mSliceCount = 0;
+	size_t mNextSlice = 0;
+	size_t mSlicesLeft = 0; // not finished yet
+	bool mQuit = false;
+	std::vector<std::thread> mThreads;
+
+	explicit ColorizePool(unsigned int aThreadCount)
+	{
+		for (unsigned int t = 0; t < aThreadCount; t++)
+			mThreads.emplace_back([this] { Run(); });
+	}
+	~ColorizePool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWakeUp.notify_all();
+		for (auto& thread : mThreads)
+			thread.join();
+	}
+
+	void ForEachSlice(size_t aSliceCount, const std::function<void(size_t)>& aTask)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mTask = aTask;
+		mSliceCount = aSliceCount;
+		mNextSlice = 0;
+		mSlicesLeft = aSliceCount;
+		mWakeUp.notify_all();
+		TakeSlices(lock);
+		mSlicesDone.wait(lock, [this] { return mSlicesLeft == 0; });
+		mTask = nullptr;
+	}
+
+	void TakeSlices(std::unique_lock<std::mutex>& aLock)
+	{
+		while (mNextSlice < mSliceCount)
+		{
+			size_t slice = mNextSlice++;
+			aLock.unlock();
+			mTask(slice);
+			aLock.lock();
+			if (--mSlicesLeft == 0)
+				mSlicesDone.notify_all();
+		}
+	}
+
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		for (;;)
+		{
+			mWakeUp.wait(lock, [this] { return mQuit || mNextSlice < mSliceCount; });
+			if (mQuit)
+				return;
+			TakeSlices(lock);
+		}
+	}
+};
+
+// Regex search over a copy of the search range, run by the view's RegexFindWorker so that dropping a slow
+// search never blocks the UI. The editor only ever cancels it and takes the matches found so far; the
+// worker holds its own reference and lets go once the current regex step returns.
+struct TextEditor::RegexFindJob
+{
+	struct Match
+	{
+		int mStartLine;
+		int mStartIndex;
+		int mEndLine;
+		int mEndIndex;
+	};
+
+	std::string mText; // the search range, lines joined with '\n'
+	std::vector<size_t> mLineOffsets; // where each line of the range starts in mText
+	int mFirstLine = 0;
+	int mFirstIndex = 0; // character index mText starts at on mFirstLine
+	boost::regex mRegex;
+	std::atomic<bool> mCancelled{ false };
+
+	std::mutex mMutex;
+	std::condition_variable mFinishedSignal;
+	std::vector<Match> mMatches; // found and not yet taken by the editor
+	bool mFinished = false;
+	bool mFailed = false;
+
+	// editor side only
+	uint32_t mDocumentVersion = 0;
+	std::pair<int, int> mCursor;
+	std::pair<int, int> mPreservedStart;
+	std::pair<int, int> mPreservedEnd;
+	bool mPreservedValid = false;
+	bool mResultChosen = false;
+
+	void Run()
+	{
+		bool failed = false;
+		try
+		{
+			auto flags = boost::match_default | boost::match_not_dot_newline | boost::match_single_line;
+			for (boost::sregex_iterator it(mText.begin(), mText.end(), mRegex, flags), end; it != end && !mCancelled; ++it)
+			{
+				if (it->length() == 0)
+					continue;
+				size_t start = (size_t)it->position();
+				Match match;
+				ToPosition(start, match.mStartLine, match.mStartIndex);
+				ToPosition(start + (size_t)it->length(), match.mEndLine, match.mEndIndex);
+				std::lock_guard<std::mutex> lock(mMutex);
+				mMatches.push_back(match);
+			}
+		}
+		catch (const std::runtime_error&)
+		{
+			failed = true; // boost gives up on patterns that backtrack without bound
+		}
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFailed = failed;
+		mFinished = true;
+		mFinishedSignal.notify_all();
+	}
+
+	void ToPosition(size_t aOffset, int& outLine, int& outIndex) const
+	{
+		size_t line = std::upper_bound(mLineOffsets.begin(), mLineOffsets.end(), aOffset) - mLineOffsets.begin() - 1;
+		outLine = mFirstLine + (int)line;
+		outIndex = (int)(aOffset - mLineOffsets[line]) + (line == 0 ? mFirstIndex : 0);
+	}
+};
+
+// One thread per view for its regex searches. Only the latest search is worth running, so the queue holds
+// a single job: a newer one takes the place of one that has not started yet.
+struct TextEditor::RegexFindWorker
+{
+	std::mutex mMutex;
+	std::condition_variable mWakeUp;
+	std::shared_ptr<RegexFindJob> mQueued;
+	bool mQuit = false;
+	std::thread mThread; // last, so everything above exists before the thread starts
+
+	RegexFindWorker() : mThread([this] { Run(); }) {}
+	~RegexFindWorker()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWakeUp.notify_one();
+		mThread.join();
+	}
+
+	void Submit(const std::shared_ptr<RegexFindJob>& aJob)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQueued = aJob;
+		}
+		mWakeUp.notify_one();
+	}
+
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		for (;;)
+		{
+			mWakeUp.wait(lock, [this] { return mQuit || mQueued != nullptr; });
+			if (mQuit)
+				return;
+			std::shared_ptr<RegexFindJob> job = std::move(mQueued);
+			mQueued.reset();
+			lock.unlock();
+			if (!job->mCancelled)
+				job->Run();
+			job.reset();
+			lock.lock();
+		}
+	}
+};
+
 
 // --------------------------------------- //
 // ------------- Exposed API ------------- //
 
 TextEditor::TextEditor()
-    : mRegexList(std::make_shared<RegexList>())
+	: TextEditor(std::make_shared<Document>())
 {
+}
+
+TextEditor::TextEditor(const std::shared_ptr<Document>& aDocument)
+	: mDocument(aDocument)
+{
+	// a new document gets its first line, a shared one is taken as it is
+	if (mRegexList == nullptr)
+		mRegexList = GetRegexList(nullptr);
+	if (mLines.empty())
+		mLines.push_back(Line());
+	mViewDocumentVersion = mDocumentVersion;
+	mViews.push_back(this);
 	SetPalette(defaultPalette);
-	mLines.push_back(Line());
 	std::memset(mFindBuffer, 0, sizeof(mFindBuffer));
 	std::memset(mReplaceBuffer, 0, sizeof(mReplaceBuffer));
 	mFindRefreshPending = false;
@@ -41,6 +790,16 @@ TextEditor::TextEditor()
 
 TextEditor::~TextEditor()
 {
+	CancelRegexFind();
+	mRegexFindWorker.reset(); // joins once the cancelled search returns from its current regex step
+	mViews.erase(std::find(mViews.begin(), mViews.end(), this));
+
+	// the slot goes to the next view, the lines outlive this view and should not keep its matches
+	mFindIndex.mInUse = false;
+	if (mDocument.use_count() > 1 && mFindIndex.mUpdates > 0)
+		for (auto& line : mLines)
+			line.mFindOccurrences.erase(std::remove_if(line.mFindOccurrences.begin(), line.mFindOccurrences.end(),
+				[this](const FindOccurrence& aOccurrence) { return aOccurrence.mFindIndex == mFindIndex.mSlot; }), line.mFindOccurrences.end());
 }
 
 void TextEditor::SetPalette(PaletteId aValue)
@@ -74,6 +833,8 @@ void TextEditor::SetPalette(PaletteId aValue)
 void TextEditor::SetLanguageDefinition(LanguageDefinitionId aValue)
 {
 	mLanguageDefinitionId = aValue;
+	for (auto& line : mLines)
+		line.mColorizedRevision = Line::kNeverColorized;
 	switch (mLanguageDefinitionId)
 	{
 	case LanguageDefinitionId::None:
@@ -111,13 +872,46 @@ void TextEditor::SetLanguageDefinition(LanguageDefinitionId aValue)
 		break;
 	}
 
-    mRegexList->mValue.clear();
-	for (const auto& r : mLanguageDefinition->mTokenRegexStrings)
-        mRegexList->mValue.push_back(std::make_pair(boost::regex(r.first, boost::regex_constants::optimize), r.second));
+	mRegexList = GetRegexList(mLanguageDefinition);
 
 	Colorize();
 }
 
+// Compiled once per language for the whole process and never modified afterwards, so editors, their
+// background jobs and language switches can all hold on to the same list.
+std::shared_ptr<TextEditor::RegexList> TextEditor::GetRegexList(const LanguageDefinition* aLanguageDefinition)
+{
+	static std::mutex mutex;
+	static std::unordered_map<const LanguageDefinition*, std::shared_ptr<RegexList>> cache;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& regexList = cache[aLanguageDefinition];
+	if (regexList == nullptr)
+	{
+		regexList = std::make_shared<RegexList>();
+		if (aLanguageDefinition != nullptr)
+		{
+			for (const auto& r : aLanguageDefinition->mTokenRegexStrings)
+				regexList->mValue.push_back(std::make_pair(boost::regex(r.first, boost::regex_constants::optimize), r.second));
+		}
+	}
+	return regexList;
+}
+
+void TextEditor::SetBackgroundColorizationEnabled(bool aValue)
+{
+	if (aValue == IsBackgroundColorizationEnabled())
+		return;
+	if (aValue)
+		mColorizeWorker = std::make_shared<ColorizeWorker>();
+	else
+	{
+		// whatever the worker still had in flight is lost with it
+		mColorizeWorker.reset();
+		Colorize();
+	}
+}
+
 const char* TextEditor::GetLanguageDefinitionName() const
 {
 	return mLanguageDefinition != nullptr ? mLanguageDefinition->mName.c_str() : "None";
@@ -135,6 +929,7 @@ void TextEditor::SetLineSpacing(float aValue)
 
 void TextEditor::SelectAll()
 {
+	SyncWithDocument();
 	ClearSelections();
 	ClearExtraCursors();
 	MoveTop();
@@ -143,6 +938,7 @@ void TextEditor::SelectAll()
 
 void TextEditor::SelectLine(int aLine)
 {
+	SyncWithDocument();
 	ClearSelections();
 	ClearExtraCursors();
 	SetSelection({ aLine, 0 }, { aLine, GetLineMaxColumn(aLine) });
@@ -150,6 +946,7 @@ void TextEditor::SelectLine(int aLine)
 
 void TextEditor::SelectRegion(int aStartLine, int aStartChar, int aEndLine, int aEndChar)
 {
+	SyncWithDocument();
 	ClearSelections();
 	ClearExtraCursors();
 	SetSelection(aStartLine, aStartChar, aEndLine, aEndChar);
@@ -157,6 +954,7 @@ void TextEditor::SelectRegion(int aStartLine, int aStartChar, int aEndLine, int
 
 void TextEditor::SelectNextOccurrenceOf(const char* aText, int aTextSize, bool aCaseSensitive)
 {
+	SyncWithDocument();
 	ClearSelections();
 	ClearExtraCursors();
 	SelectNextOccurrenceOf(aText, aTextSize, -1, aCaseSensitive);
@@ -164,6 +962,7 @@ void TextEditor::SelectNextOccurrenceOf(const char* aText, int aTextSize, bool a
 
 void TextEditor::SelectAllOccurrencesOf(const char* aText, int aTextSize, bool aCaseSensitive)
 {
+	SyncWithDocument();
 	ClearSelections();
 	ClearExtraCursors();
 	SelectNextOccurrenceOf(aText, aTextSize, -1, aCaseSensitive);
@@ -251,11 +1050,13 @@ void TextEditor::MarkFindResultsDirty(bool deferRefresh)
 
 void TextEditor::ClearExtraCursors()
 {
+	SyncWithDocument();
 	mState.mCurrentCursor = 0;
 }
 
 void TextEditor::ClearSelections()
 {
+	SyncWithDocument();
 	for (int c = mState.mCurrentCursor; c > -1; c--)
 		mState.mCursors[c].mInteractiveEnd =
 		mState.mCursors[c].mInteractiveStart =
@@ -264,6 +1065,7 @@ void TextEditor::ClearSelections()
 
 void TextEditor::SetCursorPosition(int aLine, int aCharIndex)
 {
+	SyncWithDocument();
 	SetCursorPosition({ aLine, GetCharacterColumn(aLine, aCharIndex) }, -1, true);
 }
 
@@ -285,6 +1087,7 @@ void TextEditor::SetViewAtLine(int aLine, SetViewAtLineMode aMode)
 
 void TextEditor::Copy()
 {
+	SyncWithDocument();
 	if (AnyCursorHasSelection())
 	{
 		std::string clipboardText = GetClipboardText();
@@ -294,17 +1097,15 @@ void TextEditor::Copy()
 	{
 		if (!mLines.empty())
 		{
-			std::string str;
 			auto& line = mLines[GetSanitizedCursorCoordinates().mLine];
-			for (auto& g : line)
-				str.push_back(g.mChar);
-			ImGui::SetClipboardText(str.c_str());
+			ImGui::SetClipboardText(line.mText.c_str());
 		}
 	}
 }
 
 void TextEditor::Cut()
 {
+	SyncWithDocument();
 	if (mReadOnly)
 	{
 		Copy();
@@ -313,6 +1114,7 @@ void TextEditor::Cut()
 	{
 		if (AnyCursorHasSelection())
 		{
+			ScopedCount heldEvents(mEditEventsHeld);
 			UndoRecord u;
 			u.mBefore = mState;
 
@@ -323,7 +1125,7 @@ void TextEditor::Cut()
 				DeleteSelection(c);
 			}
 
-			u.mAfter = mState;
+			u.SetAfter(mState);
 			AddUndo(u);
 		}
 	}
@@ -331,6 +1133,7 @@ void TextEditor::Cut()
 
 void TextEditor::Paste()
 {
+	SyncWithDocument();
 	if (mReadOnly)
 		return;
 
@@ -358,6 +1161,7 @@ void TextEditor::Paste()
 
 	if (clipText.length() > 0)
 	{
+		ScopedCount heldEvents(mEditEventsHeld);
 		UndoRecord u;
 		u.mBefore = mState;
 
@@ -386,66 +1190,472 @@ void TextEditor::Paste()
 			}
 		}
 
-		u.mAfter = mState;
+		u.SetAfter(mState);
 		AddUndo(u);
 	}
 }
 
 void TextEditor::Undo(int aSteps)
 {
+	SyncWithDocument();
 	while (CanUndo() && aSteps-- > 0)
 		mUndoBuffer[--mUndoIndex].Undo(this);
 }
 
 void TextEditor::Redo(int aSteps)
 {
+	SyncWithDocument();
 	while (CanRedo() && aSteps-- > 0)
 		mUndoBuffer[mUndoIndex++].Redo(this);
 }
 
+void TextEditor::SetUndoMemoryBudget(size_t aBytes)
+{
+	mUndoMemoryBudget = aBytes;
+	TrimUndoBuffer();
+}
+
 void TextEditor::SetText(const std::string& aText)
 {
-	mLines.clear();
-	mLines.emplace_back(Line());
-	for (auto chr : aText)
+	LoadFromMemory(aText.data(), aText.size());
+}
+
+void TextEditor::LoadFromMemory(const char* aData, size_t aSize)
+{
+	// line breaks first, so every line is allocated once at its final size
+	std::vector<size_t> breaks;
+	unsigned int threadCount = aSize >= PARALLEL_LOAD_MIN_BYTES ? Min(8u, std::thread::hardware_concurrency()) : 1;
+	if (threadCount <= 1)
+		CollectLineBreaks(aData, 0, aSize, breaks);
+	else
 	{
-		if (chr == '\r')
-			continue;
+		std::vector<std::vector<size_t>> parts(threadCount);
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t < threadCount; t++)
+			threads.emplace_back([&, t]() { CollectLineBreaks(aData, aSize * t / threadCount, aSize * (t + 1) / threadCount, parts[t]); });
+		size_t total = 0;
+		for (unsigned int t = 0; t < threadCount; t++)
+		{
+			threads[t].join();
+			total += parts[t].size();
+		}
+		breaks.reserve(total);
+		for (const auto& part : parts)
+			breaks.insert(breaks.end(), part.begin(), part.end());
+	}
 
-		if (chr == '\n')
-			mLines.emplace_back(Line());
-		else
+	Coordinates oldEnd((int)mLines.size() - 1, GetLineMaxColumn((int)mLines.size() - 1));
+	mDocumentVersion++;
+	mLineLayoutVersion++;
+	mLines.clear();
+	mDocumentWords = DocumentWords(); // every line holding word ids is gone
+	mLines.resize(breaks.size() + 1);
+	size_t lineStart = 0;
+	size_t lineIndex = 0;
+	for (auto& line : mLines)
+	{
+		size_t lineEnd = lineIndex < breaks.size() ? breaks[lineIndex] : aSize;
+		const char* begin = aData + lineStart;
+		const char* end = aData + lineEnd;
+		line.mRevision = mDocumentVersion;
+		// '\r' is dropped
+		const char* cr = (const char*)std::memchr(begin, '\r', end - begin);
+		if (cr != nullptr)
+			line.Reserve(end - begin);
+		for (; cr != nullptr; cr = (const char*)std::memchr(begin, '\r', end - begin))
 		{
-			mLines.back().emplace_back(Glyph(chr, PaletteIndex::Default));
+			line.Append(begin, cr);
+			begin = cr + 1;
 		}
+		line.Append(begin, end);
+		lineStart = lineEnd + 1;
+		lineIndex++;
 	}
+	if (HasEditObservers())
+		EmitEditEvent(Coordinates(), oldEnd, std::string_view(aData, aSize));
 
 	mScrollToTop = true;
 
-	mUndoBuffer.clear();
-	mUndoIndex = 0;
+	ClearUndoBuffer();
 
 	Colorize();
 	MarkFindResultsDirty(false);
+	InvalidateFindIndexes();
 	mFindResultIndex = -1;
 	mFindHighlightsCache.clear();
 }
 
-std::string TextEditor::GetText() const
+bool TextEditor::LoadFromFile(const char* aPath)
 {
-	auto lastLine = (int)mLines.size() - 1;
-	auto lastLineLength = GetLineMaxColumn(lastLine);
-	Coordinates startCoords = Coordinates();
-	Coordinates endCoords = Coordinates(lastLine, lastLineLength);
-	return startCoords < endCoords ? GetText(startCoords, endCoords) : "";
+	return UseMappedFile(aPath, [this](const char* aData, size_t aSize) { LoadFromMemory(aData, aSize); return true; });
 }
 
-void TextEditor::SetTextLines(const std::vector<std::string>& aLines)
+bool TextEditor::SaveTo(TextWriter aWriter, void* aUserData) const
 {
-	mLines.clear();
-
-	if (aLines.empty())
-		mLines.emplace_back(Line());
+	BufferedWriter out(aWriter, aUserData);
+	bool first = true;
+	for (const auto& line : mLines)
+	{
+		if (!first && !out.Put("\n", 1))
+			return false;
+		first = false;
+		if (!out.Put(line.mText.data(), line.mText.size()))
+			return false;
+	}
+	return out.Flush();
+}
+
+bool TextEditor::SaveToFile(const char* aPath) const
+{
+	FILE* file = fopen(aPath, "wb");
+	if (file == nullptr)
+		return false;
+	bool written = SaveTo([](const char* aData, size_t aSize, void* aFile) { return fwrite(aData, 1, aSize, (FILE*)aFile) == aSize; }, file);
+	return fclose(file) == 0 && written;
+}
+
+bool TextEditor::SaveSnapshot(TextWriter aWriter, void* aUserData, bool aWithUndo) const
+{
+	SnapshotHeader header = {};
+	std::memcpy(header.mMagic, SNAPSHOT_MAGIC, sizeof(header.mMagic));
+	header.mFormatVersion = SNAPSHOT_FORMAT_VERSION;
+	header.mByteOrder = SNAPSHOT_BYTE_ORDER;
+	header.mLanguageFingerprint = LanguageFingerprint(mLanguageDefinition);
+	header.mLanguageId = (uint32_t)mLanguageDefinitionId;
+	header.mFirstVisibleLine = mFirstVisibleLine;
+	header.mLineCount = mLines.size();
+	for (const auto& line : mLines)
+		header.mTextSize += line.mText.size();
+	header.mCheckCommentsFromLine = mCheckComments ? mCheckCommentsFromLine : -1;
+	header.mCheckCommentsToLine = mCheckComments ? mCheckCommentsToLine : -1;
+	header.mUndoCount = aWithUndo ? mUndoBuffer.size() : 0;
+	header.mUndoIndex = aWithUndo ? mUndoIndex : 0;
+	header.mTabSize = mTabSize;
+
+	BufferedWriter out(aWriter, aUserData);
+	if (!out.Put(&header, sizeof(header)))
+		return false;
+	for (const auto& line : mLines)
+	{
+		uint32_t size = (uint32_t)line.mText.size();
+		if (!out.Put(&size, sizeof(size)))
+			return false;
+	}
+	for (const auto& line : mLines)
+		if (!out.Put(&line.mEntryState, 1))
+			return false;
+	for (const auto& line : mLines)
+	{
+		uint8_t colored = line.mColorizedRevision == line.mRevision;
+		if (!out.Put(&colored, 1))
+			return false;
+	}
+	for (const auto& line : mLines)
+		if (!out.Put(line.mText.data(), line.mText.size()))
+			return false;
+	for (const auto& line : mLines)
+		if (!out.Put(line.mGlyphs.data(), line.mGlyphs.size() * sizeof(Glyph)))
+			return false;
+
+	if (!PutEditorState(out, mState))
+		return false;
+	for (uint64_t r = 0; r < header.mUndoCount; r++)
+	{
+		const UndoRecord& record = mUndoBuffer[r];
+		EditorState after = record.mBefore;
+		record.mAfter.ApplyTo(after);
+		uint8_t mergeable = record.mMergeable;
+		uint32_t operationCount = (uint32_t)record.mOperations.size();
+		if (!out.Put(&mergeable, 1) || !PutEditorState(out, record.mBefore) || !PutEditorState(out, after) ||
+			!out.Put(&operationCount, sizeof(operationCount)))
+			return false;
+		for (const UndoOperation& operation : record.mOperations)
+		{
+			uint8_t type = (uint8_t)operation.mType;
+			int32_t coordinates[4] = { operation.mStart.mLine, operation.mStart.mColumn, operation.mEnd.mLine, operation.mEnd.mColumn };
+			uint32_t size = (uint32_t)operation.mText.size();
+			if (!out.Put(&type, 1) || !out.Put(coordinates, sizeof(coordinates)) || !out.Put(&size, sizeof(size)) ||
+				!out.Put(operation.mText.data(), size))
+				return false;
+		}
+	}
+	return out.Flush();
+}
+
+bool TextEditor::SaveSnapshotToFile(const char* aPath, bool aWithUndo) const
+{
+	FILE* file = fopen(aPath, "wb");
+	if (file == nullptr)
+		return false;
+	bool written = SaveSnapshot([](const char* aData, size_t aSize, void* aFile) { return fwrite(aData, 1, aSize, (FILE*)aFile) == aSize; }, file, aWithUndo);
+	return fclose(file) == 0 && written;
+}
+
+bool TextEditor::LoadSnapshot(const char* aData, size_t aSize)
+{
+	// everything is read and checked before the editor is touched
+	SnapshotReader in(aData, aSize);
+	SnapshotHeader header;
+	if (!in.Read(header) || std::memcmp(header.mMagic, SNAPSHOT_MAGIC, sizeof(header.mMagic)) != 0 ||
+		header.mFormatVersion != SNAPSHOT_FORMAT_VERSION || header.mByteOrder != SNAPSHOT_BYTE_ORDER ||
+		header.mLineCount == 0 || header.mLineCount > (uint64_t)INT_MAX || header.mUndoIndex < 0 || (uint64_t)header.mUndoIndex > header.mUndoCount)
+		return false;
+	size_t lineCount = (size_t)header.mLineCount;
+	const char* sizes = in.Take(header.mLineCount * sizeof(uint32_t));
+	const char* entryStates = in.Take(header.mLineCount);
+	const char* colored = in.Take(header.mLineCount);
+	const char* text = in.Take(header.mTextSize);
+	const char* glyphs = in.Take(header.mTextSize * sizeof(Glyph));
+	if (sizes == nullptr || entryStates == nullptr || colored == nullptr || text == nullptr || glyphs == nullptr)
+		return false;
+	uint64_t textSize = 0;
+	for (size_t i = 0; i < lineCount; i++)
+	{
+		uint32_t size;
+		std::memcpy(&size, sizes + i * sizeof(size), sizeof(size));
+		textSize += size;
+	}
+	if (textSize != header.mTextSize)
+		return false;
+
+	EditorState state;
+	if (!ReadEditorState(in, state))
+		return false;
+	std::vector<UndoRecord> records;
+	std::vector<EditorState> afterStates; // resolved into the records once they are checked
+	for (uint64_t r = 0; r < header.mUndoCount; r++)
+	{
+		UndoRecord record;
+		EditorState after;
+		uint8_t mergeable;
+		uint32_t operationCount;
+		if (!in.Read(mergeable) || !ReadEditorState(in, record.mBefore) || !ReadEditorState(in, after) ||
+			!in.Read(operationCount) || operationCount > in.Remaining())
+			return false;
+		record.mOperations.resize(operationCount);
+		for (UndoOperation& operation : record.mOperations)
+		{
+			uint8_t type;
+			int32_t coordinates[4];
+			uint32_t size;
+			const char* operationText;
+			if (!in.Read(type) || type > (uint8_t)UndoOperationType::Delete || !in.Read(coordinates) || !in.Read(size) ||
+				(operationText = in.Take(size)) == nullptr ||
+				coordinates[0] < 0 || coordinates[1] < 0 || coordinates[2] < 0 || coordinates[3] < 0)
+				return false;
+			operation.mType = (UndoOperationType)type;
+			operation.mStart = Coordinates(coordinates[0], coordinates[1]);
+			operation.mEnd = Coordinates(coordinates[2], coordinates[3]);
+			operation.mText.assign(operationText, size);
+		}
+		record.mMergeable = mergeable != 0;
+		records.push_back(std::move(record));
+		afterStates.push_back(std::move(after));
+	}
+	if (in.Remaining() != 0)
+		return false;
+
+	// Sound sizes are not enough: attributes must be ones the editor writes and every undo step must
+	// apply to the text it is undone or redone on. Cursors are clamped to the text like the editor's
+	// own, which may be left past the end of the text by an edit.
+	if (header.mTabSize < 1 || header.mTabSize > 8 || header.mCheckCommentsFromLine < -1 ||
+		header.mCheckCommentsToLine < header.mCheckCommentsFromLine)
+		return false;
+	for (uint64_t i = 0; i < header.mTextSize; i++)
+		if (((const Glyph*)glyphs)[i].mColorIndex >= (uint8_t)PaletteIndex::Background)
+			return false;
+	for (size_t i = 0; i < lineCount; i++)
+		if ((uint8_t)entryStates[i] >= COMMENT_STATE_FIRST_CHAR << 1)
+			return false;
+	if (!records.empty())
+	{
+		if (!FitsHistory(records, afterStates, header.mUndoIndex, (int)lineCount))
+			return false;
+		for (size_t r = 0; r < records.size(); r++)
+			records[r].SetAfter(afterStates[r]);
+	}
+
+	// colors are only as good as the definition that produced them
+	bool keepColors = header.mLanguageId == (uint32_t)mLanguageDefinitionId &&
+		header.mLanguageFingerprint == LanguageFingerprint(mLanguageDefinition);
+
+	Coordinates oldEnd((int)mLines.size() - 1, GetLineMaxColumn((int)mLines.size() - 1));
+	mDocumentVersion++;
+	mLineLayoutVersion++;
+	mLines.clear();
+	mDocumentWords = DocumentWords(); // every line holding word ids is gone
+	mLines.resize(lineCount);
+	const char* lineText = text;
+	const Glyph* lineGlyphs = (const Glyph*)glyphs;
+	int firstUncolored = INT_MAX;
+	int lastUncolored = -1;
+	for (size_t i = 0; i < lineCount; i++)
+	{
+		Line& line = mLines[i];
+		uint32_t size;
+		std::memcpy(&size, sizes + i * sizeof(size), sizeof(size));
+		line.Append(lineText, lineText + size);
+		line.mRevision = mDocumentVersion;
+		if (keepColors)
+		{
+			if (size > 0)
+				std::memcpy(line.mGlyphs.data(), lineGlyphs, size * sizeof(Glyph));
+			line.mEntryState = (uint8_t)entryStates[i];
+			if (colored[i] != 0)
+				line.mColorizedRevision = line.mRevision;
+			else
+			{
+				firstUncolored = std::min(firstUncolored, (int)i);
+				lastUncolored = (int)i;
+			}
+		}
+		lineText += size;
+		lineGlyphs += size;
+	}
+
+	if (keepColors)
+	{
+		mColorRangeMin = INT_MAX;
+		mColorRangeMax = 0;
+		mCheckComments = false;
+		if (lastUncolored >= 0)
+			Colorize(firstUncolored, lastUncolored - firstUncolored + 1);
+		if (header.mCheckCommentsFromLine >= 0)
+			InvalidateCommentState(std::min(header.mCheckCommentsFromLine, (int)lineCount - 1),
+				std::min(header.mCheckCommentsToLine, (int)lineCount - 1));
+	}
+	else
+		Colorize();
+	if (HasEditObservers())
+		EmitEditEvent(Coordinates(), oldEnd, GetText());
+
+	ClearUndoBuffer();
+	for (UndoRecord& record : records)
+	{
+		mUndoBuffer.push_back(std::move(record));
+		UndoRecord& added = mUndoBuffer.back();
+		added.mMemorySize = added.GetMemorySize();
+		mUndoMemoryUsage += added.mMemorySize;
+	}
+	mUndoIndex = header.mUndoIndex;
+	TrimUndoBuffer();
+
+	mTabSize = header.mTabSize;
+	mState = state;
+	for (int c = 0; c <= mState.mCurrentCursor; c++)
+	{
+		Cursor& cursor = mState.mCursors[c];
+		cursor.mInteractiveStart = SanitizeCoordinates(cursor.mInteractiveStart);
+		cursor.mInteractiveEnd = SanitizeCoordinates(cursor.mInteractiveEnd);
+	}
+	mCursorPositionChanged = true;
+
+	mScrollToTop = true;
+	if (header.mFirstVisibleLine > 0)
+		SetViewAtLine(std::min(header.mFirstVisibleLine, (int)lineCount - 1), SetViewAtLineMode::FirstVisibleLine);
+
+	MarkFindResultsDirty(false);
+	InvalidateFindIndexes();
+	mFindResultIndex = -1;
+	mFindHighlightsCache.clear();
+	if (mDocumentWordCompletion)
+		for (auto& line : mLines)
+			if (line.mColorizedRevision == line.mRevision)
+				HarvestLineWords(line);
+	return true;
+}
+
+bool TextEditor::FitsHistory(std::vector<UndoRecord>& aRecords, std::vector<EditorState>& aAfterStates, int aUndoIndex, int aLineCount)
+{
+	// Back to the oldest step, forward to the newest and back to aUndoIndex, following the line count
+	// alone, so no copy of the text is needed. Undo and redo clamp columns past the end of a line, as
+	// the editor records some, but lines must exist; an operation's text must hold the line breaks its
+	// range spans, or undoing it would leave another line count than redoing it took.
+	int lineCount = aLineCount;
+	auto clampCursors = [&lineCount](EditorState& aState)
+	{
+		for (int c = 0; c <= aState.mCurrentCursor; c++)
+		{
+			auto& cursor = aState.mCursors[c];
+			cursor.mInteractiveStart.mLine = std::min(cursor.mInteractiveStart.mLine, lineCount - 1);
+			cursor.mInteractiveEnd.mLine = std::min(cursor.mInteractiveEnd.mLine, lineCount - 1);
+		}
+	};
+	auto apply = [&lineCount](const UndoOperation& aOperation, bool aInsert)
+	{
+		if (aOperation.mText.empty())
+			return true;
+		int spannedLines = aOperation.mEnd.mLine - aOperation.mStart.mLine;
+		if (!(aOperation.mStart <= aOperation.mEnd) || spannedLines != (int)std::count(aOperation.mText.begin(), aOperation.mText.end(), '\n'))
+			return false;
+		if (aInsert)
+		{
+			if (aOperation.mStart.mLine >= lineCount)
+				return false;
+			lineCount += spannedLines;
+		}
+		else
+		{
+			if (aOperation.mEnd.mLine >= lineCount)
+				return false;
+			lineCount -= spannedLines;
+		}
+		return true;
+	};
+	auto undo = [&](int aRecord)
+	{
+		UndoRecord& record = aRecords[aRecord];
+		for (int i = (int)record.mOperations.size() - 1; i > -1; i--)
+			if (!apply(record.mOperations[i], record.mOperations[i].mType == UndoOperationType::Delete))
+				return false;
+		clampCursors(record.mBefore);
+		return true;
+	};
+	auto redo = [&](int aRecord)
+	{
+		for (const UndoOperation& operation : aRecords[aRecord].mOperations)
+			if (!apply(operation, operation.mType == UndoOperationType::Add))
+				return false;
+		clampCursors(aAfterStates[aRecord]);
+		return true;
+	};
+
+	for (int r = aUndoIndex - 1; r >= 0; r--)
+		if (!undo(r))
+			return false;
+	for (int r = 0; r < (int)aRecords.size(); r++)
+		if (!redo(r))
+			return false;
+	for (int r = (int)aRecords.size() - 1; r >= aUndoIndex; r--)
+		if (!undo(r))
+			return false;
+	return lineCount == aLineCount;
+}
+
+bool TextEditor::LoadSnapshotFromFile(const char* aPath)
+{
+	return UseMappedFile(aPath, [this](const char* aData, size_t aSize) { return LoadSnapshot(aData, aSize); });
+}
+
+std::string TextEditor::GetText() const
+{
+	auto lastLine = (int)mLines.size() - 1;
+	auto lastLineLength = GetLineMaxColumn(lastLine);
+	Coordinates startCoords = Coordinates();
+	Coordinates endCoords = Coordinates(lastLine, lastLineLength);
+	return startCoords < endCoords ? GetText(startCoords, endCoords) : "";
+}
+
+void TextEditor::SetTextLines(const std::vector<std::string>& aLines)
+{
+	Coordinates oldEnd((int)mLines.size() - 1, GetLineMaxColumn((int)mLines.size() - 1));
+	mDocumentVersion++;
+	mLineLayoutVersion++;
+	mLines.clear();
+	mDocumentWords = DocumentWords(); // every line holding word ids is gone
+
+	if (aLines.empty())
+		mLines.emplace_back(Line()).mRevision = mDocumentVersion;
 	else
 	{
 		mLines.resize(aLines.size());
@@ -453,20 +1663,20 @@ void TextEditor::SetTextLines(const std::vector<std::string>& aLines)
 		for (size_t i = 0; i < aLines.size(); ++i)
 		{
 			const std::string& aLine = aLines[i];
-
-			mLines[i].reserve(aLine.size());
-			for (size_t j = 0; j < aLine.size(); ++j)
-				mLines[i].emplace_back(Glyph(aLine[j], PaletteIndex::Default));
+			mLines[i].Append(aLine.data(), aLine.data() + aLine.size());
+			mLines[i].mRevision = mDocumentVersion;
 		}
 	}
+	if (HasEditObservers())
+		EmitEditEvent(Coordinates(), oldEnd, GetText());
 
 	mScrollToTop = true;
 
-	mUndoBuffer.clear();
-	mUndoIndex = 0;
+	ClearUndoBuffer();
 
 	Colorize();
 	MarkFindResultsDirty(false);
+	InvalidateFindIndexes();
 	mFindResultIndex = -1;
 	mFindHighlightsCache.clear();
 }
@@ -478,22 +1688,14 @@ std::vector<std::string> TextEditor::GetTextLines() const
 	result.reserve(mLines.size());
 
 	for (auto& line : mLines)
-	{
-		std::string text;
-
-		text.resize(line.size());
-
-		for (size_t i = 0; i < line.size(); ++i)
-			text[i] = line[i].mChar;
-
-		result.emplace_back(std::move(text));
-	}
+		result.emplace_back(line.mText);
 
 	return result;
 }
 
 bool TextEditor::Render(const char* aTitle, bool aParentIsFocused, const ImVec2& aSize, bool aBorder)
 {
+	SyncWithDocument();
 	if (mCursorPositionChanged)
 		OnCursorPositionChanged();
 	mCursorPositionChanged = false;
@@ -504,10 +1706,24 @@ bool TextEditor::Render(const char* aTitle, bool aParentIsFocused, const ImVec2&
 	ImGui::BeginChild(aTitle, aSize, aBorder, ImGuiWindowFlags_HorizontalScrollbar | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoNavInputs);
 
 	bool isFocused = ImGui::IsWindowFocused();
-	HandleKeyboardInputs(aParentIsFocused);
-	HandleMouseInputs();
-	ColorizeInternal();
-	Render(aParentIsFocused);
+	{
+		ScopedTimer timer(mFrameStats.mInputMs);
+		HandleKeyboardInputs(aParentIsFocused);
+		HandleMouseInputs();
+	}
+	{
+		ScopedTimer timer(mFrameStats.mColorizeMs);
+		ColorizeInternal();
+	}
+	{
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		int commands = drawList->CmdBuffer.Size;
+		int vertices = drawList->VtxBuffer.Size;
+		ScopedTimer timer(mFrameStats.mRenderMs);
+		Render(aParentIsFocused);
+		mFrameStats.mDrawCommands += drawList->CmdBuffer.Size - commands;
+		mFrameStats.mVertices += drawList->VtxBuffer.Size - vertices;
+	}
 
 	ImGui::EndChild();
 
@@ -522,9 +1738,65 @@ bool TextEditor::Render(const char* aTitle, bool aParentIsFocused, const ImVec2&
 	ImGui::PopStyleVar();
 	ImGui::PopStyleColor();
 
+	mViewDocumentVersion = mDocumentVersion; // this frame's own edits are accounted for
+	mFrameStats.mColorizeBacklog = std::max(0, mColorRangeMax - mColorRangeMin);
+	mStats = mFrameStats;
+	mFrameStats = PerformanceStats();
+	if (mStatsHistory.size() < PERFORMANCE_HISTORY_FRAMES)
+		mStatsHistory.push_back(mStats);
+	else
+		mStatsHistory[mStatsHistoryNext] = mStats;
+	mStatsHistoryNext = (mStatsHistoryNext + 1) % PERFORMANCE_HISTORY_FRAMES;
+
 	return isFocused;
 }
 
+void TextEditor::SyncWithDocument()
+{
+	// Another view edited the document. Cursors followed its edit events already (FollowEdit) and are
+	// clamped to what their lines hold now; what else refers to lines is dropped, and find results are
+	// searched again as the version changed. Alone on the document, edits were this editor's own.
+	if (mViewDocumentVersion == mDocumentVersion)
+		return;
+	mViewDocumentVersion = mDocumentVersion;
+	if (mDocument.use_count() == 1)
+		return;
+
+	for (int c = 0; c <= mState.mCurrentCursor; c++)
+	{
+		auto& cursor = mState.mCursors[c];
+		cursor.mInteractiveStart = SanitizeCoordinates(cursor.mInteractiveStart);
+		cursor.mInteractiveEnd = SanitizeCoordinates(cursor.mInteractiveEnd);
+	}
+	mCursorPositionChanged = true;
+	mFindSelectionRangeStart = SanitizeCoordinates(mFindSelectionRangeStart);
+	mFindSelectionRangeEnd = SanitizeCoordinates(mFindSelectionRangeEnd);
+	mFindResults.clear();
+	mFindHighlightsCache.clear();
+	mFindResultIndex = -1;
+	mFindResultsDirty = true;
+	mFindResultsBasis.mValid = false;
+	mLineDrawCache.clear();
+	mShowAutoComplete = false;
+}
+
+TextEditor::MemoryStats TextEditor::EstimateMemoryUsage() const
+{
+	// capacities rather than sizes, and the allocator's own overhead is left out
+	MemoryStats stats;
+	for (const auto& line : mLines)
+	{
+		stats.mLines += sizeof(Line) + line.mText.capacity() + line.mGlyphs.capacity() * sizeof(Glyph) +
+			line.mFindOccurrences.capacity() * sizeof(FindOccurrence) + line.mWordIds.capacity() * sizeof(uint32_t) +
+			line.mColumnBreaks.capacity() * sizeof(Line::ColumnBreak);
+	}
+	stats.mUndo = mUndoMemoryUsage;
+	stats.mFindHighlights = mFindResults.capacity() * sizeof(mFindResults[0]);
+	for (const auto& entry : mFindHighlightsCache)
+		stats.mFindHighlights += sizeof(entry) + entry.second.capacity() * sizeof(LineHighlight);
+	return stats;
+}
+
 // ------------------------------------ //
 // ---------- Generic utils ----------- //
 
@@ -532,6 +1804,8 @@ bool TextEditor::Render(const char* aTitle, bool aParentIsFocused, const ImVec2&
 // We assume that the char is a standalone character (<128) or a leading byte of an UTF-8 code sequence (non-10xxxxxx code)
 static int UTF8CharLength(char c)
 {
+	if ((c & 0x80) == 0)
+		return 1;
 	if ((c & 0xFE) == 0xFC)
 		return 6;
 	if ((c & 0xFC) == 0xF8)
@@ -625,6 +1899,58 @@ void TextEditor::EditorState::SortCursorsFromTopToBottom()
 			mLastAddedCursor = c;
 }
 
+void TextEditor::EditorStateDelta::Build(const EditorState& aFrom, const EditorState& aTo)
+{
+	mCurrentCursor = aTo.mCurrentCursor;
+	mLastAddedCursor = aTo.mLastAddedCursor;
+	mRuns.clear();
+	mCursors.clear();
+
+	// slots past mCurrentCursor are unused and not kept
+	int common = std::min(aFrom.mCurrentCursor, aTo.mCurrentCursor) + 1;
+	for (int c = 0; c < common; c++)
+	{
+		const Cursor& from = aFrom.mCursors[c];
+		const Cursor& to = aTo.mCursors[c];
+		int lineShift = to.mInteractiveStart.mLine - from.mInteractiveStart.mLine;
+		int columnShift = to.mInteractiveStart.mColumn - from.mInteractiveStart.mColumn;
+		if (to.mInteractiveEnd.mLine - from.mInteractiveEnd.mLine != lineShift ||
+			to.mInteractiveEnd.mColumn - from.mInteractiveEnd.mColumn != columnShift)
+			mCursors.push_back({ c, to });
+		else if (lineShift != 0 || columnShift != 0)
+		{
+			if (!mRuns.empty() && mRuns.back().mFirst + mRuns.back().mCount == c &&
+				mRuns.back().mLineShift == lineShift && mRuns.back().mColumnShift == columnShift)
+				mRuns.back().mCount++;
+			else
+				mRuns.push_back({ c, 1, lineShift, columnShift });
+		}
+	}
+	for (int c = common; c <= aTo.mCurrentCursor; c++)
+		mCursors.push_back({ c, aTo.mCursors[c] });
+	mRuns.shrink_to_fit();
+	mCursors.shrink_to_fit();
+}
+
+void TextEditor::EditorStateDelta::ApplyTo(EditorState& aState) const
+{
+	aState.mCurrentCursor = mCurrentCursor;
+	aState.mLastAddedCursor = mLastAddedCursor;
+	if ((int)aState.mCursors.size() < mCurrentCursor + 1)
+		aState.mCursors.resize(mCurrentCursor + 1);
+	for (const Run& run : mRuns)
+		for (int c = run.mFirst; c < run.mFirst + run.mCount; c++)
+		{
+			Cursor& cursor = aState.mCursors[c];
+			cursor.mInteractiveStart.mLine += run.mLineShift;
+			cursor.mInteractiveStart.mColumn += run.mColumnShift;
+			cursor.mInteractiveEnd.mLine += run.mLineShift;
+			cursor.mInteractiveEnd.mColumn += run.mColumnShift;
+		}
+	for (const auto& changed : mCursors)
+		aState.mCursors[changed.first] = changed.second;
+}
+
 // ---------- Undo record functions --------- //
 
 TextEditor::UndoRecord::UndoRecord(const std::vector<UndoOperation>& aOperations,
@@ -632,7 +1958,7 @@ TextEditor::UndoRecord::UndoRecord(const std::vector<UndoOperation>& aOperations
 {
 	mOperations = aOperations;
 	mBefore = aBefore;
-	mAfter = aAfter;
+	SetAfter(aAfter);
 	for (const UndoOperation& o : mOperations)
 		assert(o.mStart <= o.mEnd);
 }
@@ -679,24 +2005,92 @@ void TextEditor::UndoRecord::Redo(TextEditor* aEditor)
 			case UndoOperationType::Delete:
 			{
 				aEditor->DeleteRange(operation.mStart, operation.mEnd);
-				aEditor->Colorize(operation.mStart.mLine - 1, operation.mEnd.mLine - operation.mStart.mLine + 1);
+				aEditor->Colorize(operation.mStart.mLine - 1, operation.mEnd.mLine - operation.mStart.mLine + 2);
 				break;
 			}
 			case UndoOperationType::Add:
 			{
 				auto start = operation.mStart;
 				aEditor->InsertTextAt(start, operation.mText.c_str());
-				aEditor->Colorize(operation.mStart.mLine - 1, operation.mEnd.mLine - operation.mStart.mLine + 1);
+				aEditor->Colorize(operation.mStart.mLine - 1, operation.mEnd.mLine - operation.mStart.mLine + 2);
 				break;
 			}
 			}
 		}
 	}
 
-	aEditor->mState = mAfter;
+	aEditor->mState = mBefore;
+	mAfter.ApplyTo(aEditor->mState);
 	aEditor->EnsureCursorVisible();
 }
 
+// One character typed or backspaced by every cursor, each cursor on a line of its own. Operations on
+// separate lines do not move each other's coordinates, so runs of these can be merged cursor by cursor.
+bool TextEditor::UndoRecord::IsSingleCharacterEdit() const
+{
+	if (mOperations.empty())
+		return false;
+	for (int i = 0; i < (int)mOperations.size(); i++)
+	{
+		const UndoOperation& operation = mOperations[i];
+		if (operation.mType != mOperations[0].mType || operation.mStart.mLine != operation.mEnd.mLine ||
+			operation.mText.empty() || operation.mText[0] == '\n' || (int)operation.mText.size() != UTF8CharLength(operation.mText[0]))
+			return false;
+		if (i > 0 && operation.mStart.mLine >= mOperations[i - 1].mStart.mLine)
+			return false;
+	}
+	return true;
+}
+
+bool TextEditor::UndoRecord::TryMerge(const UndoRecord& aNext)
+{
+	if (!mMergeable || !aNext.IsSingleCharacterEdit() || aNext.mOperations.size() != mOperations.size() ||
+		aNext.mOperations[0].mType != mOperations[0].mType)
+		return false;
+
+	// typing continues where the last character went in, backspacing right before the last deleted one
+	bool adding = mOperations[0].mType == UndoOperationType::Add;
+	for (int i = 0; i < (int)mOperations.size(); i++)
+	{
+		const UndoOperation& next = aNext.mOperations[i];
+		if (adding ? next.mStart != mOperations[i].mEnd : next.mEnd != mOperations[i].mStart)
+			return false;
+	}
+
+	for (int i = 0; i < (int)mOperations.size(); i++)
+	{
+		UndoOperation& operation = mOperations[i];
+		const UndoOperation& next = aNext.mOperations[i];
+		if (adding)
+		{
+			operation.mText += next.mText;
+			operation.mEnd = next.mEnd;
+		}
+		else
+		{
+			operation.mText.insert(0, next.mText);
+			operation.mStart = next.mStart;
+		}
+	}
+
+	EditorState after = aNext.mBefore;
+	aNext.mAfter.ApplyTo(after);
+	SetAfter(after);
+	return true;
+}
+
+size_t TextEditor::UndoRecord::GetMemorySize() const
+{
+	size_t size = sizeof(UndoRecord) +
+		mOperations.capacity() * sizeof(UndoOperation) +
+		mBefore.mCursors.capacity() * sizeof(Cursor) +
+		mAfter.mRuns.capacity() * sizeof(EditorStateDelta::Run) +
+		mAfter.mCursors.capacity() * sizeof(std::pair<int, Cursor>);
+	for (const UndoOperation& operation : mOperations)
+		size += operation.mText.capacity();
+	return size;
+}
+
 // ---------- Text editor internal functions --------- //
 
 std::string TextEditor::GetText(const Coordinates& aStart, const Coordinates& aEnd) const
@@ -704,37 +2098,42 @@ std::string TextEditor::GetText(const Coordinates& aStart, const Coordinates& aE
 	assert(aStart < aEnd);
 
 	std::string result;
-	auto lstart = aStart.mLine;
-	auto lend = aEnd.mLine;
-	auto istart = GetCharacterIndexR(aStart);
-	auto iend = GetCharacterIndexR(aEnd);
 	size_t s = 0;
-
-	for (size_t i = lstart; i < lend; i++)
+	for (int i = aStart.mLine; i < aEnd.mLine; i++)
 		s += mLines[i].size();
-
 	result.reserve(s + s / 8);
 
-	while (istart < iend || lstart < lend)
-	{
-		if (lstart >= (int)mLines.size())
-			break;
+	ReadText(aStart.mLine, GetCharacterIndexR(aStart), aEnd.mLine, GetCharacterIndexR(aEnd),
+		[](const char* aData, size_t aSize, void* aResult) { ((std::string*)aResult)->append(aData, aSize); return true; }, &result);
+	return result;
+}
 
-		auto& line = mLines[lstart];
-		if (istart < (int)line.size())
-		{
-			result += line[istart].mChar;
-			istart++;
-		}
-		else
-		{
-			istart = 0;
-			++lstart;
-			result += '\n';
-		}
+bool TextEditor::ReadText(int aStartLine, int aStartChar, int aEndLine, int aEndChar, TextWriter aWriter, void* aUserData) const
+{
+	// a region past the end stops at the end of the text
+	int lineCount = (int)mLines.size();
+	for (int lineIndex = Max(aStartLine, 0); lineIndex <= aEndLine && lineIndex < lineCount; lineIndex++)
+	{
+		const auto& line = mLines[lineIndex];
+		int from = lineIndex == aStartLine ? Max(0, Min(aStartChar, (int)line.size())) : 0;
+		int to = lineIndex == aEndLine ? Min(aEndChar, (int)line.size()) : (int)line.size();
+		if (from < to && !aWriter(line.mText.data() + from, to - from, aUserData))
+			return false;
+		if (lineIndex < aEndLine && lineIndex + 1 < lineCount && !aWriter("\n", 1, aUserData))
+			return false;
 	}
+	return true;
+}
 
-	return result;
+bool TextEditor::ForEachLine(LineReader aReader, void* aUserData, int aFromLine, int aToLine) const
+{
+	int lineCount = (int)mLines.size();
+	if (aToLine < 0 || aToLine > lineCount)
+		aToLine = lineCount;
+	for (int lineIndex = Max(aFromLine, 0); lineIndex < aToLine; lineIndex++)
+		if (!aReader(lineIndex, mLines[lineIndex].mText, aUserData))
+			return false;
+	return true;
 }
 
 std::string TextEditor::GetClipboardText() const
@@ -780,51 +2179,97 @@ void TextEditor::SetCursorPosition(const Coordinates& aPosition, int aCursor, bo
 
 int TextEditor::InsertTextAt(Coordinates& /* inout */ aWhere, const char* aValue)
 {
+	// The text is split on line breaks once and each piece goes into its line with a single insert,
+	// '\r' is dropped. Cursors are moved once for the whole text instead of once per character.
 	assert(!mReadOnly);
+	assert(!mLines.empty());
 	MarkFindResultsDirty(true);
 	mFindHighlightsCache.clear();
 
+	const char* end = aValue + std::strlen(aValue);
+	std::string stripped;
+	if (std::memchr(aValue, '\r', end - aValue) != nullptr)
+	{
+		stripped.reserve(end - aValue);
+		std::remove_copy(aValue, end, std::back_inserter(stripped), '\r');
+		aValue = stripped.c_str();
+		end = aValue + stripped.size();
+	}
+	if (aValue == end)
+		return 0;
+
+	int lineIndex = aWhere.mLine;
 	int cindex = GetCharacterIndexR(aWhere);
-	int totalLines = 0;
-	while (*aValue != '\0')
+	const char* firstBreak = (const char*)std::memchr(aValue, '\n', end - aValue);
+	bool emit = mEditEventsHeld == 0 && HasEditObservers();
+	Coordinates eventStart = emit ? Coordinates(lineIndex, GetCharacterColumn(lineIndex, cindex)) : Coordinates();
+	const char* firstEnd = firstBreak != nullptr ? firstBreak : end;
+
+	// cursors to the right of the insertion point without a selection move with the text after it
+	mLineChangedCursors.clear();
+	for (int c = 0; c <= mState.mCurrentCursor; c++)
 	{
-		assert(!mLines.empty());
+		const auto& cursor = mState.mCursors[c];
+		if (cursor.mInteractiveEnd.mLine == lineIndex && cursor.mInteractiveEnd.mColumn > aWhere.mColumn && !cursor.HasSelection())
+			mLineChangedCursors.push_back({ c, GetCharacterIndexR(cursor.mInteractiveEnd) - cindex });
+	}
 
-		if (*aValue == '\r')
-		{
-			// skip
-			++aValue;
-		}
-		else if (*aValue == '\n')
-		{
-			if (cindex < (int)mLines[aWhere.mLine].size())
-			{
-				auto& newLine = InsertLine(aWhere.mLine + 1);
-				auto& line = mLines[aWhere.mLine];
-				AddGlyphsToLine(aWhere.mLine + 1, 0, line.begin() + cindex, line.end());
-				RemoveGlyphsFromLine(aWhere.mLine, cindex);
-			}
-			else
-			{
-				InsertLine(aWhere.mLine + 1);
-			}
-			++aWhere.mLine;
-			aWhere.mColumn = 0;
-			cindex = 0;
-			++totalLines;
-			++aValue;
-		}
-		else
-		{
-			auto& line = mLines[aWhere.mLine];
-			auto d = UTF8CharLength(*aValue);
-			while (d-- > 0 && *aValue != '\0')
-				AddGlyphToLine(aWhere.mLine, cindex++, Glyph(*aValue++, PaletteIndex::Default));
-			aWhere.mColumn = GetCharacterColumn(aWhere.mLine, cindex);
-		}
+	if (firstBreak == nullptr)
+	{
+		auto& line = mLines[lineIndex];
+		line.Insert(cindex, aValue, end);
+		line.mRevision = ++mDocumentVersion;
+		InvalidateCommentState(lineIndex, lineIndex);
+		InvalidateFindLines(lineIndex, lineIndex);
+		int insertedEnd = cindex + (int)(end - aValue);
+		for (auto& item : mLineChangedCursors)
+			SetCursorPosition({ lineIndex, GetCharacterColumn(lineIndex, insertedEnd + item.second) }, item.first);
+		aWhere.mColumn = GetCharacterColumn(lineIndex, insertedEnd);
+		if (emit)
+			EmitEditEvent(eventStart, eventStart, std::string_view(aValue, end - aValue));
+		return 0;
 	}
 
-	return totalLines;
+	// every line after the first piece is new, the last one also gets the rest of the line
+	int totalLines = 0;
+	for (const char* p = firstBreak; p != end;)
+	{
+		const char* pieceBegin = p + 1;
+		const char* pieceEnd = (const char*)std::memchr(pieceBegin, '\n', end - pieceBegin);
+		if (pieceEnd == nullptr)
+			pieceEnd = end;
+		auto& newLine = InsertLine(lineIndex + ++totalLines, false);
+		newLine.Append(pieceBegin, pieceEnd);
+		p = pieceEnd;
+	}
+	int lastLineIndex = lineIndex + totalLines;
+	auto& lastLine = mLines[lastLineIndex];
+	int insertedEnd = (int)lastLine.size();
+	auto& line = mLines[lineIndex];
+	lastLine.Insert(lastLine.size(), line, cindex, line.size());
+	line.Erase(cindex, line.size());
+	line.Insert(cindex, aValue, firstEnd);
+	line.mRevision = ++mDocumentVersion;
+	InvalidateCommentState(lineIndex, lineIndex);
+	InvalidateFindLines(lineIndex, lineIndex);
+
+	for (int c = 0; c <= mState.mCurrentCursor; c++)
+	{
+		auto& cursor = mState.mCursors[c];
+		if (cursor.mInteractiveStart.mLine > lineIndex)
+			cursor.mInteractiveStart.mLine += totalLines;
+		if (cursor.mInteractiveEnd.mLine > lineIndex)
+			cursor.mInteractiveEnd.mLine += totalLines;
+	}
+	for (auto& item : mLineChangedCursors)
+		SetCursorPosition({ lastLineIndex, GetCharacterColumn(lastLineIndex, insertedEnd + item.second) }, item.first);
+	mCursorPositionChanged = true;
+
+	aWhere.mLine = lastLineIndex;
+	aWhere.mColumn = GetCharacterColumn(lastLineIndex, insertedEnd);
+	if (emit)
+		EmitEditEvent(eventStart, eventStart, std::string_view(aValue, end - aValue));
+	return totalLines;
 }
 
 void TextEditor::InsertTextAtCursor(const char* aValue, int aCursor)
@@ -865,7 +2310,7 @@ bool TextEditor::Move(int& aLine, int& aCharIndex, bool aLeft, bool aLockLine) c
 		else
 		{
 			aCharIndex--;
-			while (aCharIndex > 0 && IsUTFSequence(mLines[aLine][aCharIndex].mChar))
+			while (aCharIndex > 0 && IsUTFSequence(mLines[aLine][aCharIndex]))
 				aCharIndex--;
 		}
 	}
@@ -880,7 +2325,7 @@ bool TextEditor::Move(int& aLine, int& aCharIndex, bool aLeft, bool aLockLine) c
 		}
 		else
 		{
-			int seqLength = UTF8CharLength(mLines[aLine][aCharIndex].mChar);
+			int seqLength = UTF8CharLength(mLines[aLine][aCharIndex]);
 			aCharIndex = std::min(aCharIndex + seqLength, (int)mLines[aLine].size());
 		}
 	}
@@ -891,7 +2336,13 @@ void TextEditor::MoveCharIndexAndColumn(int aLine, int& aCharIndex, int& aColumn
 {
 	assert(aLine < mLines.size());
 	assert(aCharIndex < mLines[aLine].size());
-	char c = mLines[aLine][aCharIndex].mChar;
+	char c = mLines[aLine][aCharIndex];
+	if ((c & 0x80) == 0 && c != '\t')
+	{
+		aCharIndex++;
+		aColumn++;
+		return;
+	}
 	aCharIndex += UTF8CharLength(c);
 	if (c == '\t')
 		aColumn = (aColumn / mTabSize) * mTabSize + mTabSize;
@@ -1066,10 +2517,19 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 		return;
 	}
 
+	ScopedCount heldEvents(mEditEventsHeld);
 	UndoRecord u;
 	u.mBefore = mState;
 
-	if (hasSelection)
+	// with several cursors every touched line is rebuilt once, see InsertAtCursors
+	bool batched = mState.mCurrentCursor > 0;
+	if (batched)
+	{
+		mState.SortCursorsFromTopToBottom();
+		MergeCursorsIfPossible();
+	}
+
+	if (hasSelection && !(batched && DeleteSelectionsInLines(u)))
 	{
 		for (int c = mState.mCurrentCursor; c > -1; c--)
 		{
@@ -1078,6 +2538,26 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 		}
 	}
 
+	if (batched)
+	{
+		if (aChar == '\n')
+			SplitLinesAtCursors(u);
+		else
+		{
+			char buf[7];
+			int e = ImTextCharToUtf8(buf, 7, aChar);
+			if (e > 0)
+			{
+				buf[e] = '\0';
+				InsertAtCursors(buf, u);
+			}
+		}
+		u.SetAfter(mState);
+		AddUndo(u);
+		EnsureCursorVisible();
+		return;
+	}
+
 	std::vector<Coordinates> coords;
 	for (int c = mState.mCurrentCursor; c > -1; c--) // order important here for typing \n in the same line at the same time
 	{
@@ -1098,15 +2578,17 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 			added.mText = "";
 			added.mText += (char)aChar;
 			if (mAutoIndent)
-				for (int i = 0; i < line.size() && isascii(line[i].mChar) && isblank(line[i].mChar); ++i)
-				{
-					newLine.push_back(line[i]);
-					added.mText += line[i].mChar;
-				}
+			{
+				int indent = 0;
+				while (indent < line.size() && isascii(line[indent]) && isblank(line[indent]))
+					indent++;
+				newLine.Insert(newLine.size(), line, 0, indent);
+				added.mText.append(line.mText, 0, indent);
+			}
 
 			const size_t whitespaceSize = newLine.size();
 			auto cindex = GetCharacterIndexR(coord);
-			AddGlyphsToLine(coord.mLine + 1, newLine.size(), line.begin() + cindex, line.end());
+			AddGlyphsToLine(coord.mLine + 1, newLine.size(), line, cindex, (int)line.size());
 			RemoveGlyphsFromLine(coord.mLine, cindex);
 			SetCursorPosition(Coordinates(coord.mLine + 1, GetCharacterColumn(coord.mLine + 1, (int)whitespaceSize)), c);
 		}
@@ -1121,7 +2603,7 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 				auto cindex = GetCharacterIndexR(coord);
 
 				for (auto p = buf; *p != '\0'; p++, ++cindex)
-					AddGlyphToLine(coord.mLine, cindex, Glyph(*p, PaletteIndex::Default));
+					AddGlyphToLine(coord.mLine, cindex, *p);
 				added.mText = buf;
 
 				SetCursorPosition(Coordinates(coord.mLine, GetCharacterColumn(coord.mLine, cindex)), c);
@@ -1134,7 +2616,7 @@ void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
 		u.mOperations.push_back(added);
 	}
 
-	u.mAfter = mState;
+	u.SetAfter(mState);
 	AddUndo(u);
 
 	for (const auto& coord : coords)
@@ -1176,16 +2658,24 @@ void TextEditor::Delete(bool aWordMode, const EditorState* aEditorState)
 
 	if (AnyCursorHasSelection())
 	{
+		ScopedCount heldEvents(mEditEventsHeld);
 		UndoRecord u;
 		u.mBefore = aEditorState == nullptr ? mState : *aEditorState;
-		for (int c = mState.mCurrentCursor; c > -1; c--)
+		bool batched = false;
+		if (mState.mCurrentCursor > 0)
+		{
+			mState.SortCursorsFromTopToBottom();
+			MergeCursorsIfPossible();
+			batched = DeleteSelectionsInLines(u);
+		}
+		for (int c = mState.mCurrentCursor; c > -1 && !batched; c--)
 		{
 			if (!mState.mCursors[c].HasSelection())
 				continue;
 			u.mOperations.push_back({ GetSelectedText(c), mState.mCursors[c].GetSelectionStart(), mState.mCursors[c].GetSelectionEnd(), UndoOperationType::Delete });
 			DeleteSelection(c);
 		}
-		u.mAfter = mState;
+		u.SetAfter(mState);
 		AddUndo(u);
 	}
 	else
@@ -1263,151 +2753,134 @@ void TextEditor::AddCursorForNextOccurrence(bool aCaseSensitive)
 bool TextEditor::FindNextOccurrence(const char* aText, int aTextSize, const Coordinates& aFrom, Coordinates& outStart, Coordinates& outEnd, bool aCaseSensitive)
 {
 	assert(aTextSize > 0);
-	bool fmatches = false;
-	int fline, ifline;
-	int findex, ifindex;
-
-	ifline = fline = aFrom.mLine;
-	ifindex = findex = GetCharacterIndexR(aFrom);
-	
-	// Track if we've started from the beginning (used to prevent wrapping in linear search)
-	bool startedFromBeginning = (ifline == 0 && ifindex == 0);
-	bool hasProcessedStart = false;
-
-	while (true)
-	{
-		bool matches;
-		{ // match function
-			int lineOffset = 0;
-			int currentCharIndex = findex;
-			int i = 0;
-			for (; i < aTextSize; i++)
-			{
-				if (currentCharIndex == mLines[fline + lineOffset].size())
-				{
-					if (aText[i] == '\n' && fline + lineOffset + 1 < mLines.size())
-					{
-						currentCharIndex = 0;
-						lineOffset++;
-					}
-					else
-						break;
-				}
-				else
-				{
-					char toCompareA = mLines[fline + lineOffset][currentCharIndex].mChar;
-					char toCompareB = aText[i];
-					toCompareA = (!aCaseSensitive && toCompareA >= 'A' && toCompareA <= 'Z') ? toCompareA - 'A' + 'a' : toCompareA;
-					toCompareB = (!aCaseSensitive && toCompareB >= 'A' && toCompareB <= 'Z') ? toCompareB - 'A' + 'a' : toCompareB;
-					if (toCompareA != toCompareB)
-						break;
-					else
-						currentCharIndex++;
-				}
-			}
-			matches = i == aTextSize;
-			if (matches)
-			{
-				outStart = { fline, GetCharacterColumn(fline, findex) };
-				outEnd = { fline + lineOffset, GetCharacterColumn(fline + lineOffset, currentCharIndex) };
-				return true;
-			}
-		}
-
-		// move forward
-		if (findex == mLines[fline].size()) // need to consider line breaks
+	std::string_view text(aText, aTextSize);
+	int fromLine = aFrom.mLine;
+	int fromIndex = GetCharacterIndexR(aFrom);
+
+	// Searching from the very beginning is a linear scan for all occurrences, anything else (Find Next)
+	// wraps around once and stops at the starting position.
+	bool wrap = !(fromLine == 0 && fromIndex == 0);
+	int lineCount = (int)mLines.size();
+	for (int pass = 0; pass < (wrap ? 2 : 1); pass++)
+	{
+		int firstLine = pass == 0 ? fromLine : 0;
+		int lastLine = pass == 0 ? lineCount - 1 : fromLine;
+		for (int line = firstLine; line <= lastLine; line++)
 		{
-			if (fline == mLines.size() - 1)
-			{
-				// If we started from beginning, don't wrap (linear search for all occurrences)
-				if (startedFromBeginning)
-					return false;
-				
-				// For non-linear search (Find Next), wrap around once
-				fline = 0;
-				findex = 0;
-			}
-			else
-			{
-				fline++;
-				findex = 0;
-			}
+			int startIndex = (pass == 0 && line == fromLine) ? fromIndex : 0;
+			int endLine, endIndex;
+			int matchIndex = FindLiteralInLine(line, startIndex, text, aCaseSensitive, endLine, endIndex);
+			if (matchIndex < 0 || (pass == 1 && line == fromLine && matchIndex >= fromIndex))
+				continue;
+			outStart = { line, GetCharacterColumn(line, matchIndex) };
+			outEnd = { endLine, GetCharacterColumn(endLine, endIndex) };
+			return true;
 		}
-		else
-			findex++;
+	}
+	return false;
+}
 
-		// For wrapped search, detect when we've completed the scan
-		if (!startedFromBeginning)
+int TextEditor::FindLiteralInLine(int aLine, int aFromIndex, std::string_view aText, bool aCaseSensitive, int& outEndLine, int& outEndIndex) const
+{
+	const auto& line = mLines[aLine];
+	size_t lineBreak = aText.find('\n');
+	if (lineBreak == std::string_view::npos)
+	{
+		if (aFromIndex < 0 || aFromIndex > line.size())
+			return -1;
+		const char* begin = line.mText.data();
+		const char* match = FindLiteral(begin + aFromIndex, begin + line.size(), aText.data(), aText.size(), aCaseSensitive);
+		if (match == nullptr)
+			return -1;
+		outEndLine = aLine;
+		outEndIndex = (int)(match - begin + aText.size());
+		return (int)(match - begin);
+	}
+
+	// the first segment ends the line, the middle ones fill whole lines and the last one starts the final line
+	if (lineBreak > line.size() || (int)(line.size() - lineBreak) < aFromIndex)
+		return -1;
+	int start = (int)(line.size() - lineBreak);
+	if (!LiteralEquals(line.mText.data() + start, aText.data(), lineBreak, aCaseSensitive))
+		return -1;
+	int endLine = aLine;
+	size_t segmentStart = lineBreak + 1;
+	while (++endLine < (int)mLines.size())
+	{
+		const auto& segmentLine = mLines[endLine];
+		size_t segmentEnd = std::min(aText.find('\n', segmentStart), aText.size());
+		size_t length = segmentEnd - segmentStart;
+		bool isLast = segmentEnd == aText.size();
+		if ((isLast ? length > segmentLine.size() : length != segmentLine.size()) ||
+			!LiteralEquals(segmentLine.mText.data(), aText.data() + segmentStart, length, aCaseSensitive))
+			return -1;
+		if (isLast)
 		{
-			// Mark that we've processed the starting position
-			if (fline == ifline && findex == ifindex)
-				hasProcessedStart = true;
-			
-			// If we've wrapped and reached or passed the start position after processing it once
-			if (hasProcessedStart && ((fline == ifline && findex == ifindex) || 
-			    (fline == 0 && findex == 0 && ifline == 0 && ifindex == 0)))
-				return false;
+			outEndLine = endLine;
+			outEndIndex = (int)length;
+			return start;
 		}
+		segmentStart = segmentEnd + 1;
 	}
-
-	return false;
+	return -1;
 }
 
 bool TextEditor::FindMatchingBracket(int aLine, int aCharIndex, Coordinates& out)
 {
-	if (aLine > mLines.size() - 1)
+	if (aLine < 0 || aLine >= (int)mLines.size() || aCharIndex < 0 || aCharIndex >= (int)mLines[aLine].size())
 		return false;
-	int maxCharIndex = mLines[aLine].size() - 1;
-	if (aCharIndex > maxCharIndex)
+	int kind = BracketKind(mLines[aLine][aCharIndex]);
+	if (kind < 0 || !IsBracketGlyph(mLines[aLine].mGlyphs[aCharIndex]))
 		return false;
 
-	int currentLine = aLine;
-	int currentCharIndex = aCharIndex;
+	// Only brackets of the same kind count. Characters are scanned on the first line and on the line
+	// the match is on; lines in between are stepped over on their bracket summary.
+	bool forward = kind < 3;
+	int open = kind % 3;
 	int counter = 1;
-	if (CLOSE_TO_OPEN_CHAR.find(mLines[aLine][aCharIndex].mChar) != CLOSE_TO_OPEN_CHAR.end())
+	auto scanLine = [&](int aLineIndex, int aFrom)
 	{
-		char closeChar = mLines[aLine][aCharIndex].mChar;
-		char openChar = CLOSE_TO_OPEN_CHAR.at(closeChar);
-		while (Move(currentLine, currentCharIndex, true))
+		const Line& line = mLines[aLineIndex];
+		for (int i = aFrom; forward ? i < (int)line.size() : i >= 0; i += forward ? 1 : -1)
 		{
-			if (currentCharIndex < mLines[currentLine].size())
+			int k = BracketKind(line[i]);
+			if (k < 0 || k % 3 != open || !IsBracketGlyph(line.mGlyphs[i]))
+				continue;
+			counter += (k < 3) == forward ? 1 : -1;
+			if (counter == 0)
 			{
-				char currentChar = mLines[currentLine][currentCharIndex].mChar;
-				if (currentChar == openChar)
-				{
-					counter--;
-					if (counter == 0)
-					{
-						out = { currentLine, GetCharacterColumn(currentLine, currentCharIndex) };
-						return true;
-					}
-				}
-				else if (currentChar == closeChar)
-					counter++;
+				out = { aLineIndex, GetCharacterColumn(aLineIndex, i) };
+				return true;
 			}
 		}
+		return false;
+	};
+
+	if (scanLine(aLine, forward ? aCharIndex + 1 : aCharIndex - 1))
+		return true;
+	if (forward)
+	{
+		for (int lineIndex = aLine + 1; lineIndex < (int)mLines.size(); lineIndex++)
+		{
+			auto& line = mLines[lineIndex];
+			line.EnsureBrackets();
+			if (counter + line.mBracketLowest[open] > 0)
+				counter += line.mBracketDelta[open];
+			else
+				return scanLine(lineIndex, 0);
+		}
 	}
-	else if (OPEN_TO_CLOSE_CHAR.find(mLines[aLine][aCharIndex].mChar) != OPEN_TO_CLOSE_CHAR.end())
+	else
 	{
-		char openChar = mLines[aLine][aCharIndex].mChar;
-		char closeChar = OPEN_TO_CLOSE_CHAR.at(openChar);
-		while (Move(currentLine, currentCharIndex))
+		// scanning backwards the count drops by the most opens minus closes of any suffix of the line
+		for (int lineIndex = aLine - 1; lineIndex >= 0; lineIndex--)
 		{
-			if (currentCharIndex < mLines[currentLine].size())
-			{
-				char currentChar = mLines[currentLine][currentCharIndex].mChar;
-				if (currentChar == closeChar)
-				{
-					counter--;
-					if (counter == 0)
-					{
-						out = { currentLine, GetCharacterColumn(currentLine, currentCharIndex) };
-						return true;
-					}
-				}
-				else if (currentChar == openChar)
-					counter++;
-			}
+			auto& line = mLines[lineIndex];
+			line.EnsureBrackets();
+			if (line.mBracketDelta[open] - line.mBracketLowest[open] < counter)
+				counter -= line.mBracketDelta[open];
+			else
+				return scanLine(lineIndex, (int)line.size() - 1);
 		}
 	}
 	return false;
@@ -1417,6 +2890,7 @@ void TextEditor::ChangeCurrentLinesIndentation(bool aIncrease)
 {
 	assert(!mReadOnly);
 
+	ScopedCount heldEvents(mEditEventsHeld);
 	UndoRecord u;
 	u.mBefore = mState;
 
@@ -1443,7 +2917,7 @@ void TextEditor::ChangeCurrentLinesIndentation(bool aIncrease)
 				Coordinates start = { currentLine, 0 };
 				Coordinates end = { currentLine, mTabSize };
 				int charIndex = GetCharacterIndexL(end) - 1;
-				while (charIndex > -1 && (mLines[currentLine][charIndex].mChar == ' ' || mLines[currentLine][charIndex].mChar == '\t')) charIndex--;
+				while (charIndex > -1 && (mLines[currentLine][charIndex] == ' ' || mLines[currentLine][charIndex] == '\t')) charIndex--;
 				bool onlySpaceCharactersFound = charIndex == -1;
 				if (onlySpaceCharactersFound)
 				{
@@ -1463,6 +2937,7 @@ void TextEditor::MoveUpCurrentLines()
 {
 	assert(!mReadOnly);
 
+	ScopedCount heldEvents(mEditEventsHeld);
 	UndoRecord u;
 	u.mBefore = mState;
 
@@ -1498,7 +2973,13 @@ void TextEditor::MoveUpCurrentLines()
 
 	end = { maxLine, GetLineMaxColumn(maxLine) }; // this line is swapped with line above, need to find new max column
 	u.mOperations.push_back({ GetText(start, end), start, end, UndoOperationType::Add });
-	u.mAfter = mState;
+	for (int line = start.mLine; line <= end.mLine; line++) // swapped lines hold other text at their index
+		mLines[line].mRevision = ++mDocumentVersion;
+	mLineLayoutVersion++;
+	Colorize(start.mLine, end.mLine - start.mLine + 1);
+	InvalidateFindLines(start.mLine, end.mLine);
+	MarkFindResultsDirty(true);
+	u.SetAfter(mState);
 	AddUndo(u);
 }
 
@@ -1506,6 +2987,7 @@ void TextEditor::MoveDownCurrentLines()
 {
 	assert(!mReadOnly);
 
+	ScopedCount heldEvents(mEditEventsHeld);
 	UndoRecord u;
 	u.mBefore = mState;
 
@@ -1542,7 +3024,13 @@ void TextEditor::MoveDownCurrentLines()
 
 	end = { maxLine + 1, GetLineMaxColumn(maxLine + 1) }; // this line is swapped with line below, need to find new max column
 	u.mOperations.push_back({ GetText(start, end), start, end, UndoOperationType::Add });
-	u.mAfter = mState;
+	for (int line = start.mLine; line <= end.mLine; line++) // swapped lines hold other text at their index
+		mLines[line].mRevision = ++mDocumentVersion;
+	mLineLayoutVersion++;
+	Colorize(start.mLine, end.mLine - start.mLine + 1);
+	InvalidateFindLines(start.mLine, end.mLine);
+	MarkFindResultsDirty(true);
+	u.SetAfter(mState);
 	AddUndo(u);
 }
 
@@ -1553,6 +3041,7 @@ void TextEditor::ToggleLineComment()
 		return;
 	const std::string& commentString = mLanguageDefinition->mSingleLineComment;
 
+	ScopedCount heldEvents(mEditEventsHeld);
 	UndoRecord u;
 	u.mBefore = mState;
 
@@ -1566,11 +3055,11 @@ void TextEditor::ToggleLineComment()
 				continue;
 			affectedLines.insert(currentLine);
 			int currentIndex = 0;
-			while (currentIndex < mLines[currentLine].size() && (mLines[currentLine][currentIndex].mChar == ' ' || mLines[currentLine][currentIndex].mChar == '\t')) currentIndex++;
+			while (currentIndex < mLines[currentLine].size() && (mLines[currentLine][currentIndex] == ' ' || mLines[currentLine][currentIndex] == '\t')) currentIndex++;
 			if (currentIndex == mLines[currentLine].size())
 				continue;
 			int i = 0;
-			while (i < commentString.length() && currentIndex + i < mLines[currentLine].size() && mLines[currentLine][currentIndex + i].mChar == commentString[i]) i++;
+			while (i < commentString.length() && currentIndex + i < mLines[currentLine].size() && mLines[currentLine][currentIndex + i] == commentString[i]) i++;
 			bool matched = i == commentString.length();
 			shouldAddComment |= !matched;
 		}
@@ -1592,14 +3081,14 @@ void TextEditor::ToggleLineComment()
 		for (int currentLine : affectedLines) // order doesn't matter as changes are not multiline
 		{
 			int currentIndex = 0;
-			while (currentIndex < mLines[currentLine].size() && (mLines[currentLine][currentIndex].mChar == ' ' || mLines[currentLine][currentIndex].mChar == '\t')) currentIndex++;
+			while (currentIndex < mLines[currentLine].size() && (mLines[currentLine][currentIndex] == ' ' || mLines[currentLine][currentIndex] == '\t')) currentIndex++;
 			if (currentIndex == mLines[currentLine].size())
 				continue;
 			int i = 0;
-			while (i < commentString.length() && currentIndex + i < mLines[currentLine].size() && mLines[currentLine][currentIndex + i].mChar == commentString[i]) i++;
+			while (i < commentString.length() && currentIndex + i < mLines[currentLine].size() && mLines[currentLine][currentIndex + i] == commentString[i]) i++;
 			bool matched = i == commentString.length();
 			assert(matched);
-			if (currentIndex + i < mLines[currentLine].size() && mLines[currentLine][currentIndex + i].mChar == ' ')
+			if (currentIndex + i < mLines[currentLine].size() && mLines[currentLine][currentIndex + i] == ' ')
 				i++;
 
 			Coordinates start = { currentLine, GetCharacterColumn(currentLine, currentIndex) };
@@ -1610,12 +3099,13 @@ void TextEditor::ToggleLineComment()
 		}
 	}
 
-	u.mAfter = mState;
+	u.SetAfter(mState);
 	AddUndo(u);
 }
 
 void TextEditor::RemoveCurrentLines()
 {
+	ScopedCount heldEvents(mEditEventsHeld);
 	UndoRecord u;
 	u.mBefore = mState;
 
@@ -1667,7 +3157,7 @@ void TextEditor::RemoveCurrentLines()
 			DeleteRange(toDeleteStart, toDeleteEnd);
 	}
 
-	u.mAfter = mState;
+	u.SetAfter(mState);
 	AddUndo(u);
 }
 
@@ -1717,7 +3207,7 @@ TextEditor::Coordinates TextEditor::SanitizeCoordinates(const Coordinates& aValu
 
 	// Move if inside a tab character
 	int charIndex = GetCharacterIndexL(out);
-	if (charIndex > -1 && charIndex < mLines[out.mLine].size() && mLines[out.mLine][charIndex].mChar == '\t')
+	if (charIndex > -1 && charIndex < mLines[out.mLine].size() && mLines[out.mLine][charIndex] == '\t')
 	{
 		int columnToLeft = GetCharacterColumn(out.mLine, charIndex);
 		int columnToRight = GetCharacterColumn(out.mLine, GetCharacterIndexR(out));
@@ -1766,16 +3256,16 @@ TextEditor::Coordinates TextEditor::FindWordStart(const Coordinates& aFrom) cons
 	if (charIndex == (int)line.size())
 		charIndex--;
 
-	bool initialIsWordChar = CharIsWordChar(line[charIndex].mChar);
-	bool initialIsSpace = isspace(line[charIndex].mChar);
-	char initialChar = line[charIndex].mChar;
+	bool initialIsWordChar = CharIsWordChar(line[charIndex]);
+	bool initialIsSpace = isspace(line[charIndex]);
+	char initialChar = line[charIndex];
 	while (Move(lineIndex, charIndex, true, true))
 	{
-		bool isWordChar = CharIsWordChar(line[charIndex].mChar);
-		bool isSpace = isspace(line[charIndex].mChar);
+		bool isWordChar = CharIsWordChar(line[charIndex]);
+		bool isSpace = isspace(line[charIndex]);
 		if (initialIsSpace && !isSpace ||
 			initialIsWordChar && !isWordChar ||
-			!initialIsWordChar && !initialIsSpace && initialChar != line[charIndex].mChar)
+			!initialIsWordChar && !initialIsSpace && initialChar != line[charIndex])
 		{
 			Move(lineIndex, charIndex, false, true); // one step to the right
 			break;
@@ -1796,48 +3286,155 @@ TextEditor::Coordinates TextEditor::FindWordEnd(const Coordinates& aFrom) const
 	if (charIndex >= (int)line.size())
 		return aFrom;
 
-	bool initialIsWordChar = CharIsWordChar(line[charIndex].mChar);
-	bool initialIsSpace = isspace(line[charIndex].mChar);
-	char initialChar = line[charIndex].mChar;
+	bool initialIsWordChar = CharIsWordChar(line[charIndex]);
+	bool initialIsSpace = isspace(line[charIndex]);
+	char initialChar = line[charIndex];
 	while (Move(lineIndex, charIndex, false, true))
 	{
 		if (charIndex == line.size())
 			break;
-		bool isWordChar = CharIsWordChar(line[charIndex].mChar);
-		bool isSpace = isspace(line[charIndex].mChar);
+		bool isWordChar = CharIsWordChar(line[charIndex]);
+		bool isSpace = isspace(line[charIndex]);
 		if (initialIsSpace && !isSpace ||
 			initialIsWordChar && !isWordChar ||
-			!initialIsWordChar && !initialIsSpace && initialChar != line[charIndex].mChar)
+			!initialIsWordChar && !initialIsSpace && initialChar != line[charIndex])
 			break;
 	}
 	return { lineIndex, GetCharacterColumn(aFrom.mLine, charIndex) };
 }
 
-int TextEditor::GetCharacterIndexL(const Coordinates& aCoords) const
+bool TextEditor::Line::IsPlainText(const char* aBegin, const char* aEnd)
 {
-	if (aCoords.mLine >= mLines.size())
-		return -1;
+	const char* p = aBegin;
+#if defined(TEXT_EDITOR_FIND_SSE2)
+	const __m128i tab = _mm_set1_epi8('\t');
+	for (; aEnd - p >= 16; p += 16)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)p);
+		if (_mm_movemask_epi8(_mm_or_si128(bytes, _mm_cmpeq_epi8(bytes, tab))) != 0) // high bit or tab
+			return false;
+	}
+#elif defined(TEXT_EDITOR_FIND_NEON)
+	const uint8x16_t tab = vdupq_n_u8((uint8_t)'\t');
+	const uint8x16_t high = vdupq_n_u8(0x80);
+	for (; aEnd - p >= 16; p += 16)
+	{
+		uint8x16_t bytes = vld1q_u8((const uint8_t*)p);
+		uint8x16_t hits = vorrq_u8(vceqq_u8(bytes, tab), vcgeq_u8(bytes, high));
+		if (vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0) != 0)
+			return false;
+	}
+#endif
+	for (; p < aEnd; p++)
+	{
+		if (*p == '\t' || (*p & 0x80) != 0)
+			return false;
+	}
+	return true;
+}
 
-	auto& line = mLines[aCoords.mLine];
-	int c = 0;
-	int i = 0;
-	int tabCoordsLeft = 0;
+void TextEditor::Line::BuildColumns(int aTabSize) const
+{
+	mColumnsTabSize = aTabSize;
+	mPlainColumns = IsPlainText(mText.data(), mText.data() + mText.size());
+	mColumnBreaks.clear();
+	if (mPlainColumns)
+	{
+		mColumnBreaks.shrink_to_fit();
+		return;
+	}
 
-	for (; i < line.size() && c < aCoords.mColumn;)
+	int column = 0;
+	for (size_t i = 0; i < mText.size();)
 	{
-		if (line[i].mChar == '\t')
-		{
-			if (tabCoordsLeft == 0)
-				tabCoordsLeft = TabSizeAtColumn(c);
-			if (tabCoordsLeft > 0)
-				tabCoordsLeft--;
-			c++;
-		}
+		char c = mText[i];
+		size_t next = std::min(i + UTF8CharLength(c), mText.size());
+		if (c == '\t' || next - i > 1)
+			mColumnBreaks.push_back({ (int)i, column });
+		column = c == '\t' ? (column / aTabSize) * aTabSize + aTabSize : column + 1;
+		i = next;
+	}
+	mColumnBreaks.shrink_to_fit();
+}
+
+void TextEditor::Line::GetBreakEnd(const ColumnBreak& aBreak, int& outIndex, int& outColumn) const
+{
+	// where the character after the break starts
+	char c = mText[aBreak.mIndex];
+	if (c == '\t')
+	{
+		outIndex = aBreak.mIndex + 1;
+		outColumn = (aBreak.mColumn / mColumnsTabSize) * mColumnsTabSize + mColumnsTabSize;
+	}
+	else
+	{
+		outIndex = std::min(aBreak.mIndex + UTF8CharLength(c), (int)mText.size());
+		outColumn = aBreak.mColumn + 1;
+	}
+}
+
+int TextEditor::Line::ColumnAtBreaks(int aIndex) const
+{
+	auto it = std::upper_bound(mColumnBreaks.begin(), mColumnBreaks.end(), aIndex,
+		[](int aValue, const ColumnBreak& aBreak) { return aValue < aBreak.mIndex; });
+	if (it == mColumnBreaks.begin())
+		return aIndex;
+	--it;
+	int endIndex, endColumn;
+	GetBreakEnd(*it, endIndex, endColumn);
+	return aIndex < endIndex ? it->mColumn : endColumn + (aIndex - endIndex);
+}
+
+int TextEditor::Line::IndexAtColumnBreaks(int aColumn) const
+{
+	if (aColumn <= 0)
+		return 0;
+	auto it = std::upper_bound(mColumnBreaks.begin(), mColumnBreaks.end(), aColumn,
+		[](int aValue, const ColumnBreak& aBreak) { return aValue < aBreak.mColumn; });
+	int index = aColumn;
+	if (it != mColumnBreaks.begin())
+	{
+		--it;
+		int endIndex, endColumn;
+		GetBreakEnd(*it, endIndex, endColumn);
+		if (it->mColumn == aColumn)
+			index = it->mIndex;
 		else
-			++c;
-		if (tabCoordsLeft == 0)
-			i += UTF8CharLength(line[i].mChar);
+			index = aColumn <= endColumn ? endIndex : endIndex + (aColumn - endColumn);
+	}
+	return std::min(index, (int)mText.size());
+}
+
+void TextEditor::Line::BuildBrackets()
+{
+	// string colors come from tokenizing, an untokenized line is summarized but not kept as valid
+	mBracketsRevision = mColorizedRevision == mRevision ? mRevision : kNeverColorized;
+	mBracketsEntryState = mEntryState;
+	for (int kind = 0; kind < 3; kind++)
+		mBracketDelta[kind] = mBracketLowest[kind] = 0;
+	for (size_t i = 0; i < mText.size(); i++)
+	{
+		int kind = BracketKind(mText[i]);
+		if (kind < 0 || !IsBracketGlyph(mGlyphs[i]))
+			continue;
+		if (kind < 3)
+			mBracketDelta[kind]++;
+		else if (--mBracketDelta[kind - 3] < mBracketLowest[kind - 3])
+			mBracketLowest[kind - 3] = mBracketDelta[kind - 3];
 	}
+}
+
+int TextEditor::GetCharacterIndexL(const Coordinates& aCoords) const
+{
+	if (aCoords.mLine >= mLines.size())
+		return -1;
+
+	// a column inside a tab gives the tab
+	auto& line = mLines[aCoords.mLine];
+	line.EnsureColumns(mTabSize);
+	int i = line.IndexAtColumn(aCoords.mColumn);
+	if (i > 0 && line.ColumnAt(i) > aCoords.mColumn)
+		i = line.IndexAtColumn(line.ColumnAt(i - 1));
 	return i;
 }
 
@@ -1845,33 +3442,33 @@ int TextEditor::GetCharacterIndexR(const Coordinates& aCoords) const
 {
 	if (aCoords.mLine >= mLines.size())
 		return -1;
-	int c = 0;
-	int i = 0;
-	for (; i < mLines[aCoords.mLine].size() && c < aCoords.mColumn;)
-		MoveCharIndexAndColumn(aCoords.mLine, i, c);
-	return i;
+	auto& line = mLines[aCoords.mLine];
+	line.EnsureColumns(mTabSize);
+	return line.IndexAtColumn(aCoords.mColumn);
 }
 
 int TextEditor::GetCharacterColumn(int aLine, int aIndex) const
 {
-	if (aLine >= mLines.size())
+	if (aLine >= mLines.size() || aIndex <= 0)
 		return 0;
-	int c = 0;
-	int i = 0;
-	while (i < aIndex && i < mLines[aLine].size())
-		MoveCharIndexAndColumn(aLine, i, c);
-	return c;
+	auto& line = mLines[aLine];
+	line.EnsureColumns(mTabSize);
+	// an index inside a multi-byte character counts as past it, the bytes of a character share its
+	// column and the next character starts on a greater one
+	int index = Min(aIndex, (int)line.size());
+	while (index < (int)line.size() && line.ColumnAt(index) == line.ColumnAt(index - 1))
+		index++;
+	return line.ColumnAt(index);
 }
 
 int TextEditor::GetFirstVisibleCharacterIndex(int aLine) const
 {
 	if (aLine >= mLines.size())
 		return 0;
-	int c = 0;
-	int i = 0;
-	while (c < mFirstVisibleColumn && i < mLines[aLine].size())
-		MoveCharIndexAndColumn(aLine, i, c);
-	if (c > mFirstVisibleColumn)
+	auto& line = mLines[aLine];
+	line.EnsureColumns(mTabSize);
+	int i = line.IndexAtColumn(mFirstVisibleColumn);
+	if (line.ColumnAt(i) > mFirstVisibleColumn)
 		i--;
 	return i;
 }
@@ -1880,29 +3477,25 @@ int TextEditor::GetLineMaxColumn(int aLine, int aLimit) const
 {
 	if (aLine >= mLines.size())
 		return 0;
-	int c = 0;
-	if (aLimit == -1)
-	{
-		for (int i = 0; i < mLines[aLine].size(); )
-			MoveCharIndexAndColumn(aLine, i, c);
-	}
-	else
-	{
-		for (int i = 0; i < mLines[aLine].size(); )
-		{
-			MoveCharIndexAndColumn(aLine, i, c);
-			if (c > aLimit)
-				return aLimit;
-		}
-	}
-	return c;
+	auto& line = mLines[aLine];
+	line.EnsureColumns(mTabSize);
+	int c = line.ColumnAt((int)line.size());
+	return aLimit != -1 && c > aLimit ? aLimit : c;
 }
 
-TextEditor::Line& TextEditor::InsertLine(int aIndex)
+TextEditor::Line& TextEditor::InsertLine(int aIndex, bool aMoveCursors)
 {
 	assert(!mReadOnly);
-	auto& result = *mLines.insert(mLines.begin() + aIndex, Line());
-
+	auto& result = mLines.insert(aIndex);
+	result.mRevision = ++mDocumentVersion;
+	mLineLayoutVersion++;
+	ShiftCommentStateRange(aIndex, 1);
+	InvalidateCommentState(aIndex, aIndex);
+	ShiftFindLines(aIndex, 1);
+	InvalidateFindLines(aIndex, aIndex);
+
+	if (!aMoveCursors)
+		return result;
 	for (int c = 0; c <= mState.mCurrentCursor; c++) // handle multiple cursors
 	{
 		if (mState.mCursors[c].mInteractiveEnd.mLine >= aIndex)
@@ -1917,8 +3510,16 @@ void TextEditor::RemoveLine(int aIndex, const std::unordered_set<int>* aHandledC
 	assert(!mReadOnly);
 	assert(mLines.size() > 1);
 
-	mLines.erase(mLines.begin() + aIndex);
+	if (mDocumentWordCompletion)
+		ReleaseLineWords(mLines[aIndex]);
+	mLines.erase(aIndex);
 	assert(!mLines.empty());
+	mDocumentVersion++;
+	mLineLayoutVersion++;
+	ShiftCommentStateRange(aIndex, -1);
+	InvalidateCommentState(aIndex, aIndex);
+	ShiftFindLines(aIndex, -1);
+	InvalidateFindLines(aIndex, aIndex);
 
 	// handle multiple cursors
 	for (int c = 0; c <= mState.mCurrentCursor; c++)
@@ -1937,8 +3538,17 @@ void TextEditor::RemoveLines(int aStart, int aEnd)
 	assert(aEnd >= aStart);
 	assert(mLines.size() > (size_t)(aEnd - aStart));
 
-	mLines.erase(mLines.begin() + aStart, mLines.begin() + aEnd);
+	if (mDocumentWordCompletion)
+		for (int i = aStart; i < aEnd; i++)
+			ReleaseLineWords(mLines[i]);
+	mLines.erase(aStart, aEnd);
 	assert(!mLines.empty());
+	mDocumentVersion++;
+	mLineLayoutVersion++;
+	ShiftCommentStateRange(aStart, aStart - aEnd);
+	InvalidateCommentState(aStart, aStart);
+	ShiftFindLines(aStart, aStart - aEnd);
+	InvalidateFindLines(aStart, aStart);
 
 	// handle multiple cursors
 	for (int c = 0; c <= mState.mCurrentCursor; c++)
@@ -1970,6 +3580,13 @@ void TextEditor::DeleteRange(const Coordinates& aStart, const Coordinates& aEnd)
 
 	auto start = GetCharacterIndexL(aStart);
 	auto end = GetCharacterIndexR(aEnd);
+	bool emit = mEditEventsHeld == 0 && HasEditObservers();
+	Coordinates eventStart, eventEnd;
+	if (emit)
+	{
+		eventStart = Coordinates(aStart.mLine, GetCharacterColumn(aStart.mLine, start));
+		eventEnd = Coordinates(aEnd.mLine, GetCharacterColumn(aEnd.mLine, end));
+	}
 
 	if (aStart.mLine == aEnd.mLine)
 	{
@@ -1988,7 +3605,7 @@ void TextEditor::DeleteRange(const Coordinates& aStart, const Coordinates& aEnd)
 
 		if (aStart.mLine < aEnd.mLine)
 		{
-			AddGlyphsToLine(aStart.mLine, firstLine.size(), lastLine.begin(), lastLine.end());
+			AddGlyphsToLine(aStart.mLine, firstLine.size(), lastLine, 0, (int)lastLine.size());
 			for (int c = 0; c <= mState.mCurrentCursor; c++) // move up cursors in line that is being moved up
 			{
 				// if cursor is selecting the same range we are deleting, it's because this is being called from
@@ -2011,6 +3628,8 @@ void TextEditor::DeleteRange(const Coordinates& aStart, const Coordinates& aEnd)
 			RemoveLines(aStart.mLine + 1, aEnd.mLine + 1);
 		}
 	}
+	if (emit)
+		EmitEditEvent(eventStart, eventEnd, std::string_view());
 }
 
 void TextEditor::DeleteSelection(int aCursor)
@@ -2032,26 +3651,35 @@ void TextEditor::RemoveGlyphsFromLine(int aLine, int aStartChar, int aEndChar)
 	int column = GetCharacterColumn(aLine, aStartChar);
 	auto& line = mLines[aLine];
 	OnLineChanged(true, aLine, column, aEndChar - aStartChar, true);
-	line.erase(line.begin() + aStartChar, aEndChar == -1 ? line.end() : line.begin() + aEndChar);
+	line.Erase(aStartChar, aEndChar == -1 ? line.size() : aEndChar);
+	line.mRevision = ++mDocumentVersion;
+	InvalidateCommentState(aLine, aLine);
+	InvalidateFindLines(aLine, aLine);
 	OnLineChanged(false, aLine, column, aEndChar - aStartChar, true);
 }
 
-void TextEditor::AddGlyphsToLine(int aLine, int aTargetIndex, Line::iterator aSourceStart, Line::iterator aSourceEnd)
+void TextEditor::AddGlyphsToLine(int aLine, int aTargetIndex, const Line& aSource, int aSourceStart, int aSourceEnd)
 {
 	int targetColumn = GetCharacterColumn(aLine, aTargetIndex);
-	int charsInserted = std::distance(aSourceStart, aSourceEnd);
+	int charsInserted = aSourceEnd - aSourceStart;
 	auto& line = mLines[aLine];
 	OnLineChanged(true, aLine, targetColumn, charsInserted, false);
-	line.insert(line.begin() + aTargetIndex, aSourceStart, aSourceEnd);
+	line.Insert(aTargetIndex, aSource, aSourceStart, aSourceEnd);
+	line.mRevision = ++mDocumentVersion;
+	InvalidateCommentState(aLine, aLine);
+	InvalidateFindLines(aLine, aLine);
 	OnLineChanged(false, aLine, targetColumn, charsInserted, false);
 }
 
-void TextEditor::AddGlyphToLine(int aLine, int aTargetIndex, Glyph aGlyph)
+void TextEditor::AddGlyphToLine(int aLine, int aTargetIndex, char aChar)
 {
 	int targetColumn = GetCharacterColumn(aLine, aTargetIndex);
 	auto& line = mLines[aLine];
 	OnLineChanged(true, aLine, targetColumn, 1, false);
-	line.insert(line.begin() + aTargetIndex, aGlyph);
+	line.Insert(aTargetIndex, aChar);
+	line.mRevision = ++mDocumentVersion;
+	InvalidateCommentState(aLine, aLine);
+	InvalidateFindLines(aLine, aLine);
 	OnLineChanged(false, aLine, targetColumn, 1, false);
 }
 
@@ -2423,6 +4051,189 @@ void TextEditor::UpdateViewVariables(float aScrollX, float aScrollY)
 	mLastVisibleColumn = Max((int)((mContentWidth + aScrollX - mTextStart) / mCharAdvance.x), 0);
 }
 
+void TextEditor::RenderLineText(ImDrawList* aDrawList, int aLineNo, const ImVec2& aTextScreenPos, float aFontHeight, float aSpaceSize)
+{
+	// One AddText per run of glyphs sharing their attributes, and the whitespace markers of a run of
+	// blanks as one batch of quads
+	const auto& line = mLines[aLineNo];
+	const float textStartX = aTextScreenPos.x;
+	const float lineY = aTextScreenPos.y;
+	int charIndex = GetFirstVisibleCharacterIndex(aLineNo);
+	int column = mFirstVisibleColumn; // can be in the middle of tab character
+	while (charIndex < (int)line.size() && column <= mLastVisibleColumn)
+	{
+		if (line[charIndex] == ' ' || line[charIndex] == '\t')
+		{
+			int blankIndex = charIndex;
+			int blankColumn = column;
+			int quadCount = 0;
+			while (charIndex < (int)line.size() && column <= mLastVisibleColumn && (line[charIndex] == ' ' || line[charIndex] == '\t'))
+			{
+				quadCount += line[charIndex] == '\t' ? 3 : 1;
+				MoveCharIndexAndColumn(aLineNo, charIndex, column);
+			}
+			if (!mShowWhitespaces)
+				continue;
+
+			const ImU32 markerColor = mPalette[(int)PaletteIndex::ControlCharacter];
+			const ImVec2 uv = ImGui::GetFontTexUvWhitePixel();
+			const float s = ImGui::GetFontSize();
+			auto addLine = [&](const ImVec2& aFrom, const ImVec2& aTo)
+			{
+				float dx = aTo.x - aFrom.x;
+				float dy = aTo.y - aFrom.y;
+				float scale = 0.5f / std::max(sqrtf(dx * dx + dy * dy), 0.0001f);
+				float nx = -dy * scale;
+				float ny = dx * scale;
+				aDrawList->PrimQuadUV(ImVec2(aFrom.x + nx, aFrom.y + ny), ImVec2(aTo.x + nx, aTo.y + ny),
+					ImVec2(aTo.x - nx, aTo.y - ny), ImVec2(aFrom.x - nx, aFrom.y - ny), uv, uv, uv, uv, markerColor);
+			};
+			aDrawList->PrimReserve(quadCount * 6, quadCount * 4);
+			for (int i = blankIndex, blankEnd = charIndex; i < blankEnd; MoveCharIndexAndColumn(aLineNo, i, blankColumn))
+			{
+				const float x = textStartX + blankColumn * mCharAdvance.x;
+				if (line[i] == '\t')
+				{
+					const float x1 = x + mCharAdvance.x * 0.3f;
+					const float y = lineY + aFontHeight * 0.5f;
+					const float x2 = mShortTabs ? x + mCharAdvance.x : x + TabSizeAtColumn(blankColumn) * mCharAdvance.x - mCharAdvance.x * 0.3f;
+					const float head = s * (mShortTabs ? 0.16f : 0.2f);
+					addLine(ImVec2(x1, y), ImVec2(x2, y));
+					addLine(ImVec2(x2, y), ImVec2(x2 - head, y - head));
+					addLine(ImVec2(x2, y), ImVec2(x2 - head, y + head));
+				}
+				else
+				{
+					const ImVec2 center(x + aSpaceSize * 0.5f, lineY + s * 0.5f);
+					const float r = 1.5f;
+					aDrawList->PrimQuadUV(ImVec2(center.x, center.y - r), ImVec2(center.x + r, center.y),
+						ImVec2(center.x, center.y + r), ImVec2(center.x - r, center.y), uv, uv, uv, uv, markerColor);
+				}
+			}
+			continue;
+		}
+
+		// Positions come from columns, not from the font, so a multi-byte character (possibly wider
+		// than mCharAdvance) is drawn on its own and the run restarts at the next column.
+		const Glyph attributes = line.mGlyphs[charIndex];
+		int runIndex = charIndex;
+		int runColumn = column;
+		if (line.mPlainColumns)
+		{
+			// one byte per column, the run ends at a blank, other attributes or the edge of the view
+			int visibleEnd = Min((int)line.size(), mLastVisibleColumn + 1);
+			while (charIndex < visibleEnd && line[charIndex] != ' ' && line.mGlyphs[charIndex] == attributes)
+				charIndex++;
+			column = charIndex;
+			int bracketColumn = mMatchingBracketCoords.mColumn;
+			if (mCursorOnBracket && mMatchingBracketCoords.mLine == aLineNo && bracketColumn >= runColumn && bracketColumn < column)
+			{
+				ImVec2 topLeft = { textStartX + bracketColumn * mCharAdvance.x, lineY + aFontHeight + 1.0f };
+				ImVec2 bottomRight = { topLeft.x + mCharAdvance.x, topLeft.y + 1.0f };
+				aDrawList->AddRectFilled(topLeft, bottomRight, mPalette[(int)PaletteIndex::Cursor]);
+			}
+		}
+		else
+		{
+			while (charIndex < (int)line.size() && column <= mLastVisibleColumn)
+			{
+				char glyphChar = line[charIndex];
+				if (glyphChar == ' ' || glyphChar == '\t' || line.mGlyphs[charIndex] != attributes)
+					break;
+				bool multiByte = UTF8CharLength(glyphChar) > 1;
+				if (multiByte && charIndex > runIndex)
+					break;
+				if (mCursorOnBracket && !multiByte && mMatchingBracketCoords == Coordinates{ aLineNo, column })
+				{
+					ImVec2 topLeft = { textStartX + column * mCharAdvance.x, lineY + aFontHeight + 1.0f };
+					ImVec2 bottomRight = { topLeft.x + mCharAdvance.x, topLeft.y + 1.0f };
+					aDrawList->AddRectFilled(topLeft, bottomRight, mPalette[(int)PaletteIndex::Cursor]);
+				}
+				MoveCharIndexAndColumn(aLineNo, charIndex, column);
+				if (multiByte)
+					break;
+			}
+		}
+		const char* runStart = line.mText.data() + runIndex;
+		aDrawList->AddText(ImVec2(textStartX + runColumn * mCharAdvance.x, lineY), GetGlyphColor(attributes), runStart, line.mText.data() + charIndex);
+		mFrameStats.mTextDrawCalls++;
+	}
+}
+
+// Everything the text of a line is drawn with besides the line itself. Cached vertices carry the
+// font's UVs, so the font and the atlas texture they point into are part of it.
+uint64_t TextEditor::HashLineDrawSettings(const ImFont* aFont, ImTextureID aTexture, float aFontHeight, float aSpaceSize) const
+{
+	float metrics[4] = { ImGui::GetFontSize(), mCharAdvance.x, aFontHeight, aSpaceSize };
+	int view[6] = { mFirstVisibleColumn, mLastVisibleColumn, mTabSize, mShowWhitespaces, mShortTabs, mLanguageDefinition != nullptr };
+	uint64_t settings = HashBytes(mPalette.data(), sizeof(Palette));
+	settings = HashBytes(&aFont, sizeof(aFont), settings);
+	settings = HashBytes(&aTexture, sizeof(aTexture), settings);
+	settings = HashBytes(metrics, sizeof(metrics), settings);
+	return HashBytes(view, sizeof(view), settings);
+}
+
+// Geometry is kept relative to the text origin so scrolling only translates it. ImGui truncates text
+// positions to whole pixels and culls text against the clip rect, so the fractional part of the
+// origin, the horizontal clip bounds and whether the line is vertically clipped are part of the key.
+void TextEditor::RenderLineTextRetained(ImDrawList* aDrawList, int aLineNo, const ImVec2& aTextScreenPos, float aFontHeight, float aSpaceSize)
+{
+	const auto& line = mLines[aLineNo];
+	int from = GetFirstVisibleCharacterIndex(aLineNo);
+	int to = Max(from, line.IndexAtColumn(mLastVisibleColumn + 1));
+	int fromColumn = line.ColumnAt(from);
+	int bracketColumn = mCursorOnBracket && mMatchingBracketCoords.mLine == aLineNo ? mMatchingBracketCoords.mColumn : -1;
+	ImVec2 clipMin = aDrawList->GetClipRectMin();
+	ImVec2 clipMax = aDrawList->GetClipRectMax();
+	float placement[5] = { aTextScreenPos.x - floorf(aTextScreenPos.x), aTextScreenPos.y - floorf(aTextScreenPos.y),
+		clipMin.x - aTextScreenPos.x, clipMax.x - aTextScreenPos.x,
+		aTextScreenPos.y + ImGui::GetFontSize() < clipMin.y || aTextScreenPos.y > clipMax.y ? 1.0f : 0.0f };
+	uint64_t key = HashBytes(line.mText.data() + from, to - from);
+	key = HashBytes(line.mGlyphs.data() + from, to - from, key);
+	key = HashBytes(&fromColumn, sizeof(fromColumn), key);
+	key = HashBytes(&bracketColumn, sizeof(bracketColumn), key);
+	key = HashBytes(placement, sizeof(placement), key);
+
+	LineDrawCache& cache = mLineDrawCache[aLineNo];
+	if (cache.mValid && cache.mKey == key)
+	{
+		if (cache.mIndices.empty())
+			return;
+		aDrawList->PrimReserve((int)cache.mIndices.size(), (int)cache.mVertices.size());
+		ImDrawIdx base = (ImDrawIdx)aDrawList->_VtxCurrentIdx;
+		for (ImDrawIdx index : cache.mIndices)
+			aDrawList->PrimWriteIdx((ImDrawIdx)(base + index));
+		for (const ImDrawVert& vertex : cache.mVertices)
+			aDrawList->PrimWriteVtx(ImVec2(vertex.pos.x + aTextScreenPos.x, vertex.pos.y + aTextScreenPos.y), vertex.uv, vertex.col);
+		return;
+	}
+
+	int commandCount = aDrawList->CmdBuffer.Size;
+	int vertexStart = aDrawList->VtxBuffer.Size;
+	int indexStart = aDrawList->IdxBuffer.Size;
+	unsigned int base = aDrawList->_VtxCurrentIdx;
+	RenderLineText(aDrawList, aLineNo, aTextScreenPos, aFontHeight, aSpaceSize);
+	int vertexCount = aDrawList->VtxBuffer.Size - vertexStart;
+	int indexCount = aDrawList->IdxBuffer.Size - indexStart;
+
+	// not kept when the line went into a new draw command, its indices would not be relative to one base
+	cache.mKey = key;
+	cache.mValid = aDrawList->CmdBuffer.Size == commandCount && aDrawList->_VtxCurrentIdx == base + vertexCount;
+	if (!cache.mValid)
+		return;
+	cache.mVertices.resize(vertexCount);
+	for (int i = 0; i < vertexCount; i++)
+	{
+		ImDrawVert vertex = aDrawList->VtxBuffer[vertexStart + i];
+		vertex.pos.x -= aTextScreenPos.x;
+		vertex.pos.y -= aTextScreenPos.y;
+		cache.mVertices[i] = vertex;
+	}
+	cache.mIndices.resize(indexCount);
+	for (int i = 0; i < indexCount; i++)
+		cache.mIndices[i] = (ImDrawIdx)(aDrawList->IdxBuffer[indexStart + i] - base);
+}
+
 void TextEditor::Render(bool aParentIsFocused)
 {
 	ImGuiIO& io = ImGui::GetIO();
@@ -2483,12 +4294,43 @@ void TextEditor::Render(bool aParentIsFocused)
 		auto drawList = ImGui::GetWindowDrawList();
 		float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
 
+		if (mRetainedRendering)
+		{
+			ImFont* font = ImGui::GetFont();
+			uint64_t settings = HashLineDrawSettings(font, font->ContainerAtlas->TexID, fontHeight, spaceSize);
+			if (settings != mLineDrawCacheSettings)
+				mLineDrawCache.clear();
+			mLineDrawCacheSettings = settings;
+			for (auto it = mLineDrawCache.begin(); it != mLineDrawCache.end();)
+			{
+				if (it->first < mFirstVisibleLine || it->first > mLastVisibleLine)
+					it = mLineDrawCache.erase(it);
+				else
+					++it;
+			}
+		}
+
+		// highlight segments exist for the visible lines only, scrolled away ones are built again if needed
+		for (auto it = mFindHighlightsCache.begin(); it != mFindHighlightsCache.end();)
+		{
+			if (it->first < mFirstVisibleLine || it->first > mLastVisibleLine)
+				it = mFindHighlightsCache.erase(it);
+			else
+				++it;
+		}
+
+		// so are column tables, the lines scrolled out of view since the last frame give theirs back
+		for (int lineNo = mColumnsFirstLine; lineNo <= mColumnsLastLine && lineNo < (int)mLines.size(); lineNo++)
+			if ((lineNo < mFirstVisibleLine || lineNo > mLastVisibleLine) && mLines[lineNo].HasColumnBreaks())
+				mLines[lineNo].DropColumns();
+		mColumnsFirstLine = mFirstVisibleLine;
+		mColumnsLastLine = mLastVisibleLine;
+
 		for (int lineNo = mFirstVisibleLine; lineNo <= mLastVisibleLine && lineNo < mLines.size(); lineNo++)
 		{
 			ImVec2 lineStartScreenPos = ImVec2(cursorScreenPos.x, cursorScreenPos.y + lineNo * mCharAdvance.y);
 			ImVec2 textScreenPos = ImVec2(lineStartScreenPos.x + mTextStart, lineStartScreenPos.y);
 
-			auto& line = mLines[lineNo];
 			maxColumnLimited = Max(GetLineMaxColumn(lineNo, mLastVisibleColumn), maxColumnLimited);
 
 			Coordinates lineStartCoord(lineNo, 0);
@@ -2546,6 +4388,7 @@ void TextEditor::Render(bool aParentIsFocused)
 				snprintf(lineNumberBuffer, 16, "%d  ", lineNo + 1);
 				float lineNoWidth = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, lineNumberBuffer, nullptr, nullptr).x;
 				drawList->AddText(ImVec2(lineStartScreenPos.x + mTextStart - lineNoWidth, lineStartScreenPos.y), mPalette[(int)PaletteIndex::LineNumber], lineNumberBuffer);
+				mFrameStats.mTextDrawCalls++;
 			}
 
 			std::vector<Coordinates> cursorCoordsInThisLine;
@@ -2580,75 +4423,10 @@ void TextEditor::Render(bool aParentIsFocused)
 				}
 			}
 
-			// Render colorized text
-			static std::string glyphBuffer;
-			int charIndex = GetFirstVisibleCharacterIndex(lineNo);
-			int column = mFirstVisibleColumn; // can be in the middle of tab character
-			while (charIndex < mLines[lineNo].size() && column <= mLastVisibleColumn)
-			{
-				auto& glyph = line[charIndex];
-				auto color = GetGlyphColor(glyph);
-				ImVec2 targetGlyphPos = { lineStartScreenPos.x + mTextStart + TextDistanceToLineStart({lineNo, column}, false), lineStartScreenPos.y };
-
-				if (glyph.mChar == '\t')
-				{
-					if (mShowWhitespaces)
-					{
-						ImVec2 p1, p2, p3, p4;
-
-						const auto s = ImGui::GetFontSize();
-						const auto x1 = targetGlyphPos.x + mCharAdvance.x * 0.3f;
-						const auto y = targetGlyphPos.y + fontHeight * 0.5f;
-
-						if (mShortTabs)
-						{
-							const auto x2 = targetGlyphPos.x + mCharAdvance.x;
-							p1 = ImVec2(x1, y);
-							p2 = ImVec2(x2, y);
-							p3 = ImVec2(x2 - s * 0.16f, y - s * 0.16f);
-							p4 = ImVec2(x2 - s * 0.16f, y + s * 0.16f);
-						}
-						else
-						{
-							const auto x2 = targetGlyphPos.x + TabSizeAtColumn(column) * mCharAdvance.x - mCharAdvance.x * 0.3f;
-							p1 = ImVec2(x1, y);
-							p2 = ImVec2(x2, y);
-							p3 = ImVec2(x2 - s * 0.2f, y - s * 0.2f);
-							p4 = ImVec2(x2 - s * 0.2f, y + s * 0.2f);
-						}
-
-						drawList->AddLine(p1, p2, mPalette[(int)PaletteIndex::ControlCharacter]);
-						drawList->AddLine(p2, p3, mPalette[(int)PaletteIndex::ControlCharacter]);
-						drawList->AddLine(p2, p4, mPalette[(int)PaletteIndex::ControlCharacter]);
-					}
-				}
-				else if (glyph.mChar == ' ')
-				{
-					if (mShowWhitespaces)
-					{
-						const auto s = ImGui::GetFontSize();
-						const auto x = targetGlyphPos.x + spaceSize * 0.5f;
-						const auto y = targetGlyphPos.y + s * 0.5f;
-						drawList->AddCircleFilled(ImVec2(x, y), 1.5f, mPalette[(int)PaletteIndex::ControlCharacter], 4);
-					}
-				}
-				else
-				{
-					int seqLength = UTF8CharLength(glyph.mChar);
-					if (mCursorOnBracket && seqLength == 1 && mMatchingBracketCoords == Coordinates{ lineNo, column })
-					{
-						ImVec2 topLeft = { targetGlyphPos.x, targetGlyphPos.y + fontHeight + 1.0f };
-						ImVec2 bottomRight = { topLeft.x + mCharAdvance.x, topLeft.y + 1.0f };
-						drawList->AddRectFilled(topLeft, bottomRight, mPalette[(int)PaletteIndex::Cursor]);
-					}
-					glyphBuffer.clear();
-					for (int i = 0; i < seqLength; i++)
-						glyphBuffer.push_back(line[charIndex + i].mChar);
-					drawList->AddText(targetGlyphPos, color, glyphBuffer.c_str());
-				}
-
-				MoveCharIndexAndColumn(lineNo, charIndex, column);
-			}
+			if (mRetainedRendering)
+				RenderLineTextRetained(drawList, lineNo, textScreenPos, fontHeight, spaceSize);
+			else
+				RenderLineText(drawList, lineNo, textScreenPos, fontHeight, spaceSize);
 		}
 	}
 	mCurrentSpaceHeight = (mLines.size() + Min(mVisibleLineCount - 1, (int)mLines.size())) * mCharAdvance.y;
@@ -2733,24 +4511,23 @@ void TextEditor::OnCursorPositionChanged()
 
 void TextEditor::OnLineChanged(bool aBeforeChange, int aLine, int aColumn, int aCharCount, bool aDeleted) // adjusts cursor position when other cursor writes/deletes in the same line
 {
-	static std::unordered_map<int, int> cursorCharIndices;
 	if (aBeforeChange)
 	{
-		cursorCharIndices.clear();
+		mLineChangedCursors.clear();
 		for (int c = 0; c <= mState.mCurrentCursor; c++)
 		{
 			if (mState.mCursors[c].mInteractiveEnd.mLine == aLine && // cursor is at the line
 				mState.mCursors[c].mInteractiveEnd.mColumn > aColumn && // cursor is to the right of changing part
 				mState.mCursors[c].GetSelectionEnd() == mState.mCursors[c].GetSelectionStart()) // cursor does not have a selection
 			{
-				cursorCharIndices[c] = GetCharacterIndexR({ aLine, mState.mCursors[c].mInteractiveEnd.mColumn });
-				cursorCharIndices[c] += aDeleted ? -aCharCount : aCharCount;
+				int charIndex = GetCharacterIndexR({ aLine, mState.mCursors[c].mInteractiveEnd.mColumn });
+				mLineChangedCursors.push_back({ c, charIndex + (aDeleted ? -aCharCount : aCharCount) });
 			}
 		}
 	}
 	else
 	{
-		for (auto& item : cursorCharIndices)
+		for (auto& item : mLineChangedCursors)
 			SetCursorPosition({ aLine, GetCharacterColumn(aLine, item.second) }, item.first);
 	}
 }
@@ -2758,55 +4535,345 @@ void TextEditor::OnLineChanged(bool aBeforeChange, int aLine, int aColumn, int a
 void TextEditor::MergeCursorsIfPossible()
 {
 	// requires the cursors to be sorted from top to bottom
-	std::unordered_set<int> cursorsToDelete;
-	if (AnyCursorHasSelection())
-	{
-		// merge cursors if they overlap
-		for (int c = mState.mCurrentCursor; c > 0; c--)// iterate backwards through pairs
+	// one pass, each cursor against the last one kept, and a single erase of the tail
+	bool anyHasSelection = AnyCursorHasSelection();
+	int kept = 0;
+	for (int c = 1; c <= mState.mCurrentCursor; c++)
+	{
+		Cursor& pc = mState.mCursors[kept]; // pc for previous cursor
+		const Cursor& cursor = mState.mCursors[c];
+		if (anyHasSelection)
 		{
-			int pc = c - 1; // pc for previous cursor
-
-			bool pcContainsC = mState.mCursors[pc].GetSelectionEnd() >= mState.mCursors[c].GetSelectionEnd();
-			bool pcContainsStartOfC = mState.mCursors[pc].GetSelectionEnd() > mState.mCursors[c].GetSelectionStart();
+			// merge cursors if they overlap
+			bool pcContainsC = pc.GetSelectionEnd() >= cursor.GetSelectionEnd();
+			bool pcContainsStartOfC = pc.GetSelectionEnd() > cursor.GetSelectionStart();
 
 			if (pcContainsC)
+				continue;
+			if (pcContainsStartOfC)
 			{
-				cursorsToDelete.insert(c);
-			}
-			else if (pcContainsStartOfC)
-			{
-				Coordinates pcStart = mState.mCursors[pc].GetSelectionStart();
-				Coordinates cEnd = mState.mCursors[c].GetSelectionEnd();
-				mState.mCursors[pc].mInteractiveEnd = cEnd;
-				mState.mCursors[pc].mInteractiveStart = pcStart;
-				cursorsToDelete.insert(c);
+				Coordinates pcStart = pc.GetSelectionStart();
+				pc.mInteractiveEnd = cursor.GetSelectionEnd();
+				pc.mInteractiveStart = pcStart;
+				continue;
 			}
 		}
+		else if (pc.mInteractiveEnd == cursor.mInteractiveEnd) // merge cursors if they are at the same position
+			continue;
+		if (++kept != c)
+			mState.mCursors[kept] = cursor;
 	}
-	else
-	{
-		// merge cursors if they are at the same position
-		for (int c = mState.mCurrentCursor; c > 0; c--)// iterate backwards through pairs
+	mState.mCursors.erase(mState.mCursors.begin() + (kept + 1), mState.mCursors.begin() + (mState.mCurrentCursor + 1));
+	mState.mCurrentCursor = kept;
+}
+
+int TextEditor::AdvanceColumn(int aColumn, const char* aBegin, const char* aEnd) const
+{
+	for (const char* p = aBegin; p < aEnd; p += UTF8CharLength(*p))
+		aColumn = *p == '\t' ? (aColumn / mTabSize) * mTabSize + mTabSize : aColumn + 1;
+	return aColumn;
+}
+
+void TextEditor::InsertAtCursors(const char* aText, UndoRecord& aUndo)
+{
+	// aText has no line break and no cursor has a selection. Cursors on a line are consecutive, the
+	// line is rebuilt once with the text at each of them, and the operations are recorded right to
+	// left as typing at each cursor from the last one would have.
+	const char* textEnd = aText + std::strlen(aText);
+	int length = (int)(textEnd - aText);
+	std::vector<int> indices;
+	for (int last = mState.mCurrentCursor; last > -1; last--)
+	{
+		int lineIndex = GetSanitizedCursorCoordinates(last).mLine;
+		int first = last;
+		while (first > 0 && GetSanitizedCursorCoordinates(first - 1).mLine == lineIndex)
+			first--;
+
+		indices.clear();
+		for (int c = first; c <= last; c++)
+			indices.push_back(GetCharacterIndexR(GetSanitizedCursorCoordinates(c)));
+		for (int c = last; c >= first; c--)
+		{
+			auto start = GetSanitizedCursorCoordinates(c);
+			int column = AdvanceColumn(GetCharacterColumn(lineIndex, indices[c - first]), aText, textEnd);
+			aUndo.mOperations.push_back({ aText, start, Coordinates(lineIndex, column), UndoOperationType::Add });
+		}
+
+		auto& line = mLines[lineIndex];
+		Line rebuilt;
+		rebuilt.Reserve(line.size() + indices.size() * length);
+		int copied = 0;
+		for (int index : indices)
+		{
+			rebuilt.Insert(rebuilt.size(), line, copied, index);
+			rebuilt.Append(aText, textEnd);
+			copied = index;
+		}
+		rebuilt.Insert(rebuilt.size(), line, copied, line.size());
+		line.mText.swap(rebuilt.mText);
+		line.mGlyphs.swap(rebuilt.mGlyphs);
+		line.mColumnsTabSize = 0;
+		line.mRevision = ++mDocumentVersion;
+		InvalidateFindLines(lineIndex, lineIndex);
+
+		for (int c = first; c <= last; c++)
+			SetCursorPosition(Coordinates(lineIndex, GetCharacterColumn(lineIndex, indices[c - first] + (c - first + 1) * length)), c);
+		Colorize(lineIndex - 1, 3);
+		last = first;
+	}
+}
+
+void TextEditor::SplitLinesAtCursors(UndoRecord& aUndo)
+{
+	// No cursor has a selection. Every cursor ends up one line below its own line plus one for each
+	// cursor before it, so cursors are placed once instead of moved down by every inserted line.
+	std::vector<int> indices;
+	for (int last = mState.mCurrentCursor; last > -1; last--)
+	{
+		int lineIndex = GetSanitizedCursorCoordinates(last).mLine;
+		int first = last;
+		while (first > 0 && GetSanitizedCursorCoordinates(first - 1).mLine == lineIndex)
+			first--;
+
+		indices.clear();
+		for (int c = first; c <= last; c++)
+			indices.push_back(GetCharacterIndexR(GetSanitizedCursorCoordinates(c)));
+		indices.push_back((int)mLines[lineIndex].size());
+
+		int blank = 0;
+		if (mAutoIndent)
+		{
+			const auto& line = mLines[lineIndex];
+			while (blank < (int)line.size() && isascii(line[blank]) && isblank(line[blank]))
+				blank++;
+		}
+
+		// right to left, the line seen by each split ends at the cursor after it
+		for (int c = last; c >= first; c--)
 		{
-			int pc = c - 1;
-			if (mState.mCursors[pc].mInteractiveEnd == mState.mCursors[c].mInteractiveEnd)
-				cursorsToDelete.insert(c);
+			int k = c - first;
+			int indent = std::min(blank, indices[k + 1]);
+			auto start = GetSanitizedCursorCoordinates(c);
+			Line& newLine = InsertLine(lineIndex + 1, false);
+			const Line& line = mLines[lineIndex];
+			newLine.Reserve(indent + indices[k + 1] - indices[k]);
+			newLine.Insert(0, line, 0, indent);
+			newLine.Insert(indent, line, indices[k], indices[k + 1]);
+
+			std::string text = "\n";
+			text.append(line.mText, 0, indent);
+			int column = AdvanceColumn(0, line.mText.data(), line.mText.data() + indent);
+			aUndo.mOperations.push_back({ text, start, Coordinates(lineIndex + 1, column), UndoOperationType::Add });
+			mState.mCursors[c].mInteractiveStart = mState.mCursors[c].mInteractiveEnd = Coordinates(lineIndex + 1 + c, column);
 		}
+
+		auto& line = mLines[lineIndex];
+		line.Erase(indices[0], line.size());
+		line.mRevision = ++mDocumentVersion;
+		InvalidateFindLines(lineIndex, lineIndex);
+		Colorize(lineIndex - 1, last - first + 3);
+		last = first;
 	}
-	for (int c = mState.mCurrentCursor; c > -1; c--)// iterate backwards through each of them
+	mCursorPositionChanged = true;
+	EnsureCursorVisible();
+}
+
+bool TextEditor::DeleteSelectionsInLines(UndoRecord& aUndo)
+{
+	// Only for selections within a line, false without changing anything otherwise. Cursors without
+	// a selection move left by what was deleted before them on their line.
+	for (int c = 0; c <= mState.mCurrentCursor; c++)
+		if (mState.mCursors[c].GetSelectionStart().mLine != mState.mCursors[c].GetSelectionEnd().mLine)
+			return false;
+
+	MarkFindResultsDirty(true);
+	mFindHighlightsCache.clear();
+	std::vector<std::pair<int, int>> ranges;
+	for (int last = mState.mCurrentCursor; last > -1; last--)
 	{
-		if (cursorsToDelete.find(c) != cursorsToDelete.end())
-			mState.mCursors.erase(mState.mCursors.begin() + c);
+		int lineIndex = mState.mCursors[last].mInteractiveEnd.mLine;
+		int first = last;
+		while (first > 0 && mState.mCursors[first - 1].mInteractiveEnd.mLine == lineIndex)
+			first--;
+
+		ranges.clear();
+		for (int c = first; c <= last; c++)
+		{
+			const auto& cursor = mState.mCursors[c];
+			if (cursor.HasSelection())
+				ranges.push_back({ GetCharacterIndexL(cursor.GetSelectionStart()), GetCharacterIndexR(cursor.GetSelectionEnd()) });
+			else
+			{
+				int index = GetCharacterIndexR(cursor.mInteractiveEnd);
+				ranges.push_back({ index, index });
+			}
+		}
+		for (int c = last; c >= first; c--)
+		{
+			const auto& cursor = mState.mCursors[c];
+			if (cursor.HasSelection())
+				aUndo.mOperations.push_back({ GetSelectedText(c), cursor.GetSelectionStart(), cursor.GetSelectionEnd(), UndoOperationType::Delete });
+		}
+
+		auto& line = mLines[lineIndex];
+		Line rebuilt;
+		rebuilt.Reserve(line.size());
+		int copied = 0;
+		for (auto& range : ranges)
+		{
+			if (range.first > copied)
+				rebuilt.Insert(rebuilt.size(), line, copied, range.first);
+			copied = std::max(copied, range.second);
+			range.first = (int)rebuilt.size(); // where the cursor ends up
+		}
+		rebuilt.Insert(rebuilt.size(), line, copied, line.size());
+		line.mText.swap(rebuilt.mText);
+		line.mGlyphs.swap(rebuilt.mGlyphs);
+		line.mColumnsTabSize = 0;
+		line.mRevision = ++mDocumentVersion;
+		InvalidateFindLines(lineIndex, lineIndex);
+
+		for (int c = first; c <= last; c++)
+			SetCursorPosition(Coordinates(lineIndex, GetCharacterColumn(lineIndex, ranges[c - first].first)), c);
+		Colorize(lineIndex, 1);
+		last = first;
 	}
-	mState.mCurrentCursor -= cursorsToDelete.size();
+	return true;
 }
 
 void TextEditor::AddUndo(UndoRecord& aValue)
 {
 	assert(!mReadOnly);
-	mUndoBuffer.resize((size_t)(mUndoIndex + 1));
-	mUndoBuffer.back() = aValue;
+	// the edit held its own events back, its operations replay it in order
+	if (HasEditObservers())
+		for (const UndoOperation& operation : aValue.mOperations)
+		{
+			if (operation.mText.empty())
+				continue;
+			if (operation.mType == UndoOperationType::Delete)
+				EmitEditEvent(operation.mStart, operation.mEnd, std::string_view());
+			else
+				EmitEditEvent(operation.mStart, operation.mStart, operation.mText);
+		}
+
+	while ((int)mUndoBuffer.size() > mUndoIndex)
+	{
+		mUndoMemoryUsage -= mUndoBuffer.back().mMemorySize;
+		mUndoBuffer.pop_back();
+	}
+
+	if (mUndoIndex > 0)
+	{
+		UndoRecord& last = mUndoBuffer.back();
+		if (last.TryMerge(aValue))
+		{
+			mUndoMemoryUsage -= last.mMemorySize;
+			last.mMemorySize = last.GetMemorySize();
+			mUndoMemoryUsage += last.mMemorySize;
+			TrimUndoBuffer();
+			return;
+		}
+	}
+
+	// unused cursor slots are not needed to restore the state
+	mUndoBuffer.push_back(aValue);
+	UndoRecord& added = mUndoBuffer.back();
+	added.mBefore.mCursors.resize(added.mBefore.mCurrentCursor + 1);
+	added.mBefore.mCursors.shrink_to_fit();
+	added.mMergeable = added.IsSingleCharacterEdit();
+	added.mMemorySize = added.GetMemorySize();
+	mUndoMemoryUsage += added.mMemorySize;
 	++mUndoIndex;
+	TrimUndoBuffer();
+}
+
+void TextEditor::TrimUndoBuffer()
+{
+	// oldest first, the last step taken stays undoable whatever its size
+	while (mUndoMemoryBudget > 0 && mUndoMemoryUsage > mUndoMemoryBudget && mUndoIndex > 1)
+	{
+		mUndoMemoryUsage -= mUndoBuffer.front().mMemorySize;
+		mUndoBuffer.pop_front();
+		--mUndoIndex;
+	}
+}
+
+void TextEditor::ClearUndoBuffer()
+{
+	mUndoBuffer.clear();
+	mUndoIndex = 0;
+	mUndoMemoryUsage = 0;
+}
+
+int TextEditor::AddEditListener(EditListener aListener)
+{
+	int id = mDocument->mNextEditListenerId++;
+	mEditListeners.push_back({ id, std::move(aListener) });
+	return id;
+}
+
+void TextEditor::RemoveEditListener(int aId)
+{
+	mEditListeners.erase(std::remove_if(mEditListeners.begin(), mEditListeners.end(),
+		[aId](const std::pair<int, EditListener>& aListener) { return aListener.first == aId; }), mEditListeners.end());
+}
+
+void TextEditor::EmitEditEvent(const Coordinates& aStart, const Coordinates& aEnd, std::string_view aText)
+{
+	// '\r' never reaches the document, so listeners do not see it either
+	std::string stripped;
+	if (aText.find('\r') != std::string_view::npos)
+	{
+		std::remove_copy(aText.begin(), aText.end(), std::back_inserter(stripped), '\r');
+		aText = stripped;
+	}
+	EditEvent event{ aStart, aEnd, aText, mDocumentVersion };
+	for (const auto& listener : mEditListeners)
+		listener.second(event);
+	for (TextEditor* view : mViews)
+		if (view != this)
+			view->FollowEdit(event);
+}
+
+void TextEditor::FollowEdit(const EditEvent& aEvent)
+{
+	// Positions after the change move with the text after it, those inside the removed part go to its
+	// start. On the line the change ends on, columns past it keep their distance to the end of the
+	// change, which is off where tabs realign; SyncWithDocument clamps what is left over.
+	int insertedLines = 0;
+	int column = aEvent.mStart.mColumn;
+	for (char c : aEvent.mText)
+	{
+		if (c == '\n')
+		{
+			insertedLines++;
+			column = 0;
+		}
+		else if (c == '\t')
+			column += TabSizeAtColumn(column);
+		else if ((c & 0xC0) != 0x80) // lead bytes only
+			column++;
+	}
+	Coordinates insertedEnd(aEvent.mStart.mLine + insertedLines, column);
+	auto follow = [&](Coordinates& aPosition)
+	{
+		if (aPosition < aEvent.mStart)
+			return;
+		if (aPosition < aEvent.mEnd)
+			aPosition = aEvent.mStart;
+		else if (aPosition.mLine == aEvent.mEnd.mLine)
+			aPosition = Coordinates(insertedEnd.mLine, insertedEnd.mColumn + aPosition.mColumn - aEvent.mEnd.mColumn);
+		else
+			aPosition.mLine += insertedEnd.mLine - aEvent.mEnd.mLine;
+	};
+	for (int c = 0; c <= mState.mCurrentCursor; c++)
+	{
+		follow(mState.mCursors[c].mInteractiveStart);
+		follow(mState.mCursors[c].mInteractiveEnd);
+	}
+	follow(mFindSelectionRangeStart);
+	follow(mFindSelectionRangeEnd);
+	mCursorPositionChanged = true;
 }
 
 bool TextEditor::HasValidFindPattern() const
@@ -2814,12 +4881,38 @@ bool TextEditor::HasValidFindPattern() const
 	return mFindBuffer[0] != '\0';
 }
 
-const std::vector<TextEditor::LineHighlight>* TextEditor::GetFindHighlightsForLine(int aLineNumber) const
+const std::vector<TextEditor::LineHighlight>* TextEditor::GetFindHighlightsForLine(int aLineNumber)
 {
-	if (!HasValidFindPattern())
+	// nothing is shown between an edit and the next refresh, the stored results may be off by then
+	if (!HasValidFindPattern() || mFindResultsDirty || mFindResults.empty() || aLineNumber < 0 || aLineNumber >= (int)mLines.size())
 		return nullptr;
 	auto it = mFindHighlightsCache.find(aLineNumber);
-	return it != mFindHighlightsCache.end() ? &it->second : nullptr;
+	if (it == mFindHighlightsCache.end())
+	{
+		// built on demand for the lines being drawn, from the results starting on this line or on the
+		// few lines above whose results reach down to it; results are sorted, so those are found by
+		// a binary search
+		auto& segments = mFindHighlightsCache[aLineNumber];
+		int firstLine = std::max(0, aLineNumber - mFindMaxLineSpan);
+		auto result = std::partition_point(mFindResults.begin(), mFindResults.end(),
+			[firstLine](const SearchResult& aResult) { return aResult.mStart.mLine < firstLine; });
+		for (; result != mFindResults.end() && result->mStart.mLine <= aLineNumber; ++result)
+		{
+			if (result->mEnd.mLine < aLineNumber)
+				continue;
+			int index = (int)(result - mFindResults.begin());
+			if (result->mStart.mLine == result->mEnd.mLine)
+				segments.push_back({ result->mStart.mColumn, result->mEnd.mColumn, false, index });
+			else if (aLineNumber == result->mStart.mLine)
+				segments.push_back({ result->mStart.mColumn, GetLineMaxColumn(aLineNumber), true, index });
+			else if (aLineNumber < result->mEnd.mLine)
+				segments.push_back({ 0, GetLineMaxColumn(aLineNumber), true, index });
+			else
+				segments.push_back({ 0, result->mEnd.mColumn, false, index });
+		}
+		it = mFindHighlightsCache.find(aLineNumber);
+	}
+	return it->second.empty() ? nullptr : &it->second;
 }
 
 TextEditor::Coordinates TextEditor::AdvanceCoordinates(const Coordinates& aCoords) const
@@ -2855,11 +4948,11 @@ bool TextEditor::IsWholeWordMatch(const Coordinates& aStart, const Coordinates&
 	if (startCharIndex > 0)
 	{
 		int prevIndex = startCharIndex - 1;
-		while (prevIndex > 0 && IsUTFSequence(mLines[startLine][prevIndex].mChar))
+		while (prevIndex > 0 && IsUTFSequence(mLines[startLine][prevIndex]))
 			--prevIndex;
 		if (prevIndex >= 0 && prevIndex < (int)mLines[startLine].size())
 		{
-			char prevChar = mLines[startLine][prevIndex].mChar;
+			char prevChar = mLines[startLine][prevIndex];
 			boundaryBefore = !CharIsWordChar(prevChar);
 		}
 	}
@@ -2871,7 +4964,7 @@ bool TextEditor::IsWholeWordMatch(const Coordinates& aStart, const Coordinates&
 	bool boundaryAfter = true;
 	if (endCharIndex < (int)mLines[endLine].size())
 	{
-		char nextChar = mLines[endLine][endCharIndex].mChar;
+		char nextChar = mLines[endLine][endCharIndex];
 		boundaryAfter = !CharIsWordChar(nextChar);
 	}
 
@@ -2882,6 +4975,7 @@ void TextEditor::EnsureFindResultsUpToDate()
 {
 	if (!HasValidFindPattern())
 	{
+		CancelRegexFind();
 		if (!mFindResults.empty())
 		{
 			mFindResults.clear();
@@ -2892,22 +4986,149 @@ void TextEditor::EnsureFindResultsUpToDate()
 		return;
 	}
 
-	int undoSize = (int)mUndoBuffer.size();
-	if (mFindResultsDirty || mFindLastUndoIndex != mUndoIndex || mFindLastUndoBufferSize != undoSize)
+	if (mFindResultsDirty || mFindLastDocumentVersion != mDocumentVersion)
 		RefreshFindResults();
+	else if (mRegexFindJob != nullptr)
+		ApplyRegexFindResults();
+}
+
+TextEditor::FindIndex& TextEditor::ClaimFindIndex()
+{
+	auto& indexes = mDocument->mFindIndexes;
+	auto it = std::find_if(indexes.begin(), indexes.end(), [](const FindIndex& aIndex) { return !aIndex.mInUse; });
+	if (it == indexes.end())
+	{
+		assert(indexes.size() <= UINT16_MAX);
+		indexes.emplace_back();
+		it = indexes.end() - 1;
+	}
+	uint16_t slot = (uint16_t)(it - indexes.begin());
+	*it = FindIndex();
+	it->mSlot = slot;
+	it->mInUse = true;
+	return *it;
+}
+
+void TextEditor::InvalidateFindLines(int aFromLine, int aToLine)
+{
+	aFromLine = std::max(0, aFromLine);
+	aToLine = std::max(aFromLine, aToLine);
+	for (auto& index : mDocument->mFindIndexes)
+	{
+		if (!index.mLinesDirty)
+		{
+			index.mDirtyFromLine = aFromLine;
+			index.mDirtyToLine = aToLine;
+			index.mLinesDirty = true;
+		}
+		else
+		{
+			index.mDirtyFromLine = std::min(index.mDirtyFromLine, aFromLine);
+			index.mDirtyToLine = std::max(index.mDirtyToLine, aToLine);
+		}
+	}
+}
+
+void TextEditor::ShiftFindLines(int aIndex, int aLineCountDelta)
+{
+	auto shift = [aIndex, aLineCountDelta](int& line) {
+		if (aLineCountDelta > 0 && line >= aIndex)
+			line += aLineCountDelta;
+		else if (aLineCountDelta < 0 && line >= aIndex)
+			line = std::max(aIndex, line + aLineCountDelta);
+	};
+	for (auto& index : mDocument->mFindIndexes)
+	{
+		if (!index.mLinesDirty)
+			continue;
+		shift(index.mDirtyFromLine);
+		shift(index.mDirtyToLine);
+	}
+}
+
+void TextEditor::InvalidateFindIndexes()
+{
+	for (auto& index : mDocument->mFindIndexes)
+		index.mValid = false;
+}
+
+bool TextEditor::UpdateFindIndex(const std::string& aPattern, bool aCaseSensitive, int& outFromLine, int& outToLine)
+{
+	// true when only outFromLine..outToLine were scanned again, none when that range is empty
+	int& fromLine = outFromLine;
+	int& toLine = outToLine;
+	fromLine = 0;
+	toLine = (int)mLines.size() - 1;
+	bool incremental = false;
+
+	// A match that starts on line L covers L..L+k for a pattern with k line breaks, so an edit on a line
+	// can change the matches of the k lines above it. Lines further away keep their match lists.
+	if (mFindIndexValid && mFindIndexPattern == aPattern && mFindIndexCaseSensitive == aCaseSensitive)
+	{
+		if (!mFindLinesDirty)
+		{
+			fromLine = toLine + 1;
+			return true;
+		}
+		int span = (int)std::count(aPattern.begin(), aPattern.end(), '\n');
+		fromLine = std::max(0, mFindDirtyFromLine - span);
+		toLine = std::min(toLine, mFindDirtyToLine);
+		incremental = true;
+	}
+	mFindIndexValid = true;
+	mFindIndexPattern = aPattern;
+	mFindIndexCaseSensitive = aCaseSensitive;
+	mFindLinesDirty = false;
+	mFindIndexUpdates++;
+
+	// every start position, overlapping ones included; RefreshFindResults picks the set the search
+	// would have found from wherever it starts
+	FindOccurrence occurrence;
+	occurrence.mFindIndex = mFindIndex.mSlot;
+	auto ofThisView = [this](const FindOccurrence& aOccurrence) { return aOccurrence.mFindIndex == mFindIndex.mSlot; };
+	for (int lineIndex = fromLine; lineIndex <= toLine; lineIndex++)
+	{
+		auto& line = mLines[lineIndex];
+		line.mFindOccurrences.erase(std::remove_if(line.mFindOccurrences.begin(), line.mFindOccurrences.end(), ofThisView), line.mFindOccurrences.end());
+		int endLine, endIndex;
+		for (int start = 0; (start = FindLiteralInLine(lineIndex, start, aPattern, aCaseSensitive, endLine, endIndex)) >= 0; start++)
+		{
+			const auto& last = mLines[endLine];
+			occurrence.mStart = start;
+			occurrence.mEnd = endIndex;
+			occurrence.mEndLine = endLine - lineIndex;
+			occurrence.mWordBoundaryBefore = start == 0 || !CharIsWordChar(line[start - 1]);
+			occurrence.mWordBoundaryAfter = endIndex >= last.size() || !CharIsWordChar(last[endIndex]);
+			line.mFindOccurrences.push_back(occurrence);
+		}
+	}
+	return incremental;
 }
 
 void TextEditor::RefreshFindResults(bool aPreserveSelection)
 {
+	ScopedTimer timer(mFrameStats.mFindMs);
+	CancelRegexFind();
 	mFindResultsDirty = false;
 	mFindRefreshPending = false;
 	mFindRefreshTimer = 0.0f;
-	mFindLastUndoIndex = mUndoIndex;
-	mFindLastUndoBufferSize = (int)mUndoBuffer.size();
-	mFindResults.clear();
-	mFindHighlightsCache.clear();
+	mFindLastDocumentVersion = mDocumentVersion;
 	mFindResultIndex = -1;
 
+	// after edits alone the results they did not touch are kept, see SpliceFindResults
+	const FindResultsBasis& basis = mFindResultsBasis;
+	bool splice = basis.mValid && basis.mWholeWord == mFindWholeWord && basis.mTabSize == mTabSize &&
+		basis.mFindIndexUpdates == mFindIndexUpdates && !mFindUseRegex && !mFindSelectionOnly && HasValidFindPattern();
+	mFindResultsBasis.mValid = false;
+	auto startOver = [this]()
+	{
+		mFindResults.clear();
+		mFindHighlightsCache.clear();
+		mFindMaxLineSpan = 0;
+	};
+	if (!splice)
+		startOver();
+
 	if (!HasValidFindPattern() || mLines.empty())
 		return;
 
@@ -2919,68 +5140,6 @@ void TextEditor::RefreshFindResults(bool aPreserveSelection)
 	bool wholeWord = mFindWholeWord && !mFindUseRegex;
 	bool useRegex = mFindUseRegex;
 
-	std::vector<std::string> lineStrings;
-	std::vector<size_t> lineOffsets;
-	lineStrings.reserve(mLines.size());
-	lineOffsets.reserve(mLines.size());
-
-	size_t totalLength = 0;
-	for (size_t i = 0; i < mLines.size(); ++i)
-	{
-		lineOffsets.push_back(totalLength);
-		const auto& line = mLines[i];
-		std::string lineText;
-		lineText.reserve(line.size());
-		for (const auto& glyph : line)
-			lineText.push_back(glyph.mChar);
-		totalLength += lineText.size();
-		if (i + 1 < mLines.size())
-			totalLength += 1;
-		lineStrings.emplace_back(std::move(lineText));
-	}
-
-	std::string joined;
-	joined.reserve(totalLength);
-	for (size_t i = 0; i < lineStrings.size(); ++i)
-	{
-		joined.append(lineStrings[i]);
-		if (i + 1 < lineStrings.size())
-			joined.push_back('\n');
-	}
-
-	auto coordinateToOffset = [&](const Coordinates& coords) -> size_t
-	{
-		Coordinates sanitized = SanitizeCoordinates(coords);
-		int line = std::clamp(sanitized.mLine, 0, (int)mLines.size() - 1);
-		sanitized.mLine = line;
-		int charIndex = GetCharacterIndexR(sanitized);
-		charIndex = std::clamp(charIndex, 0, (int)mLines[line].size());
-		size_t base = lineOffsets[line];
-		return base + static_cast<size_t>(charIndex);
-	};
-
-	auto offsetToCoordinates = [&](size_t offset) -> Coordinates
-	{
-		if (lineOffsets.empty())
-			return Coordinates(0, 0);
-		if (offset > joined.size())
-			offset = joined.size();
-
-		auto it = std::upper_bound(lineOffsets.begin(), lineOffsets.end(), offset);
-		int line = (int)std::distance(lineOffsets.begin(), it) - 1;
-		if (line < 0)
-			line = 0;
-		if (line >= (int)lineOffsets.size())
-			line = (int)lineOffsets.size() - 1;
-
-		size_t lineOffset = lineOffsets[line];
-		size_t charIndex = offset - lineOffset;
-		if (charIndex > lineStrings[line].size())
-			charIndex = lineStrings[line].size();
-		int column = GetCharacterColumn(line, (int)charIndex);
-		return Coordinates(line, column);
-	};
-
 	Coordinates selectionStartCoords;
 	Coordinates selectionEndCoords;
 	bool selectionRangeValid = false;
@@ -3014,11 +5173,20 @@ void TextEditor::RefreshFindResults(bool aPreserveSelection)
 		selectionEndCoords = SanitizeCoordinates(selectionEndCoords);
 	}
 
-	size_t rangeStartOffset = coordinateToOffset(selectionStartCoords);
-	size_t rangeEndOffset = coordinateToOffset(selectionEndCoords);
-	rangeEndOffset = std::min(rangeEndOffset, joined.size());
-	if (rangeStartOffset > rangeEndOffset)
-		std::swap(rangeStartOffset, rangeEndOffset);
+	// positions as (line, character index), which orders the same way as offsets into the joined text
+	auto toPosition = [&](const Coordinates& aCoords) -> std::pair<int, int>
+	{
+		Coordinates sanitized = SanitizeCoordinates(aCoords);
+		int line = std::clamp(sanitized.mLine, 0, (int)mLines.size() - 1);
+		sanitized.mLine = line;
+		int charIndex = std::clamp(GetCharacterIndexR(sanitized), 0, (int)mLines[line].size());
+		return { line, charIndex };
+	};
+
+	std::pair<int, int> rangeStart = toPosition(selectionStartCoords);
+	std::pair<int, int> rangeEnd = toPosition(selectionEndCoords);
+	if (rangeEnd < rangeStart)
+		std::swap(rangeStart, rangeEnd);
 
 	Coordinates preservedSelectionStart;
 	Coordinates preservedSelectionEnd;
@@ -3031,144 +5199,119 @@ void TextEditor::RefreshFindResults(bool aPreserveSelection)
 		preservedSelectionValid = true;
 	}
 
-	auto addResult = [&](size_t startOffset, size_t endOffset)
-	{
-		if (startOffset >= endOffset)
-			return;
-		Coordinates startCoord = offsetToCoordinates(startOffset);
-		Coordinates endCoord = offsetToCoordinates(endOffset);
-		SearchResult result{ startCoord, endCoord };
-		mFindResults.push_back(result);
-		int resultIndex = (int)mFindResults.size() - 1;
-		int startLine = result.mStart.mLine;
-		int endLine = result.mEnd.mLine;
-		if (startLine == endLine)
-		{
-			mFindHighlightsCache[startLine].push_back({ result.mStart.mColumn, result.mEnd.mColumn, false, resultIndex });
-		}
-		else
-		{
-			mFindHighlightsCache[startLine].push_back({ result.mStart.mColumn, GetLineMaxColumn(startLine), true, resultIndex });
-			for (int line = startLine + 1; line < endLine; ++line)
-			{
-				mFindHighlightsCache[line].push_back({ 0, GetLineMaxColumn(line), true, resultIndex });
-			}
-			mFindHighlightsCache[endLine].push_back({ 0, result.mEnd.mColumn, false, resultIndex });
-		}
-	};
-
 	if (useRegex)
 	{
+		// the regex runs over the whole range at once since a match may span any number of lines
+		auto job = std::make_shared<RegexFindJob>();
 		try
 		{
-			std::regex_constants::syntax_option_type options = std::regex_constants::ECMAScript | std::regex_constants::optimize;
-			if (!caseSensitive)
-				options |= std::regex_constants::icase;
-			std::regex re(pattern, options);
-
-			auto beginIt = joined.begin() + (std::ptrdiff_t)rangeStartOffset;
-			auto endIt = joined.begin() + (std::ptrdiff_t)rangeEndOffset;
-
-			for (auto it = std::sregex_iterator(beginIt, endIt, re); it != std::sregex_iterator(); ++it)
-			{
-				size_t relativeStart = static_cast<size_t>(it->position());
-				size_t matchLength = static_cast<size_t>(it->length());
-				if (matchLength == 0)
-					continue;
-
-				size_t matchStart = rangeStartOffset + relativeStart;
-				size_t matchEnd = matchStart + matchLength;
-				if (wholeWord)
-				{
-					bool boundaryBefore = (matchStart == rangeStartOffset) || (matchStart == 0) || !CharIsWordChar(joined[matchStart - 1]);
-					bool boundaryAfter = (matchEnd >= rangeEndOffset) || (matchEnd >= joined.size()) || !CharIsWordChar(joined[matchEnd]);
-					if (!boundaryBefore || !boundaryAfter)
-						continue;
-				}
-				addResult(matchStart, matchEnd);
-			}
+			job->mRegex.assign(pattern, caseSensitive ? boost::regex::ECMAScript : boost::regex::ECMAScript | boost::regex::icase);
 		}
-		catch (const std::regex_error&)
+		catch (const boost::regex_error&)
 		{
 			mFindStatusMessage = "Invalid regex";
 			mFindStatusTimer = 3.0f;
 			return;
 		}
-	}
-	else
-	{
-		const std::string* haystackPtr = &joined;
-		std::string loweredHaystack;
-		std::string loweredPattern;
-		const std::string* patternPtr = &pattern;
-		if (!caseSensitive)
+
+		job->mFirstLine = rangeStart.first;
+		job->mFirstIndex = rangeStart.second;
+		job->mLineOffsets.reserve(rangeEnd.first - rangeStart.first + 1);
+		for (int i = rangeStart.first; i <= rangeEnd.first; i++)
 		{
-			loweredHaystack = joined;
-			std::transform(loweredHaystack.begin(), loweredHaystack.end(), loweredHaystack.begin(), [](unsigned char c) { return (char)std::tolower(c); });
-			loweredPattern = pattern;
-			std::transform(loweredPattern.begin(), loweredPattern.end(), loweredPattern.begin(), [](unsigned char c) { return (char)std::tolower(c); });
-			haystackPtr = &loweredHaystack;
-			patternPtr = &loweredPattern;
+			const auto& text = mLines[i].mText;
+			size_t from = i == rangeStart.first ? rangeStart.second : 0;
+			size_t to = i == rangeEnd.first ? rangeEnd.second : text.size();
+			job->mLineOffsets.push_back(job->mText.size());
+			job->mText.append(text, from, to - from);
+			if (i < rangeEnd.first)
+				job->mText.push_back('\n');
 		}
 
-		size_t patternLength = pattern.size();
-		if (patternLength == 0)
-			return;
-
-		size_t searchPos = rangeStartOffset;
-		while (searchPos < rangeEndOffset)
+		job->mDocumentVersion = mDocumentVersion;
+		job->mCursor = toPosition(GetSanitizedCursorCoordinates());
+		if (preservedSelectionValid)
 		{
-			size_t found = haystackPtr->find(*patternPtr, searchPos);
-			if (found == std::string::npos || found >= rangeEndOffset)
-				break;
-
-			size_t matchStart = found;
-			size_t matchEnd = matchStart + patternLength;
+			job->mPreservedStart = toPosition(preservedSelectionStart);
+			job->mPreservedEnd = toPosition(preservedSelectionEnd);
+			job->mPreservedValid = true;
+		}
+		mRegexFindJob = job;
+		if (mRegexFindWorker == nullptr)
+			mRegexFindWorker = std::make_shared<RegexFindWorker>();
+		mRegexFindWorker->Submit(job);
+		return;
+	}
 
-			if (matchEnd > rangeEndOffset)
-				break;
+	int fromLine, toLine;
+	if (UpdateFindIndex(pattern, caseSensitive, fromLine, toLine) && splice)
+		SpliceFindResults(fromLine, toLine, wholeWord);
+	else
+	{
+		if (splice)
+			startOver();
 
-			if (wholeWord)
+		// Replay the sequential search over the stored occurrences: it starts at the range start, resumes
+		// after each accepted match and one character after a match rejected as a partial word.
+		std::pair<int, int> searchPosition = rangeStart;
+		bool searching = true;
+		for (int lineIndex = 0; searching && lineIndex < (int)mLines.size(); lineIndex++)
+		{
+			for (const auto& occurrence : mLines[lineIndex].mFindOccurrences)
 			{
-				bool boundaryBefore = (matchStart == rangeStartOffset) || (matchStart == 0) || !CharIsWordChar(joined[matchStart - 1]);
-				bool boundaryAfter = (matchEnd >= rangeEndOffset) || (matchEnd >= joined.size()) || !CharIsWordChar(joined[matchEnd]);
-				if (!boundaryBefore || !boundaryAfter)
-				{
-					searchPos = matchStart + 1;
+				if (occurrence.mFindIndex != mFindIndex.mSlot)
 					continue;
+				std::pair<int, int> start(lineIndex, occurrence.mStart);
+				std::pair<int, int> end(lineIndex + occurrence.mEndLine, occurrence.mEnd);
+				if (start < searchPosition)
+					continue;
+				if (!(start < rangeEnd) || rangeEnd < end)
+				{
+					searching = false;
+					break;
 				}
-			}
 
-			addResult(matchStart, matchEnd);
-			if (matchEnd <= matchStart)
-			{
-				// safety net against zero-length advances
-				searchPos = matchStart + 1;
+				if (wholeWord)
+				{
+					bool boundaryBefore = start == rangeStart || occurrence.mWordBoundaryBefore;
+					bool boundaryAfter = end == rangeEnd || occurrence.mWordBoundaryAfter;
+					if (!boundaryBefore || !boundaryAfter)
+					{
+						searchPosition = { start.first, start.second + 1 };
+						continue;
+					}
+				}
+
+				AddFindResult(lineIndex, occurrence);
+				searchPosition = end;
 			}
-			else
-				searchPos = matchEnd;
 		}
 	}
+	mFindResultsBasis.mValid = !mFindSelectionOnly;
+	mFindResultsBasis.mWholeWord = mFindWholeWord;
+	mFindResultsBasis.mTabSize = mTabSize;
+	mFindResultsBasis.mLineCount = (int)mLines.size();
+	mFindResultsBasis.mFindIndexUpdates = mFindIndexUpdates;
 
 	if (mFindResults.empty())
 		return;
 
-	Coordinates cursorCoords = GetSanitizedCursorCoordinates();
-	size_t cursorOffset = coordinateToOffset(cursorCoords);
+	std::pair<int, int> cursorPosition = toPosition(GetSanitizedCursorCoordinates());
 	int chosenIndex = -1;
 
+	// results do not overlap, so they are sorted by start and by end alike and both lookups are
+	// binary searches
 	if (aPreserveSelection && preservedSelectionValid)
 	{
-		size_t preservedStart = coordinateToOffset(preservedSelectionStart);
-		size_t preservedEnd = coordinateToOffset(preservedSelectionEnd);
-		for (int i = 0; i < (int)mFindResults.size(); ++i)
+		std::pair<int, int> preservedStart = toPosition(preservedSelectionStart);
+		std::pair<int, int> preservedEnd = toPosition(preservedSelectionEnd);
+		auto it = std::partition_point(mFindResults.begin(), mFindResults.end(),
+			[&](const SearchResult& res) { return toPosition(res.mStart) < preservedStart; });
+		for (; it != mFindResults.end() && toPosition(it->mStart) == preservedStart; ++it)
 		{
-			const auto& res = mFindResults[i];
-			size_t resStart = coordinateToOffset(res.mStart);
-			size_t resEnd = coordinateToOffset(res.mEnd);
-			if (resStart == preservedStart && resEnd == preservedEnd)
+			if (toPosition(it->mEnd) == preservedEnd)
 			{
-				chosenIndex = i;
+				chosenIndex = (int)(it - mFindResults.begin());
 				break;
 			}
 		}
@@ -3176,28 +5319,268 @@ void TextEditor::RefreshFindResults(bool aPreserveSelection)
 
 	if (chosenIndex == -1)
 	{
-		for (int i = 0; i < (int)mFindResults.size(); ++i)
+		// the first result containing the cursor or after it, that is the first one ending after it
+		auto it = std::partition_point(mFindResults.begin(), mFindResults.end(),
+			[&](const SearchResult& res) { return !(cursorPosition < toPosition(res.mEnd)); });
+		if (it != mFindResults.end())
+			chosenIndex = (int)(it - mFindResults.begin());
+	}
+
+	if (chosenIndex == -1)
+		chosenIndex = 0;
+
+	mFindResultIndex = chosenIndex;
+	DropFindColumns(0);
+}
+
+// Results starting above aFromLine stay. The search is replayed from there over the lines scanned again
+// and on below them until a line it reaches with nothing carried over from the line before, where the
+// previous search did the same; from there on it goes as it did, so the previous results are kept,
+// moved by the lines inserted or removed since. Only for a search of the whole text.
+void TextEditor::SpliceFindResults(int aFromLine, int aToLine, bool aWholeWord)
+{
+	int lineDelta = (int)mLines.size() - mFindResultsBasis.mLineCount;
+	size_t keep = std::partition_point(mFindResults.begin(), mFindResults.end(),
+		[aFromLine](const SearchResult& aResult) { return aResult.mStart.mLine < aFromLine; }) - mFindResults.begin();
+	std::pair<int, int> searchPosition(0, 0);
+	if (keep > 0)
+	{
+		// a kept result ends above the edited lines, so its line is as it was
+		const Coordinates& end = mFindResults[keep - 1].mEnd;
+		searchPosition = { end.mLine, GetCharacterIndexR(end) };
+	}
+
+	std::vector<SearchResult> found;
+	size_t previous = keep; // first previous result not above the line reached, in previous line numbers
+	size_t resume = mFindResults.size();
+	for (int lineIndex = aFromLine; lineIndex < (int)mLines.size(); lineIndex++)
+	{
+		if (lineIndex > aToLine && searchPosition <= std::make_pair(lineIndex, 0))
 		{
-			const auto& res = mFindResults[i];
-			size_t resStart = coordinateToOffset(res.mStart);
-			size_t resEnd = coordinateToOffset(res.mEnd);
-			if (resStart <= cursorOffset && cursorOffset < resEnd)
+			Coordinates lineStart(lineIndex - lineDelta, 0);
+			while (previous < mFindResults.size() && mFindResults[previous].mStart < lineStart)
+				previous++;
+			if (previous == keep || mFindResults[previous - 1].mEnd <= lineStart)
 			{
-				chosenIndex = i;
+				resume = previous;
 				break;
 			}
-			if (cursorOffset < resStart)
+		}
+		for (const auto& occurrence : mLines[lineIndex].mFindOccurrences)
+		{
+			if (occurrence.mFindIndex != mFindIndex.mSlot || std::make_pair(lineIndex, occurrence.mStart) < searchPosition)
+				continue;
+			if (aWholeWord && (!occurrence.mWordBoundaryBefore || !occurrence.mWordBoundaryAfter))
 			{
-				chosenIndex = i;
-				break;
+				searchPosition = { lineIndex, occurrence.mStart + 1 };
+				continue;
 			}
+			int endLine = lineIndex + occurrence.mEndLine;
+			found.push_back({ Coordinates(lineIndex, GetCharacterColumn(lineIndex, occurrence.mStart)), Coordinates(endLine, GetCharacterColumn(endLine, occurrence.mEnd)) });
+			mFindMaxLineSpan = std::max(mFindMaxLineSpan, occurrence.mEndLine);
+			searchPosition = { endLine, occurrence.mEnd };
 		}
 	}
 
-	if (chosenIndex == -1)
-		chosenIndex = 0;
+	if (lineDelta != 0)
+	{
+		for (size_t i = resume; i < mFindResults.size(); i++)
+		{
+			mFindResults[i].mStart.mLine += lineDelta;
+			mFindResults[i].mEnd.mLine += lineDelta;
+		}
+	}
+	mFindResults.erase(mFindResults.begin() + keep, mFindResults.begin() + resume);
+	mFindResults.insert(mFindResults.begin() + keep, found.begin(), found.end());
 
-	mFindResultIndex = chosenIndex;
+	// segments hold result indices, those from the first replaced result on have moved
+	for (auto it = mFindHighlightsCache.begin(); it != mFindHighlightsCache.end();)
+	{
+		if (it->first >= aFromLine)
+			it = mFindHighlightsCache.erase(it);
+		else
+			++it;
+	}
+}
+
+void TextEditor::AddFindResult(int aLine, const FindOccurrence& aOccurrence)
+{
+	int endLine = aLine + aOccurrence.mEndLine;
+	mFindResults.push_back({ Coordinates(aLine, GetCharacterColumn(aLine, aOccurrence.mStart)), Coordinates(endLine, GetCharacterColumn(endLine, aOccurrence.mEnd)) });
+	mFindMaxLineSpan = std::max(mFindMaxLineSpan, aOccurrence.mEndLine);
+}
+
+void TextEditor::DropFindColumns(size_t aFirstResult)
+{
+	// results are found over the whole document, the column tables built for them are only kept in view
+	for (size_t i = aFirstResult; i < mFindResults.size(); i++)
+		for (int lineIndex : { mFindResults[i].mStart.mLine, mFindResults[i].mEnd.mLine })
+			if ((lineIndex < mFirstVisibleLine || lineIndex > mLastVisibleLine) && mLines[lineIndex].HasColumnBreaks())
+				mLines[lineIndex].DropColumns();
+}
+
+void TextEditor::ApplyRegexFindResults()
+{
+	auto job = mRegexFindJob;
+	std::vector<RegexFindJob::Match> matches;
+	bool finished;
+	bool failed;
+	{
+		std::lock_guard<std::mutex> lock(job->mMutex);
+		matches.swap(job->mMatches);
+		finished = job->mFinished;
+		failed = job->mFailed;
+	}
+	// the text changed under the search, the refresh that follows every edit starts a new one
+	if (job->mDocumentVersion != mDocumentVersion)
+		return;
+
+	size_t firstAdded = mFindResults.size();
+	for (const auto& match : matches)
+	{
+		FindOccurrence occurrence;
+		occurrence.mStart = match.mStartIndex;
+		occurrence.mEnd = match.mEndIndex;
+		occurrence.mEndLine = match.mEndLine - match.mStartLine;
+		AddFindResult(match.mStartLine, occurrence);
+		for (int line = match.mStartLine; line <= match.mEndLine; line++)
+			mFindHighlightsCache.erase(line);
+
+		// same choice as a synchronous refresh: the previously selected match, else the first one not
+		// ending before the cursor
+		int index = (int)mFindResults.size() - 1;
+		std::pair<int, int> start(match.mStartLine, match.mStartIndex);
+		std::pair<int, int> end(match.mEndLine, match.mEndIndex);
+		if (job->mResultChosen)
+			continue;
+		if (job->mPreservedValid && start == job->mPreservedStart && end == job->mPreservedEnd)
+		{
+			mFindResultIndex = index;
+			job->mResultChosen = true;
+		}
+		else if (mFindResultIndex == -1 && job->mCursor < end)
+			mFindResultIndex = index;
+	}
+	DropFindColumns(firstAdded);
+
+	if (!finished)
+		return;
+	if (mFindResultIndex == -1 && !mFindResults.empty())
+		mFindResultIndex = 0;
+	if (failed)
+	{
+		mFindStatusMessage = "Regex too complex, search stopped";
+		mFindStatusTimer = 3.0f;
+	}
+	mRegexFindJob.reset();
+}
+
+void TextEditor::WaitForFindResults()
+{
+	if (mRegexFindJob == nullptr)
+		return;
+	{
+		std::unique_lock<std::mutex> lock(mRegexFindJob->mMutex);
+		mRegexFindJob->mFinishedSignal.wait(lock, [this] { return mRegexFindJob->mFinished; });
+	}
+	ApplyRegexFindResults();
+	mRegexFindJob.reset(); // also when the document moved on, its matches are of no use then
+}
+
+void TextEditor::CancelRegexFind()
+{
+	if (mRegexFindJob == nullptr)
+		return;
+	mRegexFindJob->mCancelled = true;
+	mRegexFindJob.reset();
+}
+
+void TextEditor::ReplaceRanges(const std::vector<SearchResult>& aRanges, const char* aText)
+{
+	// Back to front, so the ranges still to do keep their coordinates, and recorded as one undo step.
+	// Ranges within a single line are all done in one rebuild of that line instead of an edit each.
+	// The ranges are find results: sorted, not overlapping and on character boundaries.
+	assert(!mReadOnly);
+	if (aRanges.empty())
+		return;
+
+	ScopedCount heldEvents(mEditEventsHeld);
+	UndoRecord u;
+	u.mBefore = mState;
+	u.mOperations.reserve(aRanges.size() * 2);
+	MarkFindResultsDirty(false);
+	mFindHighlightsCache.clear();
+
+	const char* textEnd = aText + std::strlen(aText);
+	bool textIsSingleLine = std::find_if(aText, textEnd, [](char c) { return c == '\n' || c == '\r'; }) == textEnd;
+
+	Coordinates firstEnd;
+	for (int i = (int)aRanges.size() - 1; i >= 0; i--)
+	{
+		const auto& range = aRanges[i];
+		if (!textIsSingleLine || range.mStart.mLine != range.mEnd.mLine)
+		{
+			std::string removed = GetText(range.mStart, range.mEnd);
+			DeleteRange(range.mStart, range.mEnd);
+			Coordinates end = range.mStart;
+			int insertedLines = InsertTextAt(end, aText);
+			u.mOperations.push_back({ removed, range.mStart, range.mEnd, UndoOperationType::Delete });
+			u.mOperations.push_back({ aText, range.mStart, end, UndoOperationType::Add });
+			Colorize(range.mStart.mLine - 1, insertedLines + 2);
+			firstEnd = end;
+			continue;
+		}
+
+		int lineIndex = range.mStart.mLine;
+		int first = i;
+		while (first > 0 && aRanges[first - 1].mStart.mLine == lineIndex && aRanges[first - 1].mEnd.mLine == lineIndex)
+			first--;
+
+		// left to right within the line, each operation seeing the replacements before it done
+		auto& line = mLines[lineIndex];
+		int walkIndex = 0;
+		int walkColumn = 0;
+		auto indexAt = [&](int aColumn)
+		{
+			while (walkIndex < (int)line.size() && walkColumn < aColumn)
+				MoveCharIndexAndColumn(lineIndex, walkIndex, walkColumn);
+			return walkIndex;
+		};
+
+		Line rebuilt;
+		int column = 0;
+		int copied = 0;
+		for (int k = first; k <= i; k++)
+		{
+			int start = indexAt(aRanges[k].mStart.mColumn);
+			int end = indexAt(aRanges[k].mEnd.mColumn);
+			column = AdvanceColumn(column, line.mText.data() + copied, line.mText.data() + start);
+			rebuilt.Insert(rebuilt.size(), line, copied, start);
+			Coordinates operationStart(lineIndex, column);
+			u.mOperations.push_back({ line.mText.substr(start, end - start), operationStart,
+				Coordinates(lineIndex, AdvanceColumn(column, line.mText.data() + start, line.mText.data() + end)), UndoOperationType::Delete });
+			column = AdvanceColumn(column, aText, textEnd);
+			rebuilt.Append(aText, textEnd);
+			u.mOperations.push_back({ aText, operationStart, Coordinates(lineIndex, column), UndoOperationType::Add });
+			if (k == first)
+				firstEnd = Coordinates(lineIndex, column);
+			copied = end;
+		}
+		rebuilt.Insert(rebuilt.size(), line, copied, line.size());
+		line.mText.swap(rebuilt.mText);
+		line.mGlyphs.swap(rebuilt.mGlyphs);
+		line.mColumnsTabSize = 0;
+		line.mRevision = ++mDocumentVersion;
+		InvalidateFindLines(lineIndex, lineIndex);
+		Colorize(lineIndex - 1, 3);
+		i = first;
+	}
+
+	ClearSelections();
+	ClearExtraCursors();
+	SetCursorPosition(firstEnd);
+	u.SetAfter(mState);
+	AddUndo(u);
 }
 
 bool TextEditor::FocusFindResult(int aIndex, bool aCenterView)
@@ -3214,6 +5597,8 @@ bool TextEditor::FocusFindResult(int aIndex, bool aCenterView)
 	else
 		idx = idx % count;
 	mFindResultIndex = idx;
+	if (mRegexFindJob != nullptr)
+		mRegexFindJob->mResultChosen = true; // matches still arriving must not move the focus away
 
 	const auto& res = mFindResults[mFindResultIndex];
 	ClearSelections();
@@ -3257,7 +5642,7 @@ void TextEditor::FindNext(bool aBackwards)
 
 void TextEditor::ReplaceCurrent()
 {
-	if (!HasValidFindPattern())
+	if (!HasValidFindPattern() || mReadOnly)
 	{
 		mFindStatusMessage = "Nothing to replace";
 		mFindStatusTimer = 2.5f;
@@ -3265,6 +5650,7 @@ void TextEditor::ReplaceCurrent()
 	}
 
 	EnsureFindResultsUpToDate();
+	WaitForFindResults();
 	if (mFindResults.empty())
 	{
 		mFindStatusMessage = "No matches";
@@ -3274,37 +5660,20 @@ void TextEditor::ReplaceCurrent()
 	if (mFindResultIndex < 0 || mFindResultIndex >= (int)mFindResults.size())
 		mFindResultIndex = 0;
 
-	const auto current = mFindResults[mFindResultIndex];
-	ClearSelections();
-	ClearExtraCursors();
-	SetSelection(current.mStart, current.mEnd);
-	InsertTextAtCursor(mReplaceBuffer);
+	ReplaceRanges({ mFindResults[mFindResultIndex] }, mReplaceBuffer);
 	if (mFindSelectionOnly)
 		mFindSelectionRangeValid = false;
 
 	MarkFindResultsDirty(false);
 	RefreshFindResults(false);
+	WaitForFindResults();
 	if (!mFindResults.empty())
 	{
+		// the first result containing the cursor or not starting before it
 		Coordinates cursor = GetSanitizedCursorCoordinates();
-		int nextIndex = -1;
-		for (int i = 0; i < (int)mFindResults.size(); ++i)
-		{
-			const auto& res = mFindResults[i];
-			if (!(cursor < res.mStart) && cursor < res.mEnd)
-			{
-				nextIndex = i;
-				break;
-			}
-			if (!(res.mStart < cursor))
-			{
-				nextIndex = i;
-				break;
-			}
-		}
-		if (nextIndex == -1)
-			nextIndex = 0;
-		FocusFindResult(nextIndex);
+		auto it = std::partition_point(mFindResults.begin(), mFindResults.end(),
+			[&](const SearchResult& res) { return !(cursor < res.mEnd) && res.mStart < cursor; });
+		FocusFindResult(it == mFindResults.end() ? 0 : (int)(it - mFindResults.begin()));
 	}
 	else
 	{
@@ -3319,7 +5688,7 @@ void TextEditor::ReplaceCurrent()
 
 int TextEditor::ReplaceAll()
 {
-	if (!HasValidFindPattern())
+	if (!HasValidFindPattern() || mReadOnly)
 	{
 		mFindStatusMessage = "Nothing to replace";
 		mFindStatusTimer = 2.5f;
@@ -3327,6 +5696,7 @@ int TextEditor::ReplaceAll()
 	}
 
 	EnsureFindResultsUpToDate();
+	WaitForFindResults();
 	if (mFindResults.empty())
 	{
 		mFindStatusMessage = "No matches";
@@ -3334,68 +5704,17 @@ int TextEditor::ReplaceAll()
 		return 0;
 	}
 
-	Coordinates selectionStart;
-	Coordinates selectionEnd;
-	bool selectionRangeActive = false;
+	// the results already respect the selection-only range, and replacing them all at once means text
+	// brought in by a replacement is never matched again
+	std::vector<SearchResult> targets;
+	targets.swap(mFindResults);
+	int replacements = (int)targets.size();
+	ReplaceRanges(targets, mReplaceBuffer);
 	if (mFindSelectionOnly)
-	{
-		if (TryGetSelectionBounds(selectionStart, selectionEnd))
-		{
-			mFindSelectionRangeStart = selectionStart;
-			mFindSelectionRangeEnd = selectionEnd;
-			mFindSelectionRangeValid = true;
-		}
-		if (mFindSelectionRangeValid)
-		{
-			selectionStart = SanitizeCoordinates(mFindSelectionRangeStart);
-			selectionEnd = SanitizeCoordinates(mFindSelectionRangeEnd);
-			selectionRangeActive = true;
-		}
-	}
-
-	auto withinSelectionRange = [&](const SearchResult& res)
-	{
-		if (!selectionRangeActive)
-			return true;
-		return !(res.mStart < selectionStart) && !(selectionEnd < res.mEnd);
-	};
-
-	int replacements = 0;
-	Coordinates lastReplacementStart = Coordinates::Invalid();
-
-	while (true)
-	{
-		EnsureFindResultsUpToDate();
-		if (mFindResults.empty())
-			break;
-
-		int targetIndex = -1;
-		for (int i = 0; i < (int)mFindResults.size(); ++i)
-		{
-			if (withinSelectionRange(mFindResults[i]))
-			{
-				targetIndex = i;
-				break;
-			}
-		}
-		if (targetIndex == -1)
-			break;
-
-		const auto current = mFindResults[targetIndex];
-		if (lastReplacementStart == current.mStart)
-			break;
-		lastReplacementStart = current.mStart;
-
-		ClearSelections();
-		ClearExtraCursors();
-		SetSelection(current.mStart, current.mEnd);
-		InsertTextAtCursor(mReplaceBuffer);
-		++replacements;
-		if (selectionRangeActive)
-			mFindSelectionRangeValid = false;
-	}
+		mFindSelectionRangeValid = false;
 
 	RefreshFindResults(false);
+	WaitForFindResults();
 	if (!mFindResults.empty())
 		FocusFindResult(0, false);
 	else
@@ -3405,134 +5724,210 @@ int TextEditor::ReplaceAll()
 		EnsureCursorVisible();
 	}
 
-	if (replacements == 0)
-	{
-		mFindStatusMessage = "No matches";
-		mFindStatusTimer = 2.5f;
-		return 0;
-	}
-
 	mFindStatusMessage = replacements == 1 ? "Replaced 1 match" : "Replaced " + std::to_string(replacements) + " matches";
 	mFindStatusTimer = 3.0f;
 	return replacements;
 }
 
-// TODO
-// - multiline comments vs single-line: latter is blocking start of a ML
-void TextEditor::Colorize(int aFromLine, int aLines)
-{
-	int toLine = aLines == -1 ? (int)mLines.size() : std::min((int)mLines.size(), aFromLine + aLines);
-	mColorRangeMin = std::min(mColorRangeMin, aFromLine);
-	mColorRangeMax = std::max(mColorRangeMax, toLine);
-	mColorRangeMin = std::max(0, mColorRangeMin);
-	mColorRangeMax = std::max(mColorRangeMin, mColorRangeMax);
-	mCheckComments = true;
+// TODO
+// - multiline comments vs single-line: latter is blocking start of a ML
+void TextEditor::Colorize(int aFromLine, int aLines)
+{
+	int toLine = aLines == -1 ? (int)mLines.size() : std::min((int)mLines.size(), aFromLine + aLines);
+	mColorRangeMin = std::min(mColorRangeMin, aFromLine);
+	mColorRangeMax = std::max(mColorRangeMax, toLine);
+	mColorRangeMin = std::max(0, mColorRangeMin);
+	mColorRangeMax = std::max(mColorRangeMin, mColorRangeMax);
+	InvalidateCommentState(aFromLine, toLine - 1);
+}
+
+void TextEditor::InvalidateCommentState(int aFromLine, int aToLine)
+{
+	aFromLine = std::max(0, aFromLine);
+	aToLine = std::max(aFromLine, aToLine);
+	if (!mCheckComments)
+	{
+		mCheckCommentsFromLine = aFromLine;
+		mCheckCommentsToLine = aToLine;
+		mCheckComments = true;
+	}
+	else
+	{
+		mCheckCommentsFromLine = std::min(mCheckCommentsFromLine, aFromLine);
+		mCheckCommentsToLine = std::max(mCheckCommentsToLine, aToLine);
+	}
+}
+
+void TextEditor::ShiftCommentStateRange(int aIndex, int aLineCountDelta)
+{
+	auto shift = [aIndex, aLineCountDelta](int& line) {
+		if (aLineCountDelta > 0 && line >= aIndex)
+			line += aLineCountDelta;
+		else if (aLineCountDelta < 0 && line >= aIndex)
+			line = std::max(aIndex, line + aLineCountDelta);
+	};
+	if (mCheckComments)
+	{
+		shift(mCheckCommentsFromLine);
+		shift(mCheckCommentsToLine);
+	}
+	// the pending token range moves too, several edits may be queued before the next ColorizeInternal
+	if (mColorRangeMin < mColorRangeMax)
+	{
+		shift(mColorRangeMin);
+		shift(mColorRangeMax);
+	}
+}
+
+void TextEditor::ColorizeRange(int aFromLine, int aToLine)
+{
+	if (mLines.empty() || aFromLine >= aToLine || mLanguageDefinition == nullptr)
+		return;
+	ScopedTimer timer(mFrameStats.mColorizeRangeMs);
+
+	// tokens depend on the line alone, so lines not edited since they were last tokenized are skipped;
+	// a range spanning scattered edits only costs the lines that changed
+	int endLine = std::max(0, std::min((int)mLines.size(), aToLine));
+	unsigned int threadCount = 1;
+	if (mParallelColorization && endLine - aFromLine >= 2 * PARALLEL_COLORIZE_LINES_PER_THREAD)
+		threadCount = Min(std::thread::hardware_concurrency(), (unsigned int)((endLine - aFromLine) / PARALLEL_COLORIZE_LINES_PER_THREAD));
+	if (threadCount <= 1)
+	{
+		for (int i = aFromLine; i < endLine; ++i)
+		{
+			auto& line = mLines[i];
+			if (line.mColorizedRevision == line.mRevision)
+				continue;
+			ColorizeLine(line, *mLanguageDefinition, *mRegexList);
+			line.mColorizedRevision = line.mRevision;
+			line.BuildBrackets();
+			mFrameStats.mLinesColorized++;
+			if (mDocumentWordCompletion)
+				HarvestLineWords(line);
+		}
+		return;
+	}
+
+	// Lines are independent, the comment state is a separate sequential pass (ColorizeInternal), so
+	// slices need no fix-up at their boundaries. LineStore lookups move its cache, the threads get
+	// plain pointers; the word list is not thread safe, it is fed afterwards.
+	std::vector<Line*> stale;
+	for (int i = aFromLine; i < endLine; ++i)
+	{
+		auto& line = mLines[i];
+		if (line.mColorizedRevision != line.mRevision)
+			stale.push_back(&line);
+	}
+	threadCount = Min(threadCount, (unsigned int)(stale.size() / PARALLEL_COLORIZE_LINES_PER_THREAD) + 1);
+	auto colorizeSlice = [&](size_t aFrom, size_t aTo)
+	{
+		for (size_t i = aFrom; i < aTo; i++)
+		{
+			ColorizeLine(*stale[i], *mLanguageDefinition, *mRegexList);
+			stale[i]->mColorizedRevision = stale[i]->mRevision;
+			stale[i]->BuildBrackets();
+		}
+	};
+	if (mColorizePool == nullptr)
+		mColorizePool = std::make_shared<ColorizePool>(std::thread::hardware_concurrency() - 1);
+	mColorizePool->ForEachSlice(threadCount, [&](size_t aSlice)
+		{
+			colorizeSlice(stale.size() * aSlice / threadCount, stale.size() * (aSlice + 1) / threadCount);
+		});
+
+	if (mDocumentWordCompletion)
+	{
+		for (Line* line : stale)
+			HarvestLineWords(*line);
+	}
+	mFrameStats.mLinesColorized += (int)stale.size();
 }
 
-void TextEditor::ColorizeRange(int aFromLine, int aToLine)
+// Works on the line alone, no editor state, so the background worker can run it on its copies.
+void TextEditor::ColorizeLine(Line& aLine, const LanguageDefinition& aLanguageDefinition, const RegexList& aRegexList)
 {
-	if (mLines.empty() || aFromLine >= aToLine || mLanguageDefinition == nullptr)
+	if (aLine.empty())
 		return;
 
-	std::string buffer;
 	boost::cmatch results;
-	std::string id;
 
-	int endLine = std::max(0, std::min((int)mLines.size(), aToLine));
-	for (int i = aFromLine; i < endLine; ++i)
-	{
-		auto& line = mLines[i];
+	for (auto& glyph : aLine.mGlyphs)
+		glyph.SetColorIndex(PaletteIndex::Default);
 
-		if (line.empty())
-			continue;
+	const char* bufferBegin = aLine.mText.data();
+	const char* bufferEnd = bufferBegin + aLine.size();
 
-		buffer.resize(line.size());
-		for (size_t j = 0; j < line.size(); ++j)
-		{
-			auto& col = line[j];
-			buffer[j] = col.mChar;
-			col.mColorIndex = PaletteIndex::Default;
-		}
+	auto last = bufferEnd;
 
-		const char* bufferBegin = &buffer.front();
-		const char* bufferEnd = bufferBegin + buffer.size();
+	for (auto first = bufferBegin; first != last; )
+	{
+		const char* token_begin = nullptr;
+		const char* token_end = nullptr;
+		PaletteIndex token_color = PaletteIndex::Default;
 
-		auto last = bufferEnd;
+		bool hasTokenizeResult = false;
 
-		for (auto first = bufferBegin; first != last; )
+		if (aLanguageDefinition.mTokenize != nullptr)
 		{
-			const char* token_begin = nullptr;
-			const char* token_end = nullptr;
-			PaletteIndex token_color = PaletteIndex::Default;
-
-			bool hasTokenizeResult = false;
+			if (aLanguageDefinition.mTokenize(first, last, token_begin, token_end, token_color))
+				hasTokenizeResult = true;
+		}
 
-			if (mLanguageDefinition->mTokenize != nullptr)
-			{
-				if (mLanguageDefinition->mTokenize(first, last, token_begin, token_end, token_color))
-					hasTokenizeResult = true;
-			}
+		if (hasTokenizeResult == false)
+		{
+			// todo : remove
+			//printf("using regex for %.*s\n", first + 10 < last ? 10 : int(last - first), first);
 
-			if (hasTokenizeResult == false)
+			for (const auto& p : aRegexList.mValue)
 			{
-				// todo : remove
-				//printf("using regex for %.*s\n", first + 10 < last ? 10 : int(last - first), first);
-
-				for (const auto& p : mRegexList->mValue)
+				bool regexSearchResult = false;
+				try { regexSearchResult = boost::regex_search(first, last, results, p.first, boost::regex_constants::match_continuous); }
+				catch (...) {}
+				if (regexSearchResult)
 				{
-					bool regexSearchResult = false;
-					try { regexSearchResult = boost::regex_search(first, last, results, p.first, boost::regex_constants::match_continuous); }
-					catch (...) {}
-					if (regexSearchResult)
-					{
-						hasTokenizeResult = true;
+					hasTokenizeResult = true;
 
-						auto& v = *results.begin();
-						token_begin = v.first;
-						token_end = v.second;
-						token_color = p.second;
-						break;
-					}
+					auto& v = *results.begin();
+					token_begin = v.first;
+					token_end = v.second;
+					token_color = p.second;
+					break;
 				}
 			}
+		}
 
-			if (hasTokenizeResult == false)
-			{
-				first++;
-			}
-			else
+		if (hasTokenizeResult == false)
+		{
+			first++;
+		}
+		else
+		{
+			const size_t token_length = token_end - token_begin;
+
+			if (token_color == PaletteIndex::Identifier)
 			{
-				const size_t token_length = token_end - token_begin;
+				const uint8_t classes = aLanguageDefinition.mKeywordTable.Lookup(std::string_view(token_begin, token_length));
 
-				if (token_color == PaletteIndex::Identifier)
+				if (!aLine.mGlyphs[first - bufferBegin].mPreprocessor)
 				{
-					id.assign(token_begin, token_end);
-
-					// todo : allmost all language definitions use lower case to specify keywords, so shouldn't this use ::tolower ?
-					if (!mLanguageDefinition->mCaseSensitive)
-						std::transform(id.begin(), id.end(), id.begin(), ::toupper);
-
-					if (!line[first - bufferBegin].mPreprocessor)
-					{
-						if (mLanguageDefinition->mKeywords.count(id) != 0)
-							token_color = PaletteIndex::Keyword;
-						else if (mLanguageDefinition->mIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::KnownIdentifier;
-						else if (mLanguageDefinition->mPreprocIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::PreprocIdentifier;
-					}
-					else
-					{
-						if (mLanguageDefinition->mPreprocIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::PreprocIdentifier;
-					}
+					if (classes & LanguageDefinition::KeywordTable::Keyword)
+						token_color = PaletteIndex::Keyword;
+					else if (classes & LanguageDefinition::KeywordTable::KnownIdentifier)
+						token_color = PaletteIndex::KnownIdentifier;
+					else if (classes & LanguageDefinition::KeywordTable::PreprocIdentifier)
+						token_color = PaletteIndex::PreprocIdentifier;
+				}
+				else
+				{
+					if (classes & LanguageDefinition::KeywordTable::PreprocIdentifier)
+						token_color = PaletteIndex::PreprocIdentifier;
 				}
+			}
 
-				for (size_t j = 0; j < token_length; ++j)
-					line[(token_begin - bufferBegin) + j].mColorIndex = token_color;
+			for (size_t j = 0; j < token_length; ++j)
+				aLine.mGlyphs[(token_begin - bufferBegin) + j].SetColorIndex(token_color);
 
-				first = token_end;
-			}
+			first = token_end;
 		}
 	}
 }
@@ -3548,150 +5943,382 @@ bool ColorizerEquals(InputIt1 first1, InputIt1 last1,
 	}
 	return first1 == last1 && first2 == last2;
 }
-void TextEditor::ColorizeInternal()
-{
-	if (mLines.empty() || mLanguageDefinition == nullptr)
-		return;
 
-	if (mCheckComments)
-	{
-		auto endLine = mLines.size();
-		auto endIndex = 0;
-		auto commentStartLine = endLine;
-		auto commentStartIndex = endIndex;
-		auto withinString = false;
-		auto withinSingleLineComment = false;
-		auto withinPreproc = false;
-		auto firstChar = true;			// there is no other non-whitespace characters in the line before
-		auto concatenate = false;		// '\' on the very end of the line
-		auto currentLine = 0;
-		auto currentIndex = 0;
-		while (currentLine < endLine || currentIndex < endIndex)
+uint8_t TextEditor::ColorizeCommentsInLine(Line& aLine, uint8_t aEntryState)
+{
+	auto& line = aLine;
+	const int noComment = std::numeric_limits<int>::max();
+	int commentStartIndex = (aEntryState & COMMENT_STATE_MULTILINE_COMMENT) ? -1 : noComment; // -1: opened on a previous line
+	bool withinString = (aEntryState & COMMENT_STATE_STRING) != 0;
+	bool concatenate = (aEntryState & COMMENT_STATE_CONCATENATE) != 0; // '\' on the very end of the previous line
+	bool withinSingleLineComment = concatenate && (aEntryState & COMMENT_STATE_SINGLE_LINE_COMMENT);
+	bool withinPreproc = concatenate && (aEntryState & COMMENT_STATE_PREPROCESSOR);
+	bool firstChar = !concatenate || (aEntryState & COMMENT_STATE_FIRST_CHAR); // there is no other non-whitespace characters in the line before
+
+	// Other bytes than these can neither open nor close a string or comment, they only take the flags of
+	// where the scan is. Runs of them are found sixteen bytes at a time and filled. The last byte can
+	// continue the line and the first ones can start a preprocessor directive, they are always stepped.
+	const auto& startStr = mLanguageDefinition->mCommentStart;
+	const auto& singleStartStr = mLanguageDefinition->mSingleLineComment;
+	const auto& endStr = mLanguageDefinition->mCommentEnd;
+	bool skipRuns = !startStr.empty() && !endStr.empty();
+	const char codeStops[4] = { '\"', skipRuns ? startStr[0] : '\"', singleStartStr.empty() ? '\"' : singleStartStr[0], skipRuns ? endStr.back() : '\"' };
+	const char stringStops[4] = { '\"', '\\', '\"', '\\' };
+	const int runEnd = (int)line.size() - 1;
+
+	concatenate = false;
+	int currentIndex = 0;
+	while (currentIndex < (int)line.size())
+	{
+		if (skipRuns && !firstChar && currentIndex < runEnd)
 		{
-			auto& line = mLines[currentLine];
-
-			if (currentIndex == 0 && !concatenate)
+			const char* text = line.mText.data();
+			int stop = (int)(FindAnyOf(text + currentIndex, text + runEnd, withinString ? stringStops : codeStops) - text);
+			if (stop > currentIndex)
 			{
-				withinSingleLineComment = false;
-				withinPreproc = false;
-				firstChar = true;
+				Glyph flags;
+				flags.mMultiLineComment = commentStartIndex <= currentIndex;
+				flags.mComment = !withinString && withinSingleLineComment;
+				flags.mPreprocessor = withinPreproc;
+				for (; currentIndex < stop; currentIndex++)
+				{
+					Glyph& glyph = line.mGlyphs[currentIndex];
+					glyph.mMultiLineComment = flags.mMultiLineComment;
+					glyph.mComment = flags.mComment;
+					glyph.mPreprocessor = flags.mPreprocessor;
+				}
+				continue;
 			}
+		}
 
-			concatenate = false;
+		concatenate = false;
 
-			if (!line.empty())
-			{
-				auto& g = line[currentIndex];
-				auto c = g.mChar;
+		auto c = line[currentIndex];
 
-				if (c != mLanguageDefinition->mPreprocChar && !isspace(c))
-					firstChar = false;
+		if (c != mLanguageDefinition->mPreprocChar && !isspace(c))
+			firstChar = false;
 
-				if (currentIndex == (int)line.size() - 1 && line[line.size() - 1].mChar == '\\')
-					concatenate = true;
+		if (currentIndex == (int)line.size() - 1 && line[line.size() - 1] == '\\')
+			concatenate = true;
 
-				bool inComment = (commentStartLine < currentLine || (commentStartLine == currentLine && commentStartIndex <= currentIndex));
+		bool inComment = commentStartIndex <= currentIndex;
 
-				if (withinString)
-				{
-					line[currentIndex].mMultiLineComment = inComment;
+		if (withinString)
+		{
+			// every byte gets all three flags written, stale ones would survive an incremental rescan
+			line.mGlyphs[currentIndex].mMultiLineComment = inComment;
+			line.mGlyphs[currentIndex].mComment = false;
 
-					if (c == '\"')
-					{
-						if (currentIndex + 1 < (int)line.size() && line[currentIndex + 1].mChar == '\"')
-						{
-							currentIndex += 1;
-							if (currentIndex < (int)line.size())
-								line[currentIndex].mMultiLineComment = inComment;
-						}
-						else
-							withinString = false;
-					}
-					else if (c == '\\')
+			if (c == '\"')
+			{
+				if (currentIndex + 1 < (int)line.size() && line[currentIndex + 1] == '\"')
+				{
+					line.mGlyphs[currentIndex].mPreprocessor = withinPreproc;
+					currentIndex += 1;
+					if (currentIndex < (int)line.size())
 					{
-						currentIndex += 1;
-						if (currentIndex < (int)line.size())
-							line[currentIndex].mMultiLineComment = inComment;
+						line.mGlyphs[currentIndex].mMultiLineComment = inComment;
+						line.mGlyphs[currentIndex].mComment = false;
 					}
 				}
 				else
+					withinString = false;
+			}
+			else if (c == '\\')
+			{
+				line.mGlyphs[currentIndex].mPreprocessor = withinPreproc;
+				currentIndex += 1;
+				if (currentIndex < (int)line.size())
 				{
-					if (firstChar && c == mLanguageDefinition->mPreprocChar)
-						withinPreproc = true;
+					line.mGlyphs[currentIndex].mMultiLineComment = inComment;
+					line.mGlyphs[currentIndex].mComment = false;
+				}
+			}
+		}
+		else
+		{
+			if (firstChar && c == mLanguageDefinition->mPreprocChar)
+				withinPreproc = true;
 
-					if (c == '\"')
-					{
-						withinString = true;
-						line[currentIndex].mMultiLineComment = inComment;
-					}
-					else
-					{
-						auto pred = [](const char& a, const Glyph& b) { return a == b.mChar; };
-						auto from = line.begin() + currentIndex;
-						auto& startStr = mLanguageDefinition->mCommentStart;
-						auto& singleStartStr = mLanguageDefinition->mSingleLineComment;
+			if (c == '\"')
+			{
+				withinString = true;
+				line.mGlyphs[currentIndex].mMultiLineComment = inComment;
+				line.mGlyphs[currentIndex].mComment = false;
+			}
+			else
+			{
+				auto pred = [](const char& a, const char& b) { return a == b; };
+				auto from = line.mText.begin() + currentIndex;
 
-						if (!withinSingleLineComment && currentIndex + startStr.size() <= line.size() &&
-							ColorizerEquals(startStr.begin(), startStr.end(), from, from + startStr.size(), pred))
-						{
-							commentStartLine = currentLine;
-							commentStartIndex = currentIndex;
-						}
-						else if (singleStartStr.size() > 0 &&
-							currentIndex + singleStartStr.size() <= line.size() &&
-							ColorizerEquals(singleStartStr.begin(), singleStartStr.end(), from, from + singleStartStr.size(), pred))
-						{
-							withinSingleLineComment = true;
-						}
+				if (!withinSingleLineComment && currentIndex + startStr.size() <= line.size() &&
+					ColorizerEquals(startStr.begin(), startStr.end(), from, from + startStr.size(), pred))
+				{
+					commentStartIndex = currentIndex;
+				}
+				else if (singleStartStr.size() > 0 &&
+					currentIndex + singleStartStr.size() <= line.size() &&
+					ColorizerEquals(singleStartStr.begin(), singleStartStr.end(), from, from + singleStartStr.size(), pred))
+				{
+					withinSingleLineComment = true;
+				}
 
-						inComment = (commentStartLine < currentLine || (commentStartLine == currentLine && commentStartIndex <= currentIndex));
+				inComment = commentStartIndex <= currentIndex;
 
-						line[currentIndex].mMultiLineComment = inComment;
-						line[currentIndex].mComment = withinSingleLineComment;
+				line.mGlyphs[currentIndex].mMultiLineComment = inComment;
+				line.mGlyphs[currentIndex].mComment = withinSingleLineComment;
 
-						auto& endStr = mLanguageDefinition->mCommentEnd;
-						if (currentIndex + 1 >= (int)endStr.size() &&
-							ColorizerEquals(endStr.begin(), endStr.end(), from + 1 - endStr.size(), from + 1, pred))
-						{
-							commentStartIndex = endIndex;
-							commentStartLine = endLine;
-						}
-					}
-				}
-				if (currentIndex < (int)line.size())
-					line[currentIndex].mPreprocessor = withinPreproc;
-				currentIndex += UTF8CharLength(c);
-				if (currentIndex >= (int)line.size())
+				if (currentIndex + 1 >= (int)endStr.size() &&
+					ColorizerEquals(endStr.begin(), endStr.end(), from + 1 - endStr.size(), from + 1, pred))
 				{
-					currentIndex = 0;
-					++currentLine;
+					commentStartIndex = noComment;
 				}
 			}
-			else
-			{
-				currentIndex = 0;
-				++currentLine;
-			}
+		}
+		if (currentIndex < (int)line.size())
+			line.mGlyphs[currentIndex].mPreprocessor = withinPreproc;
+		currentIndex += UTF8CharLength(c);
+	}
+
+	uint8_t exitState = 0;
+	if (commentStartIndex != noComment)
+		exitState |= COMMENT_STATE_MULTILINE_COMMENT;
+	if (withinString)
+		exitState |= COMMENT_STATE_STRING;
+	if (concatenate) // the rest only carries over into a continued line
+	{
+		exitState |= COMMENT_STATE_CONCATENATE;
+		if (withinSingleLineComment)
+			exitState |= COMMENT_STATE_SINGLE_LINE_COMMENT;
+		if (withinPreproc)
+			exitState |= COMMENT_STATE_PREPROCESSOR;
+		if (firstChar)
+			exitState |= COMMENT_STATE_FIRST_CHAR;
+	}
+	return exitState;
+}
+
+void TextEditor::ColorizeInternal()
+{
+	if (mLines.empty() || mLanguageDefinition == nullptr)
+		return;
+
+	if (mCheckComments)
+	{
+		// Restart one line above the first change: that line's entry state is still valid and its exit
+		// state seeds the changed line. Past the last change, stop as soon as a line hands the next one
+		// the state it already had, everything below is unaffected.
+		int lineCount = (int)mLines.size();
+		int fromLine = std::max(0, std::min(mCheckCommentsFromLine, lineCount - 1) - 1);
+		int toLine = std::min(mCheckCommentsToLine, lineCount - 1);
+		uint8_t state = fromLine == 0 ? 0 : mLines[fromLine].mEntryState;
+		for (int currentLine = fromLine; currentLine < lineCount; currentLine++)
+		{
+			auto& line = mLines[currentLine];
+			line.mEntryState = state;
+			state = ColorizeCommentsInLine(line, state);
+			if (currentLine >= toLine && currentLine + 1 < lineCount && mLines[currentLine + 1].mEntryState == state)
+				break;
 		}
 		mCheckComments = false;
 	}
 
+	if (mColorizeWorker != nullptr)
+		ApplyColorizeResults();
+
+	// Returns the line it stopped at, aToLine when the whole range was done. The first chunk of the
+	// frame ignores the budget so a tiny budget still makes progress.
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(mColorizeBudgetMicroseconds);
+	bool progressed = false;
+	bool parallelChunks = false;
+	auto colorizeWithinBudget = [&](int aFromLine, int aToLine)
+	{
+		for (int line = aFromLine; line < aToLine; )
+		{
+			if (mLines[line].mColorizedRevision == mLines[line].mRevision)
+			{
+				line++; // up to date, neither work nor progress
+				continue;
+			}
+			auto now = std::chrono::steady_clock::now();
+			if (progressed && now >= deadline)
+				return line;
+
+			// A parallel step takes what the rest of the budget fits at the rate measured so far, so
+			// every thread gets a share without running far past the budget
+			int chunkLines = COLORIZE_BUDGET_CHECK_LINES;
+			if (parallelChunks && mColorizeLinesPerMicrosecond > 0.0f)
+			{
+				float left = (float)std::max(0ll, (long long)std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count());
+				chunkLines = (int)std::min(left * mColorizeLinesPerMicrosecond, (float)(aToLine - line));
+				chunkLines = Max(COLORIZE_BUDGET_CHECK_LINES, chunkLines);
+			}
+			int chunkEnd = std::min(line + chunkLines, aToLine);
+			int colorizedBefore = mFrameStats.mLinesColorized;
+			ColorizeRange(line, chunkEnd);
+			int colorized = mFrameStats.mLinesColorized - colorizedBefore;
+			float elapsed = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - now).count();
+			if (parallelChunks && colorized > 0 && elapsed > 0.0f)
+				mColorizeLinesPerMicrosecond = colorized / elapsed;
+			progressed = true;
+			line = chunkEnd;
+		}
+		return aToLine;
+	};
+
+	// What is on screen first. ColorizeRange skips lines that are up to date, so walking these again
+	// when the pending range reaches them costs a comparison per line.
 	if (mColorRangeMin < mColorRangeMax)
 	{
-		const int increment = (mLanguageDefinition->mTokenize == nullptr) ? 10 : 10000;
-		const int to = std::min(mColorRangeMin + increment, mColorRangeMax);
-		ColorizeRange(mColorRangeMin, to);
-		mColorRangeMin = to;
+		int viewFrom = std::max(mColorRangeMin, mFirstVisibleLine - COLORIZE_PREFETCH_LINES);
+		int viewTo = std::min({ mColorRangeMax, mLastVisibleLine + 1 + COLORIZE_PREFETCH_LINES, (int)mLines.size() });
+		if (colorizeWithinBudget(viewFrom, viewTo) < viewTo)
+			return;
+	}
+
+	if (mColorizeWorker != nullptr)
+	{
+		SubmitColorizeJobs();
+		return;
+	}
 
-		if (mColorRangeMax == mColorRangeMin)
+	if (mColorRangeMin < mColorRangeMax)
+	{
+		parallelChunks = mParallelColorization;
+		mColorRangeMin = colorizeWithinBudget(mColorRangeMin, std::min(mColorRangeMax, (int)mLines.size()));
+		if (mColorRangeMin >= std::min(mColorRangeMax, (int)mLines.size()))
 		{
 			mColorRangeMin = std::numeric_limits<int>::max();
 			mColorRangeMax = 0;
 		}
+	}
+}
+
+void TextEditor::SubmitColorizeJobs()
+{
+	// Only the copy happens here, the worker does the tokenizing. A few jobs are kept in flight
+	// so a freshly loaded file gets colored top down without snapshotting all of it in one frame.
+	int jobsInFlight;
+	{
+		std::lock_guard<std::mutex> lock(mColorizeWorker->mMutex);
+		jobsInFlight = (int)mColorizeWorker->mQueued.size() + mColorizeWorker->mBusy;
+	}
+
+	std::vector<ColorizeJob> jobs;
+	int endLine = std::min(mColorRangeMax, (int)mLines.size());
+	while (mColorRangeMin < endLine && jobsInFlight + (int)jobs.size() < COLORIZE_MAX_JOBS_IN_FLIGHT)
+	{
+		int jobEnd = std::min(mColorRangeMin + COLORIZE_JOB_LINES, endLine);
+		jobs.emplace_back();
+		auto& job = jobs.back();
+		job.mOwner = mDocument.get();
+		job.mLanguageDefinition = mLanguageDefinition;
+		job.mRegexList = mRegexList;
+		job.mFirstLine = mColorRangeMin;
+		job.mLineLayoutVersion = mLineLayoutVersion;
+		job.mLines.resize(jobEnd - mColorRangeMin);
+		for (int i = mColorRangeMin; i < jobEnd; i++)
+		{
+			const auto& line = mLines[i];
+			auto& copy = job.mLines[i - job.mFirstLine];
+			copy.mText = line.mText;
+			copy.mGlyphs = line.mGlyphs;
+			copy.mRevision = line.mRevision;
+		}
+		mColorRangeMin = jobEnd;
+	}
+
+	if (mColorRangeMin >= endLine)
+	{
+		mColorRangeMin = std::numeric_limits<int>::max();
+		mColorRangeMax = 0;
+	}
+
+	if (jobs.empty())
 		return;
+	{
+		std::lock_guard<std::mutex> lock(mColorizeWorker->mMutex);
+		for (auto& job : jobs)
+			mColorizeWorker->mQueued.push_back(std::move(job));
+	}
+	mColorizeWorker->mWakeUp.notify_one();
+}
+
+void TextEditor::ApplyColorizeResults()
+{
+	std::vector<ColorizeJob> finished;
+	{
+		std::lock_guard<std::mutex> lock(mColorizeWorker->mMutex);
+		auto& all = mColorizeWorker->mFinished;
+		auto others = std::stable_partition(all.begin(), all.end(), [this](const ColorizeJob& job) { return job.mOwner == mDocument.get(); });
+		std::move(all.begin(), others, std::back_inserter(finished));
+		all.erase(all.begin(), others);
+	}
+
+	for (const auto& job : finished)
+	{
+		// a language switch recolors everything anyway
+		if (job.mLanguageDefinition != mLanguageDefinition)
+			continue;
+
+		// Lines were inserted, removed or moved since the copy. Loaded lines share a revision and
+		// lines that shifted keep theirs, so the revision no longer tells whether a line is the one that
+		// was copied; its indices are queued again.
+		if (job.mLineLayoutVersion != mLineLayoutVersion)
+		{
+			int jobEnd = std::min(job.mFirstLine + (int)job.mLines.size(), (int)mLines.size());
+			if (job.mFirstLine < jobEnd)
+			{
+				mColorRangeMin = std::min(mColorRangeMin, job.mFirstLine);
+				mColorRangeMax = std::max(mColorRangeMax, jobEnd);
+			}
+			continue;
+		}
+
+		for (int i = 0; i < (int)job.mLines.size(); i++)
+		{
+			int lineIndex = job.mFirstLine + i;
+			if (lineIndex >= (int)mLines.size())
+				break;
+
+			// The revision changes with every edit to the line, so with the lines in place a match
+			// means the text is what was tokenized. Otherwise queue the index again.
+			auto& line = mLines[lineIndex];
+			const auto& colored = job.mLines[i];
+			if (line.mRevision != colored.mRevision || line.size() != colored.size())
+			{
+				mColorRangeMin = std::min(mColorRangeMin, lineIndex);
+				mColorRangeMax = std::max(mColorRangeMax, lineIndex + 1);
+				continue;
+			}
+			for (size_t j = 0; j < line.mGlyphs.size(); j++)
+				line.mGlyphs[j].mColorIndex = colored.mGlyphs[j].mColorIndex;
+			line.mColorizedRevision = line.mRevision;
+			line.BuildBrackets();
+			mFrameStats.mLinesColorized++;
+			if (mDocumentWordCompletion)
+				HarvestLineWords(line);
+		}
 	}
 }
 
+bool TextEditor::IsColorizationPending() const
+{
+	if (mColorRangeMin < mColorRangeMax)
+		return true;
+	if (mColorizeWorker == nullptr)
+		return false;
+	std::lock_guard<std::mutex> lock(mColorizeWorker->mMutex);
+	if (!mColorizeWorker->mQueued.empty() || mColorizeWorker->mBusy > 0)
+		return true;
+	for (const auto& job : mColorizeWorker->mFinished)
+	{
+		if (job.mOwner == mDocument.get())
+			return true;
+	}
+	return false;
+}
+
 const TextEditor::Palette& TextEditor::GetDarkPalette()
 {
 	const static Palette p = { {
@@ -3837,22 +6464,140 @@ std::string TextEditor::GetWordAt(const Coordinates& aCoords) const
 	
 	// Find word start
 	int wordStart = charIndex;
-	while (wordStart > 0 && CharIsWordChar(line[wordStart - 1].mChar))
+	while (wordStart > 0 && CharIsWordChar(line[wordStart - 1]))
 		wordStart--;
 	
 	// Find word end
 	int wordEnd = charIndex;
-	while (wordEnd < (int)line.size() && CharIsWordChar(line[wordEnd].mChar))
+	while (wordEnd < (int)line.size() && CharIsWordChar(line[wordEnd]))
 		wordEnd++;
 	
 	// Extract word
 	std::string word;
 	for (int i = wordStart; i < wordEnd; i++)
-		word += line[i].mChar;
+		word += line[i];
 	
 	return word;
 }
 
+static std::string FoldCase(const std::string& aWord)
+{
+	std::string folded = aWord;
+	std::transform(folded.begin(), folded.end(), folded.begin(), ::toupper);
+	return folded;
+}
+
+void TextEditor::CompletionIndex::Add(const std::string& aWord, bool aFoldCase)
+{
+	mEntries.push_back({ aFoldCase ? FoldCase(aWord) : aWord, aWord });
+}
+
+void TextEditor::CompletionIndex::Sort()
+{
+	std::sort(mEntries.begin(), mEntries.end());
+	mEntries.erase(std::unique(mEntries.begin(), mEntries.end()), mEntries.end());
+}
+
+void TextEditor::CompletionIndex::Collect(const std::string& aPrefix, std::vector<const std::string*>& aOut) const
+{
+	// the word typed so far is not offered again
+	auto it = std::lower_bound(mEntries.begin(), mEntries.end(), aPrefix,
+		[](const std::pair<std::string, std::string>& aEntry, const std::string& aKey) { return aEntry.first < aKey; });
+	for (; it != mEntries.end() && it->first.compare(0, aPrefix.size(), aPrefix) == 0; ++it)
+		if (it->first.size() != aPrefix.size())
+			aOut.push_back(&it->second);
+}
+
+void TextEditor::SetExtraKeywords(const std::vector<std::string>& keywords)
+{
+	mExtraKeywordIndex.mEntries.clear();
+	mExtraKeywordIndex.mEntries.reserve(keywords.size());
+	for (const auto& keyword : keywords)
+		mExtraKeywordIndex.Add(keyword, true);
+	mExtraKeywordIndex.Sort();
+}
+
+void TextEditor::SetDocumentWordCompletionEnabled(bool aValue)
+{
+	if (mDocumentWordCompletion == aValue)
+		return;
+	ClearDocumentWords();
+	mDocumentWordCompletion = aValue;
+	if (!aValue)
+		return;
+	// lines tokenized later are added as that happens
+	for (auto& line : mLines)
+		if (line.mColorizedRevision == line.mRevision)
+			HarvestLineWords(line);
+}
+
+void TextEditor::HarvestLineWords(Line& aLine)
+{
+	ReleaseLineWords(aLine);
+	auto& words = mDocumentWords;
+	for (int i = 0; i < (int)aLine.size();)
+	{
+		if (!CharIsWordChar(aLine[i]))
+		{
+			i++;
+			continue;
+		}
+		int start = i;
+		while (i < (int)aLine.size() && CharIsWordChar(aLine[i]))
+			i++;
+		PaletteIndex color = aLine.mGlyphs[start].GetColorIndex();
+		if (color != PaletteIndex::Identifier && color != PaletteIndex::KnownIdentifier)
+			continue;
+
+		std::string word = aLine.mText.substr(start, i - start);
+		auto found = words.mIds.find(word);
+		uint32_t id;
+		if (found != words.mIds.end())
+			id = found->second;
+		else
+		{
+			if (!words.mFreeIds.empty())
+			{
+				id = words.mFreeIds.back();
+				words.mFreeIds.pop_back();
+			}
+			else
+			{
+				id = (uint32_t)words.mWords.size();
+				words.mWords.emplace_back();
+			}
+			words.mWords[id] = { word, 0 };
+			words.mIds.emplace(word, id);
+		}
+		if (words.mWords[id].second++ == 0)
+			words.mByKey.insert({ FoldCase(word), word });
+		aLine.mWordIds.push_back(id);
+	}
+}
+
+void TextEditor::ReleaseLineWords(Line& aLine)
+{
+	auto& words = mDocumentWords;
+	for (uint32_t id : aLine.mWordIds)
+	{
+		auto& entry = words.mWords[id];
+		if (--entry.second > 0)
+			continue;
+		words.mByKey.erase({ FoldCase(entry.first), entry.first });
+		words.mIds.erase(entry.first);
+		entry.first.clear();
+		words.mFreeIds.push_back(id);
+	}
+	aLine.mWordIds.clear();
+}
+
+void TextEditor::ClearDocumentWords()
+{
+	mDocumentWords = DocumentWords();
+	for (auto& line : mLines)
+		line.mWordIds.clear();
+}
+
 void TextEditor::UpdateAutoComplete()
 {
 	// Get current cursor position and word
@@ -3868,16 +6613,14 @@ void TextEditor::UpdateAutoComplete()
 	
 	// Find word boundaries
 	int wordStart = charIndex;
-	while (wordStart > 0 && CharIsWordChar(line[wordStart - 1].mChar))
+	while (wordStart > 0 && CharIsWordChar(line[wordStart - 1]))
 		wordStart--;
 	
 	mAutoCompleteWordStart = Coordinates(coords.mLine, GetCharacterColumn(coords.mLine, wordStart));
 	mAutoCompleteWordEnd = coords;
 	
 	// Extract current partial word
-	std::string currentWord;
-	for (int i = wordStart; i < charIndex; i++)
-		currentWord += line[i].mChar;
+	std::string currentWord = line.mText.substr(wordStart, charIndex - wordStart);
 	
 	if (currentWord.empty())
 	{
@@ -3886,44 +6629,49 @@ void TextEditor::UpdateAutoComplete()
 		return;
 	}
 	
-	// Convert to uppercase for comparison if language is case-insensitive
-	std::string searchWord = currentWord;
-	if (mLanguageDefinition && !mLanguageDefinition->mCaseSensitive)
-	{
-		std::transform(searchWord.begin(), searchWord.end(), searchWord.begin(), ::toupper);
-	}
-	
-	// Find matching keywords
-	mAutoCompleteSuggestions.clear();
-	
-	// Check keywords from language definition
+	// Every source is sorted by its key, so only the words starting with the typed prefix are visited
+	std::string foldedWord = FoldCase(currentWord);
+	mAutoCompleteCandidates.clear();
 	if (mLanguageDefinition)
 	{
-		for (const auto& keyword : mLanguageDefinition->mKeywords)
+		if (mKeywordIndexLanguage != mLanguageDefinition)
 		{
-			std::string compareKeyword = keyword;
-			if (!mLanguageDefinition->mCaseSensitive)
-			{
-				std::transform(compareKeyword.begin(), compareKeyword.end(), compareKeyword.begin(), ::toupper);
-			}
-			
-			if (compareKeyword.find(searchWord) == 0 && compareKeyword != searchWord)
-			{
-				mAutoCompleteSuggestions.push_back(keyword);
-			}
+			mKeywordIndex.mEntries.clear();
+			for (const auto& keyword : mLanguageDefinition->mKeywords)
+				mKeywordIndex.Add(keyword, !mLanguageDefinition->mCaseSensitive);
+			mKeywordIndex.Sort();
+			mKeywordIndexLanguage = mLanguageDefinition;
 		}
+		mKeywordIndex.Collect(mLanguageDefinition->mCaseSensitive ? currentWord : foldedWord, mAutoCompleteCandidates);
 	}
-	
-	// Check extra keywords (table and column names) - case insensitive
-	for (const auto& keyword : mExtraKeywords)
+	mExtraKeywordIndex.Collect(foldedWord, mAutoCompleteCandidates);
+	if (mDocumentWordCompletion)
 	{
-		std::string upperKeyword = keyword;
-		std::transform(upperKeyword.begin(), upperKeyword.end(), upperKeyword.begin(), ::toupper);
-		if (upperKeyword.find(searchWord) == 0 && upperKeyword != searchWord)
-		{
-			mAutoCompleteSuggestions.push_back(keyword);
-		}
+		for (auto it = mDocumentWords.mByKey.lower_bound({ foldedWord, std::string() });
+			it != mDocumentWords.mByKey.end() && it->first.compare(0, foldedWord.size(), foldedWord) == 0; ++it)
+			if (it->first.size() != foldedWord.size())
+				mAutoCompleteCandidates.push_back(&it->second);
 	}
+
+	// Words matching the typed case first, then shorter ones, then alphabetical. A word is in at
+	// most three sources, so sorting three times the cap leaves enough after removing repeats.
+	auto ranksBefore = [&currentWord](const std::string* a, const std::string* b)
+	{
+		bool aSameCase = a->compare(0, currentWord.size(), currentWord) == 0;
+		bool bSameCase = b->compare(0, currentWord.size(), currentWord) == 0;
+		if (aSameCase != bSameCase)
+			return aSameCase;
+		if (a->size() != b->size())
+			return a->size() < b->size();
+		return *a < *b;
+	};
+	auto& candidates = mAutoCompleteCandidates;
+	size_t sorted = std::min(candidates.size(), (size_t)AUTOCOMPLETE_MAX_SUGGESTIONS * 3);
+	std::partial_sort(candidates.begin(), candidates.begin() + sorted, candidates.end(), ranksBefore);
+	mAutoCompleteSuggestions.clear();
+	for (size_t i = 0; i < sorted && (int)mAutoCompleteSuggestions.size() < AUTOCOMPLETE_MAX_SUGGESTIONS; i++)
+		if (mAutoCompleteSuggestions.empty() || mAutoCompleteSuggestions.back() != *candidates[i])
+			mAutoCompleteSuggestions.push_back(*candidates[i]);
 	
 	// Show auto-complete if we have suggestions
 	if (!mAutoCompleteSuggestions.empty())
@@ -4234,7 +6982,14 @@ void TextEditor::RenderFindReplacePanel(const ImVec2& aOrigin, const ImVec2& aSi
 		ImGui::PopStyleVar(3);
 		ImGui::PopID();
 
-		if (!mFindStatusMessage.empty())
+		if (mRegexFindJob != nullptr)
+		{
+			ImGui::Spacing();
+			ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled));
+			ImGui::Text(matchCount == 1 ? "%d match so far" : "%d matches so far", matchCount);
+			ImGui::PopStyleColor();
+		}
+		else if (!mFindStatusMessage.empty())
 		{
 			ImGui::Spacing();
 			ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled));
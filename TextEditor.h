@@ -2,8 +2,14 @@
 
 #include <cmath>
 #include <cassert>
+#include <cstdint>
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
+#include <functional>
+#include <set>
 #include <array>
 #include <memory>
 #include <unordered_set>
@@ -16,7 +22,16 @@ public:
 	// ------------- Exposed API ------------- //
 
 	TextEditor();
+	// Another view of a document (see GetDocument): text, colors, undo history, language and tab size
+	// are shared, cursors, scrolling, find panel and the other view settings are this view's own. Edits
+	// made through other views are caught up with by the next call that uses lines or cursors.
+	struct Document;
+	explicit TextEditor(const std::shared_ptr<Document>& aDocument);
 	~TextEditor();
+	// An editor owns its view state, another view of the same text is made from GetDocument
+	TextEditor(const TextEditor&) = delete;
+	TextEditor& operator=(const TextEditor&) = delete;
+	inline const std::shared_ptr<Document>& GetDocument() const { return mDocument; }
 
 	enum class PaletteId
 	{
@@ -41,12 +56,28 @@ public:
 	inline bool IsShowLineNumbersEnabled() const { return mShowLineNumbers; }
 	inline void SetShortTabsEnabled(bool aValue) { mShortTabs = aValue; }
 	inline bool IsShortTabsEnabled() const { return mShortTabs; }
+	// Tokenize on a worker thread instead of a few lines per frame inside Render. Off by default.
+	void SetBackgroundColorizationEnabled(bool aValue);
+	inline bool IsBackgroundColorizationEnabled() const { return mColorizeWorker != nullptr; }
+	// Time Render may spend tokenizing each frame; visible lines go first, at least a few lines are
+	// always done so colorization progresses. With background colorization only visible lines use it.
+	inline void SetColorizationBudget(int aMicroseconds) { mColorizeBudgetMicroseconds = aMicroseconds; }
+	inline int GetColorizationBudget() const { return mColorizeBudgetMicroseconds; }
+	// Tokenize large ranges on all cores, chunks of lines per thread. Frames spent on a freshly loaded
+	// file color many more lines within the same budget. Off by default.
+	inline void SetParallelColorizationEnabled(bool aValue) { mParallelColorization = aValue; if (!aValue) mColorizePool.reset(); }
+	inline bool IsParallelColorizationEnabled() const { return mParallelColorization; }
+	// Keep the text geometry of every visible line and replay it while the line, its colors and the
+	// view settings are unchanged, instead of laying the text out again each frame. Off by default.
+	inline void SetRetainedRenderingEnabled(bool aValue) { mRetainedRendering = aValue; mLineDrawCache.clear(); }
+	inline bool IsRetainedRenderingEnabled() const { return mRetainedRendering; }
 	inline int GetLineCount() const { return mLines.size(); }
 	void SetPalette(PaletteId aValue);
 	PaletteId GetPalette() const { return mPaletteId; }
 	void SetLanguageDefinition(LanguageDefinitionId aValue);
 	LanguageDefinitionId GetLanguageDefinition() const { return mLanguageDefinitionId; };
 	const char* GetLanguageDefinitionName() const;
+	// Columns in cursors, undo steps and edit events count tabs with it, so all views share it
 	void SetTabSize(int aValue);
 	inline int GetTabSize() const { return mTabSize; }
 	void SetLineSpacing(float aValue);
@@ -83,17 +114,80 @@ public:
 	inline bool CanUndo() const { return !mReadOnly && mUndoIndex > 0; };
 	inline bool CanRedo() const { return !mReadOnly && mUndoIndex < (int)mUndoBuffer.size(); };
 	inline int GetUndoIndex() const { return mUndoIndex; };
+	// Oldest undo steps are dropped once the history takes more than this many bytes. 0, the default,
+	// keeps everything.
+	void SetUndoMemoryBudget(size_t aBytes);
+	inline size_t GetUndoMemoryBudget() const { return mUndoMemoryBudget; }
+	inline size_t GetUndoMemoryUsage() const { return mUndoMemoryUsage; }
 
 	void SetText(const std::string& aText);
 	std::string GetText() const;
 
+	// Loads without the caller holding the text: the file is memory mapped and line breaks are found
+	// in one vectorized pass, split across threads for large inputs.
+	bool LoadFromFile(const char* aPath);
+	void LoadFromMemory(const char* aData, size_t aSize);
+	// Called with consecutive pieces of the text, returns false to stop.
+	typedef bool(*TextWriter)(const char* aData, size_t aSize, void* aUserData);
+	// Writes what GetText would return without building it, false if aWriter stopped.
+	bool SaveTo(TextWriter aWriter, void* aUserData) const;
+	bool SaveToFile(const char* aPath) const;
+	// The text of a region as it is stored, a piece per line and one per line break, nothing is copied.
+	// False if aWriter stopped.
+	bool ReadText(int aStartLine, int aStartChar, int aEndLine, int aEndChar, TextWriter aWriter, void* aUserData) const;
+	// Called with the index and text of each line, without its line break, returns false to stop.
+	typedef bool(*LineReader)(int aLine, std::string_view aText, void* aUserData);
+	// Lines from aFromLine up to aToLine, which is excluded, -1 for all the rest. False if aReader stopped.
+	bool ForEachLine(LineReader aReader, void* aUserData, int aFromLine = 0, int aToLine = -1) const;
+
+	// A binary image of the session: text, syntax colors, comment state, cursors, first visible line
+	// and, unless aWithUndo is false, the undo history. Loading one skips tokenizing when the language
+	// definition is the one it was saved with. The tab size is restored too, cursor and undo columns
+	// count tabs with it. Only meant to be read back by the same build: the byte order and format version
+	// are checked, as are the attributes and every undo step against the lines of the text, and a snapshot failing
+	// any check is refused, leaving the editor as it was.
+	bool SaveSnapshot(TextWriter aWriter, void* aUserData, bool aWithUndo = true) const;
+	bool SaveSnapshotToFile(const char* aPath, bool aWithUndo = true) const;
+	bool LoadSnapshot(const char* aData, size_t aSize);
+	bool LoadSnapshotFromFile(const char* aPath);
+
 	void SetTextLines(const std::vector<std::string>& aLines);
 	std::vector<std::string> GetTextLines() const;
 
 	bool Render(const char* aTitle, bool aParentIsFocused = false, const ImVec2& aSize = ImVec2(), bool aBorder = false);
 
+	// What the last Render call cost. Work done between frames, edits through the API for instance,
+	// is counted in the frame that follows.
+	struct PerformanceStats
+	{
+		float mInputMs = 0.0f; // keyboard and mouse handling
+		float mColorizeMs = 0.0f; // ColorizeInternal, the per frame colorization step
+		float mColorizeRangeMs = 0.0f; // tokenizing lines, inside or outside ColorizeInternal
+		float mFindMs = 0.0f; // RefreshFindResults
+		float mRenderMs = 0.0f; // laying out and drawing the text
+		int mTextDrawCalls = 0; // AddText calls
+		int mDrawCommands = 0; // draw commands and vertices added to the window draw list
+		int mVertices = 0;
+		int mLinesColorized = 0; // lines whose tokens were recomputed or taken from the worker
+		int mColorizeBacklog = 0; // lines still waiting for tokens, mColorRangeMin..mColorRangeMax
+	};
+	inline const PerformanceStats& GetPerformanceStats() const { return mStats; }
+	struct MemoryStats
+	{
+		size_t mLines = 0; // text, attributes and per line caches
+		size_t mUndo = 0;
+		size_t mFindHighlights = 0; // find results and the per line highlight cache
+	};
+	// Walks every line, meant for diagnostics rather than every frame.
+	MemoryStats EstimateMemoryUsage() const;
+
 	void ImGuiDebugPanel(const std::string& panelName = "Debug");
 	void UnitTests();
+	// Times loading, colorizing, find/replace, paste, multi-cursor typing and undo/redo on generated text
+	// of 1k, 100k and 1M lines, up to aMaxLines, and returns the timings as JSON. Replaces the text and
+	// history, so run it on an editor of its own. Paste goes through the ImGui clipboard, so a context
+	// must exist; no frame is needed. The clipboard is put back afterwards.
+	std::string Benchmarks(int aMaxLines = 1000000);
 	// ------------- Generic utils ------------- //
 
 	static inline ImVec4 U32ColorToVec4(ImU32 in)
@@ -228,6 +322,25 @@ public:
 		}
 	};
 
+	// One change to the text: what was between mStart and mEnd is now mText, inserts have mStart == mEnd.
+	// Applied in the order received to a copy of the text before them, events reproduce the document.
+	// mText is only valid during the call and mVersion is the document version after the change. Commands
+	// that edit several places, such as line moves, indenting, several cursors or ReplaceAll, report their
+	// changes once the command is done, so all of their events carry the version after the whole command.
+	struct EditEvent
+	{
+		Coordinates mStart;
+		Coordinates mEnd;
+		std::string_view mText;
+		uint32_t mVersion;
+	};
+	// Called after each change from any view of the document, must not edit it or change its listeners.
+	typedef std::function<void(const EditEvent&)> EditListener;
+	int AddEditListener(EditListener aListener);
+	void RemoveEditListener(int aId);
+	// Grows with every change to the text, an unchanged version means unchanged text.
+	inline uint32_t GetDocumentVersion() const { return mDocumentVersion; }
+
 	struct Cursor
 	{
 		Coordinates mInteractiveStart = { 0, 0 };
@@ -247,6 +360,27 @@ public:
 		void SortCursorsFromTopToBottom();
 	};
 
+	// An EditorState stored against another one: cursors moved by the same amount with their selection
+	// kept are grouped into runs, only the others are stored whole.
+	struct EditorStateDelta
+	{
+		struct Run
+		{
+			int mFirst;
+			int mCount;
+			int mLineShift;
+			int mColumnShift;
+		};
+
+		int mCurrentCursor = 0;
+		int mLastAddedCursor = 0;
+		std::vector<Run> mRuns;
+		std::vector<std::pair<int, Cursor>> mCursors;
+
+		void Build(const EditorState& aFrom, const EditorState& aTo);
+		void ApplyTo(EditorState& aState) const;
+	};
+
 	struct Identifier
 	{
 		Coordinates mLocation;
@@ -256,19 +390,235 @@ public:
 	typedef std::unordered_map<std::string, Identifier> Identifiers;
 	typedef std::array<ImU32, (unsigned)PaletteIndex::Max> Palette;
 
+	// Syntax attributes of a single byte of text, packed into one byte.
+	// Only syntax colors (below PaletteIndex::Background) are ever stored.
 	struct Glyph
 	{
-		char mChar;
-		PaletteIndex mColorIndex = PaletteIndex::Default;
-		bool mComment : 1;
-		bool mMultiLineComment : 1;
-		bool mPreprocessor : 1;
-
-		Glyph(char aChar, PaletteIndex aColorIndex) : mChar(aChar), mColorIndex(aColorIndex),
-			mComment(false), mMultiLineComment(false), mPreprocessor(false) {}
+		uint8_t mColorIndex : 4;
+		uint8_t mComment : 1;
+		uint8_t mMultiLineComment : 1;
+		uint8_t mPreprocessor : 1;
+
+		Glyph() : mColorIndex((uint8_t)PaletteIndex::Default), mComment(0), mMultiLineComment(0), mPreprocessor(0) {}
+		inline PaletteIndex GetColorIndex() const { return (PaletteIndex)mColorIndex; }
+		inline void SetColorIndex(PaletteIndex aValue) { mColorIndex = (uint8_t)aValue; }
+		inline bool operator ==(const Glyph& o) const
+		{
+			return mColorIndex == o.mColorIndex && mComment == o.mComment &&
+				mMultiLineComment == o.mMultiLineComment && mPreprocessor == o.mPreprocessor;
+		}
+		inline bool operator !=(const Glyph& o) const { return !(*this == o); }
+	};
+	static_assert(sizeof(Glyph) == 1, "Glyph attributes must stay one byte");
+	static_assert((int)PaletteIndex::Background <= 16, "syntax colors must fit in Glyph::mColorIndex");
+
+	// A find match, kept by the line it starts on so it moves with the line when lines above are
+	// inserted or removed. Character indices; mEnd is on the line mEndLine lines further down.
+	struct FindOccurrence
+	{
+		int mStart = 0;
+		int mEnd = 0;
+		int mEndLine = 0;
+		uint16_t mFindIndex = 0; // FindIndex::mSlot of the view whose pattern this matches
+		bool mWordBoundaryBefore = true;
+		bool mWordBoundaryAfter = true;
+	};
+
+	// A line of text: raw UTF-8 bytes kept contiguous so they can be scanned, tokenized and copied
+	// directly, plus one Glyph of attributes per byte. All edits go through the methods below so
+	// both arrays stay the same length.
+	struct Line
+	{
+		std::string mText;
+		std::vector<Glyph> mGlyphs;
+		uint8_t mEntryState = 0; // comment/string/preprocessor scan state at the start of the line, see ColorizeInternal
+		uint32_t mRevision = 0; // document version of the last edit to this line, lets stale background colors be dropped
+		uint32_t mColorizedRevision = kNeverColorized; // mRevision when the tokens were last computed
+		std::vector<FindOccurrence> mFindOccurrences; // every plain-text match of each view's find pattern starting here, see UpdateFindIndex
+		std::vector<uint32_t> mWordIds; // identifiers of the line in the document word list, see HarvestLineWords
+
+		// Start byte and column of every tab and multi-byte character, the only characters that do not
+		// advance the column by one per byte; in between, index and column advance together. Built on
+		// the first column query and dropped by edits and by Render once the line scrolls out of view;
+		// left empty when the line is plain ASCII without tabs, and kept through edits that leave it
+		// so. Queries fill these in, so a Line is not to be read from several threads at once;
+		// background work runs on copies.
+		struct ColumnBreak
+		{
+			int mIndex;
+			int mColumn;
+		};
+		mutable std::vector<ColumnBreak> mColumnBreaks;
+		mutable int mColumnsTabSize = 0; // tab size mColumnBreaks was built for, 0 when not built
+		mutable bool mPlainColumns = false;
+
+		// Brackets outside strings and comments, by kind ('(' '[' '{'): opens minus closes over the line,
+		// and the lowest that count gets scanning from the start (0 or below). Lets bracket matching
+		// step over whole lines. Built when the line is tokenized, valid while the line, its colors and
+		// its comment entry state are the ones it was built from.
+		int mBracketDelta[3] = {};
+		int mBracketLowest[3] = {};
+		uint32_t mBracketsRevision = kNeverColorized;
+		uint8_t mBracketsEntryState = 0;
+
+		static constexpr uint32_t kNeverColorized = 0xffffffffu;
+
+		Line() {}
+		Line(const char* aBegin, const char* aEnd) : mText(aBegin, aEnd), mGlyphs(aEnd - aBegin) {}
+
+		inline size_t size() const { return mText.size(); }
+		inline bool empty() const { return mText.empty(); }
+		inline char operator[](size_t aIndex) const { return mText[aIndex]; }
+
+		inline void Insert(size_t aIndex, char aChar)
+		{
+			mText.insert(mText.begin() + aIndex, aChar);
+			mGlyphs.insert(mGlyphs.begin() + aIndex, Glyph());
+			if (!mPlainColumns || aChar == '\t' || (aChar & 0x80) != 0)
+				mColumnsTabSize = 0;
+		}
+		inline void Insert(size_t aIndex, const char* aBegin, const char* aEnd)
+		{
+			mText.insert(aIndex, aBegin, aEnd - aBegin);
+			mGlyphs.insert(mGlyphs.begin() + aIndex, aEnd - aBegin, Glyph());
+			if (!mPlainColumns || !IsPlainText(aBegin, aEnd))
+				mColumnsTabSize = 0;
+		}
+		inline void Insert(size_t aIndex, const Line& aSource, size_t aSourceStart, size_t aSourceEnd)
+		{
+			mText.insert(aIndex, aSource.mText, aSourceStart, aSourceEnd - aSourceStart);
+			mGlyphs.insert(mGlyphs.begin() + aIndex, aSource.mGlyphs.begin() + aSourceStart, aSource.mGlyphs.begin() + aSourceEnd);
+			if (!mPlainColumns || !IsPlainText(aSource.mText.data() + aSourceStart, aSource.mText.data() + aSourceEnd))
+				mColumnsTabSize = 0;
+		}
+		inline void Append(const char* aBegin, const char* aEnd) { Insert(size(), aBegin, aEnd); }
+		inline void Erase(size_t aStart, size_t aEnd)
+		{
+			mText.erase(aStart, aEnd - aStart);
+			mGlyphs.erase(mGlyphs.begin() + aStart, mGlyphs.begin() + aEnd);
+			if (!mPlainColumns)
+				mColumnsTabSize = 0;
+		}
+		// No tab and no byte of a multi-byte character in [aBegin, aEnd)
+		static bool IsPlainText(const char* aBegin, const char* aEnd);
+		inline void Reserve(size_t aSize)
+		{
+			mText.reserve(aSize);
+			mGlyphs.reserve(aSize);
+		}
+
+		inline void EnsureColumns(int aTabSize) const
+		{
+			if (mColumnsTabSize != aTabSize)
+				BuildColumns(aTabSize);
+		}
+		void BuildColumns(int aTabSize) const;
+		inline bool HasColumnBreaks() const { return !mColumnBreaks.empty(); }
+		inline void DropColumns() const
+		{
+			std::vector<ColumnBreak>().swap(mColumnBreaks);
+			mColumnsTabSize = 0;
+		}
+
+		inline void EnsureBrackets()
+		{
+			if (mBracketsRevision != mRevision || mBracketsEntryState != mEntryState)
+				BuildBrackets();
+		}
+		void BuildBrackets();
+		// EnsureColumns first. Column of byte aIndex, 0 <= aIndex <= size(); the bytes of a character
+		// share its column.
+		inline int ColumnAt(int aIndex) const { return mPlainColumns ? aIndex : ColumnAtBreaks(aIndex); }
+		// EnsureColumns first. First character starting at or after aColumn, size() past the end.
+		inline int IndexAtColumn(int aColumn) const
+		{
+			if (mPlainColumns)
+				return aColumn < 0 ? 0 : aColumn < (int)size() ? aColumn : (int)size();
+			return IndexAtColumnBreaks(aColumn);
+		}
+		int ColumnAtBreaks(int aIndex) const;
+		int IndexAtColumnBreaks(int aColumn) const;
+		void GetBreakEnd(const ColumnBreak& aBreak, int& outIndex, int& outColumn) const;
 	};
 
-	typedef std::vector<Glyph> Line;
+	// Document line container. Lines are kept in chunks of a few hundred with a Fenwick tree over
+	// the chunk sizes, so inserting or removing a line is O(log n) instead of shifting every line
+	// after it. Sequential access hits a cached chunk and stays O(1). Mirrors the subset of the
+	// std::vector interface the editor uses; references are invalidated by insert/erase.
+	class LineStore
+	{
+	public:
+		template<typename TStore, typename TLine>
+		class Iterator
+		{
+		public:
+			Iterator(TStore* aStore, size_t aChunk, size_t aOffset) : mStore(aStore), mChunk(aChunk), mOffset(aOffset) {}
+			TLine& operator*() const { return mStore->mChunks[mChunk][mOffset]; }
+			TLine* operator->() const { return &mStore->mChunks[mChunk][mOffset]; }
+			Iterator& operator++()
+			{
+				if (++mOffset == mStore->mChunks[mChunk].size())
+				{
+					mOffset = 0;
+					++mChunk;
+				}
+				return *this;
+			}
+			bool operator==(const Iterator& o) const { return mChunk == o.mChunk && mOffset == o.mOffset; }
+			bool operator!=(const Iterator& o) const { return !(*this == o); }
+		private:
+			TStore* mStore;
+			size_t mChunk;
+			size_t mOffset;
+		};
+		typedef Iterator<LineStore, Line> iterator;
+		typedef Iterator<const LineStore, const Line> const_iterator;
+
+		inline size_t size() const { return mSize; }
+		inline bool empty() const { return mSize == 0; }
+		inline Line& operator[](size_t aIndex) { Locate(aIndex); return mChunks[mCacheChunk][aIndex - mCacheStart]; }
+		inline const Line& operator[](size_t aIndex) const { Locate(aIndex); return mChunks[mCacheChunk][aIndex - mCacheStart]; }
+		inline Line& back() { return mChunks.back().back(); }
+		inline const Line& back() const { return mChunks.back().back(); }
+
+		iterator begin() { return iterator(this, 0, 0); }
+		iterator end() { return iterator(this, mChunks.size(), 0); }
+		const_iterator begin() const { return const_iterator(this, 0, 0); }
+		const_iterator end() const { return const_iterator(this, mChunks.size(), 0); }
+
+		void clear();
+		void resize(size_t aCount);
+		Line& emplace_back(Line&& aLine = Line());
+		void push_back(Line&& aLine) { emplace_back(std::move(aLine)); }
+		Line& insert(size_t aIndex, Line&& aLine = Line());
+		void erase(size_t aIndex) { erase(aIndex, aIndex + 1); }
+		void erase(size_t aStart, size_t aEnd);
+
+	private:
+		static constexpr size_t kChunkSize = 256;
+		static constexpr size_t kMaxChunkSize = 2 * kChunkSize;
+		static constexpr size_t kMinChunkSize = kChunkSize / 4;
+
+		inline void Locate(size_t aIndex) const
+		{
+			assert(aIndex < mSize);
+			if (aIndex - mCacheStart < mChunks[mCacheChunk].size()) // wraps around when aIndex < mCacheStart
+				return;
+			LocateSlow(aIndex);
+		}
+		void LocateSlow(size_t aIndex) const;
+		void RebuildIndex() const;
+		void AddToIndex(size_t aChunk, int aDelta);
+		void SplitChunk(size_t aChunk);
+		void MergeChunk(size_t aChunk);
+
+		std::vector<std::vector<Line>> mChunks;
+		mutable std::vector<int> mIndex; // Fenwick tree over chunk sizes, one-based
+		mutable bool mIndexDirty = false;
+		size_t mSize = 0;
+		mutable size_t mCacheChunk = 0;
+		mutable size_t mCacheStart = 0;
+	};
 
 	struct LanguageDefinition
 	{
@@ -285,6 +635,35 @@ public:
 		std::vector<TokenRegexString> mTokenRegexStrings;
 		bool mCaseSensitive = true;
 
+		// Perfect hash over mKeywords, mIdentifiers and mPreprocIdentifiers so an identifier token is
+		// classified with one probe and no allocation; case is folded on the fly when mCaseSensitive is
+		// false. Built once when the definition is set up, the containers above keep the declarations.
+		class KeywordTable
+		{
+		public:
+			enum : uint8_t { Keyword = 1 << 0, KnownIdentifier = 1 << 1, PreprocIdentifier = 1 << 2 };
+
+			void Build(const LanguageDefinition& aDefinition);
+			uint8_t Lookup(std::string_view aWord) const;
+
+		private:
+			struct Slot
+			{
+				uint32_t mOffset = 0;
+				uint32_t mLength = 0; // 0 marks an empty slot
+				uint8_t mClasses = 0;
+			};
+
+			uint64_t Hash(std::string_view aWord) const;
+
+			std::vector<uint16_t> mDisplacements; // per bucket, picks the slot for every word in it
+			std::vector<Slot> mSlots; // power of two sized
+			std::string mWords; // all words back to back, upper case when folding
+			uint64_t mSeed = 0;
+			bool mFoldCase = false;
+		};
+		KeywordTable mKeywordTable;
+
 		static const LanguageDefinition& Cpp();
 		static const LanguageDefinition& Hlsl();
 		static const LanguageDefinition& Glsl();
@@ -320,11 +699,17 @@ public:
 
 		void Undo(TextEditor* aEditor);
 		void Redo(TextEditor* aEditor);
+		void SetAfter(const EditorState& aAfter) { mAfter.Build(mBefore, aAfter); }
+		bool IsSingleCharacterEdit() const;
+		bool TryMerge(const UndoRecord& aNext);
+		size_t GetMemorySize() const;
 
 		std::vector<UndoOperation> mOperations;
 
 		EditorState mBefore;
-		EditorState mAfter;
+		EditorStateDelta mAfter; // against mBefore
+		bool mMergeable = false; // a run of typed or backspaced characters, see TryMerge
+		size_t mMemorySize = 0;
 	};
 
 	std::string GetText(const Coordinates& aStart, const Coordinates& aEnd) const;
@@ -359,6 +744,7 @@ public:
 	void SelectNextOccurrenceOf(const char* aText, int aTextSize, int aCursor = -1, bool aCaseSensitive = true);
 	void AddCursorForNextOccurrence(bool aCaseSensitive = true);
 	bool FindNextOccurrence(const char* aText, int aTextSize, const Coordinates& aFrom, Coordinates& outStart, Coordinates& outEnd, bool aCaseSensitive = true);
+	int FindLiteralInLine(int aLine, int aFromIndex, std::string_view aText, bool aCaseSensitive, int& outEndLine, int& outEndIndex) const;
 	bool FindMatchingBracket(int aLine, int aCharIndex, Coordinates& out);
 	void ChangeCurrentLinesIndentation(bool aIncrease);
 	void MoveUpCurrentLines();
@@ -380,22 +766,31 @@ public:
 	int GetFirstVisibleCharacterIndex(int aLine) const;
 	int GetLineMaxColumn(int aLine, int aLimit = -1) const;
 
-	Line& InsertLine(int aIndex);
+	Line& InsertLine(int aIndex, bool aMoveCursors = true);
 	void RemoveLine(int aIndex, const std::unordered_set<int>* aHandledCursors = nullptr);
 	void RemoveLines(int aStart, int aEnd);
 	void DeleteRange(const Coordinates& aStart, const Coordinates& aEnd);
 	void DeleteSelection(int aCursor = -1);
 
 	void RemoveGlyphsFromLine(int aLine, int aStartChar, int aEndChar = -1);
-	void AddGlyphsToLine(int aLine, int aTargetIndex, Line::iterator aSourceStart, Line::iterator aSourceEnd);
-	void AddGlyphToLine(int aLine, int aTargetIndex, Glyph aGlyph);
+	void AddGlyphsToLine(int aLine, int aTargetIndex, const Line& aSource, int aSourceStart, int aSourceEnd);
+	void AddGlyphToLine(int aLine, int aTargetIndex, char aChar);
 	ImU32 GetGlyphColor(const Glyph& aGlyph) const;
 
 	void HandleKeyboardInputs(bool aParentIsFocused = false);
 	void HandleMouseInputs();
 	void UpdateViewVariables(float aScrollX, float aScrollY);
 	void Render(bool aParentIsFocused = false);
+	void RenderLineText(ImDrawList* aDrawList, int aLineNo, const ImVec2& aTextScreenPos, float aFontHeight, float aSpaceSize);
+	void RenderLineTextRetained(ImDrawList* aDrawList, int aLineNo, const ImVec2& aTextScreenPos, float aFontHeight, float aSpaceSize);
+	uint64_t HashLineDrawSettings(const ImFont* aFont, ImTextureID aTexture, float aFontHeight, float aSpaceSize) const;
 	// struct LineHighlight;
+	struct SearchResult
+	{
+		Coordinates mStart;
+		Coordinates mEnd;
+	};
+
 	void RenderFindReplacePanel(const ImVec2& aOrigin, const ImVec2& aSize, bool aParentIsFocused);
 
 	void RefreshFindResults(bool aPreserveSelection = true);
@@ -404,10 +799,21 @@ public:
 	void FindNext(bool aBackwards = false);
 	void ReplaceCurrent();
 	int ReplaceAll();
+	void ReplaceRanges(const std::vector<SearchResult>& aRanges, const char* aText);
 	bool IsWholeWordMatch(const Coordinates& aStart, const Coordinates& aEnd) const;
 	Coordinates AdvanceCoordinates(const Coordinates& aCoords) const;
-	const std::vector<LineHighlight>* GetFindHighlightsForLine(int aLineNumber) const;
+	const std::vector<LineHighlight>* GetFindHighlightsForLine(int aLineNumber);
 	void EnsureFindResultsUpToDate();
+	bool UpdateFindIndex(const std::string& aPattern, bool aCaseSensitive, int& outFromLine, int& outToLine);
+	void SpliceFindResults(int aFromLine, int aToLine, bool aWholeWord);
+	void AddFindResult(int aLine, const FindOccurrence& aOccurrence);
+	void DropFindColumns(size_t aFirstResult);
+	void ApplyRegexFindResults();
+	void WaitForFindResults();
+	void CancelRegexFind();
+	void InvalidateFindLines(int aFromLine, int aToLine);
+	void ShiftFindLines(int aIndex, int aLineCountDelta);
+	void InvalidateFindIndexes();
 	bool TryGetSelectionBounds(Coordinates& outStart, Coordinates& outEnd) const;
 	void MarkFindResultsDirty(bool deferRefresh = false);
 
@@ -415,26 +821,63 @@ public:
 	void OnLineChanged(bool aBeforeChange, int aLine, int aColumn, int aCharCount, bool aDeleted);
 	void MergeCursorsIfPossible();
 
+	// Edits at every cursor that rebuild each touched line once instead of once per cursor.
+	// The cursors must be sorted from top to bottom and merged, see EnterCharacter and Delete.
+	void InsertAtCursors(const char* aText, UndoRecord& aUndo);
+	void SplitLinesAtCursors(UndoRecord& aUndo);
+	bool DeleteSelectionsInLines(UndoRecord& aUndo);
+	int AdvanceColumn(int aColumn, const char* aBegin, const char* aEnd) const;
+
 	// Auto-complete
 	void UpdateAutoComplete();
 	void RenderAutoComplete();
 	void AcceptAutoComplete();
 	std::string GetWordAt(const Coordinates& aCoords) const;
 	std::string GetCurrentWord() const;
-	void SetExtraKeywords(const std::vector<std::string>& keywords) { mExtraKeywords = keywords; }
+	void SetExtraKeywords(const std::vector<std::string>& keywords);
+	// Also offer the identifiers already in the document, collected from the lines as they are
+	// tokenized. Off by default.
+	void SetDocumentWordCompletionEnabled(bool aValue);
+	inline bool IsDocumentWordCompletionEnabled() const { return mDocumentWordCompletion; }
 
 	void AddUndo(UndoRecord& aValue);
+	void TrimUndoBuffer();
+	void ClearUndoBuffer();
+	void EmitEditEvent(const Coordinates& aStart, const Coordinates& aEnd, std::string_view aText);
+	int mEditEventsHeld = 0; // > 0 while an edit recording undo runs, its operations are sent from AddUndo
+	// Events are built for the listeners and for the other views of the document, which follow them
+	inline bool HasEditObservers() const { return !mEditListeners.empty() || mViews.size() > 1; }
+	void FollowEdit(const EditEvent& aEvent);
 
 	void Colorize(int aFromLine = 0, int aCount = -1);
 	void ColorizeRange(int aFromLine = 0, int aToLine = 0);
 	void ColorizeInternal();
+	uint8_t ColorizeCommentsInLine(Line& aLine, uint8_t aEntryState);
+	void InvalidateCommentState(int aFromLine, int aToLine);
+	void ShiftCommentStateRange(int aIndex, int aLineCountDelta);
+
+	// Document state under the names the editor code uses, bound to mDocument for the editor's lifetime
+	std::shared_ptr<Document> mDocument;
+	LineStore& mLines = mDocument->mLines;
+	std::deque<UndoRecord>& mUndoBuffer = mDocument->mUndoBuffer;
+	int& mUndoIndex = mDocument->mUndoIndex;
+	size_t& mUndoMemoryUsage = mDocument->mUndoMemoryUsage;
+	size_t& mUndoMemoryBudget = mDocument->mUndoMemoryBudget;
+	int& mColorRangeMin = mDocument->mColorRangeMin;
+	int& mColorRangeMax = mDocument->mColorRangeMax;
+	bool& mCheckComments = mDocument->mCheckComments;
+	int& mCheckCommentsFromLine = mDocument->mCheckCommentsFromLine;
+	int& mCheckCommentsToLine = mDocument->mCheckCommentsToLine;
+	uint32_t& mDocumentVersion = mDocument->mDocumentVersion;
+	uint32_t& mLineLayoutVersion = mDocument->mLineLayoutVersion;
+	std::vector<std::pair<int, EditListener>>& mEditListeners = mDocument->mEditListeners;
+	std::vector<TextEditor*>& mViews = mDocument->mViews;
+	LanguageDefinitionId& mLanguageDefinitionId = mDocument->mLanguageDefinitionId;
+	const LanguageDefinition*& mLanguageDefinition = mDocument->mLanguageDefinition;
+	int& mTabSize = mDocument->mTabSize;
 
-	std::vector<Line> mLines;
 	EditorState mState;
-	std::vector<UndoRecord> mUndoBuffer;
-	int mUndoIndex = 0;
 
-	int mTabSize = 4;
 	float mLineSpacing = 1.0f;
 	bool mReadOnly = false;
 	bool mAutoIndent = true;
@@ -457,6 +900,8 @@ public:
 	ImVec2 mLastClickPos;
 	int mFirstVisibleLine = 0;
 	int mLastVisibleLine = 0;
+	int mColumnsFirstLine = 0; // visible lines of the last frame, see Line::mColumnBreaks
+	int mColumnsLastLine = -1;
 	int mVisibleLineCount = 0;
 	int mFirstVisibleColumn = 0;
 	int mLastVisibleColumn = 0;
@@ -469,16 +914,18 @@ public:
 	bool mDraggingSelection = false;
 	ImVec2 mLastMousePos;
 	bool mCursorPositionChanged = false;
+	std::vector<std::pair<int, int>> mLineChangedCursors; // cursor and its char index after the change, see OnLineChanged
 	bool mCursorOnBracket = false;
 	Coordinates mMatchingBracketCoords;
 
-	int mColorRangeMin = 0;
-	int mColorRangeMax = 0;
-	bool mCheckComments = true;
+	int mColorizeBudgetMicroseconds = 4000;
+	bool mParallelColorization = false;
+	struct ColorizePool;
+	std::shared_ptr<ColorizePool> mColorizePool; // threads for ColorizeRange, started by the first parallel range
+	float mColorizeLinesPerMicrosecond = 0.0f; // last measured parallel rate, sizes the next step to the budget
+	uint32_t mViewDocumentVersion = 0; // mDocumentVersion this view last caught up with, see SyncWithDocument
 	PaletteId mPaletteId;
 	Palette mPalette;
-	LanguageDefinitionId mLanguageDefinitionId;
-	const LanguageDefinition* mLanguageDefinition = nullptr;
 
 	inline bool IsHorizontalScrollbarVisible() const { return mCurrentSpaceWidth > mContentWidth; }
 	inline bool IsVerticalScrollbarVisible() const { return mCurrentSpaceHeight > mContentHeight; }
@@ -494,13 +941,64 @@ public:
 
 private:
 	struct RegexList;
-	std::shared_ptr<RegexList> mRegexList;
+	std::shared_ptr<RegexList>& mRegexList = mDocument->mRegexList;
+	static std::shared_ptr<RegexList> GetRegexList(const LanguageDefinition* aLanguageDefinition);
+	void SyncWithDocument();
+	// Steps a history loaded from a snapshot over a text of aLineCount lines and clamps its cursors to
+	// the lines they come back with; false at the first operation that does not fit the text.
+	static bool FitsHistory(std::vector<UndoRecord>& aRecords, std::vector<EditorState>& aAfterStates, int aUndoIndex, int aLineCount);
+
+	struct LineDrawCache
+	{
+		uint64_t mKey = 0; // visible text and attributes, matching bracket, sub-pixel origin
+		bool mValid = false;
+		std::vector<ImDrawVert> mVertices; // relative to the text origin of the line
+		std::vector<ImDrawIdx> mIndices; // relative to the first vertex
+	};
+	PerformanceStats mStats; // last frame
+	PerformanceStats mFrameStats; // frame in progress
+	std::vector<PerformanceStats> mStatsHistory; // ring of the last frames for the debug panel
+	int mStatsHistoryNext = 0;
+
+	bool mRetainedRendering = false;
+	uint64_t mLineDrawCacheSettings = 0;
+	std::unordered_map<int, LineDrawCache> mLineDrawCache; // by line number, visible lines only
+
+	// Words offered by auto-complete, sorted by key so the words starting with a prefix are one
+	// contiguous range. The key is the word in upper case when matching ignores case.
+	struct CompletionIndex
+	{
+		std::vector<std::pair<std::string, std::string>> mEntries; // key, word
+		void Add(const std::string& aWord, bool aFoldCase);
+		void Sort();
+		void Collect(const std::string& aPrefix, std::vector<const std::string*>& aOut) const;
+	};
+	CompletionIndex mExtraKeywordIndex; // table and column names, always matched ignoring case
+	CompletionIndex mKeywordIndex;
+	const LanguageDefinition* mKeywordIndexLanguage = nullptr; // mKeywordIndex is built for this one
 
-	struct SearchResult
+	// Identifiers in the document with how often they occur. Lines keep the ids of theirs so a
+	// retokenized or removed line gives them back.
+	struct DocumentWords
 	{
-		Coordinates mStart;
-		Coordinates mEnd;
+		std::unordered_map<std::string, uint32_t> mIds;
+		std::vector<std::pair<std::string, int>> mWords; // word and occurrence count, by id
+		std::vector<uint32_t> mFreeIds;
+		std::set<std::pair<std::string, std::string>> mByKey; // upper case key and word of every word that occurs
 	};
+	bool& mDocumentWordCompletion = mDocument->mDocumentWordCompletion;
+	DocumentWords& mDocumentWords = mDocument->mDocumentWords;
+	void HarvestLineWords(Line& aLine);
+	void ReleaseLineWords(Line& aLine);
+	void ClearDocumentWords();
+
+	struct ColorizeJob;
+	struct ColorizeWorker;
+	std::shared_ptr<ColorizeWorker>& mColorizeWorker = mDocument->mColorizeWorker;
+	static void ColorizeLine(Line& aLine, const LanguageDefinition& aLanguageDefinition, const RegexList& aRegexList);
+	void SubmitColorizeJobs();
+	void ApplyColorizeResults();
+	bool IsColorizationPending() const;
 
 
 
@@ -510,7 +1008,7 @@ private:
 	int mAutoCompleteSelectedIndex = -1;
 	Coordinates mAutoCompleteWordStart;
 	Coordinates mAutoCompleteWordEnd;
-	std::vector<std::string> mExtraKeywords;
+	std::vector<const std::string*> mAutoCompleteCandidates;
 
 	// Find & replace members
 	bool mShowFindPanel = false;
@@ -523,8 +1021,7 @@ private:
 	bool mFindSelectionOnly = false;
 	bool mFindResultsDirty = true;
 	int mFindResultIndex = -1;
-	int mFindLastUndoIndex = -1;
-	int mFindLastUndoBufferSize = -1;
+	uint32_t mFindLastDocumentVersion = 0;
 	char mFindBuffer[256];
 	char mReplaceBuffer[256];
 	std::vector<SearchResult> mFindResults;
@@ -536,4 +1033,76 @@ private:
 	Coordinates mFindSelectionRangeEnd;
 	bool mFindRefreshPending = false;
 	float mFindRefreshTimer = 0.0f;
+	int mFindMaxLineSpan = 0; // most lines a current result spans, bounds the look-back for highlights
+	// What mFindResults were last found with. While it still holds, a refresh after edits only searches
+	// the lines they touched again, see SpliceFindResults.
+	struct FindResultsBasis
+	{
+		bool mValid = false;
+		bool mWholeWord = false;
+		int mTabSize = 0;
+		int mLineCount = 0;
+		uint32_t mFindIndexUpdates = 0;
+	};
+	FindResultsBasis mFindResultsBasis;
+	// A view's per line find index: the occurrences tagged with mSlot in Line::mFindOccurrences match
+	// mPattern outside the dirty lines. Edits through any view mark the lines dirty in every index, so
+	// views searching for different patterns each rescan only what was edited.
+	struct FindIndex
+	{
+		uint16_t mSlot = 0;
+		bool mInUse = false;
+		bool mValid = false;
+		std::string mPattern;
+		bool mCaseSensitive = false;
+		bool mLinesDirty = false;
+		int mDirtyFromLine = 0;
+		int mDirtyToLine = 0;
+		uint32_t mUpdates = 0; // bumped whenever UpdateFindIndex scans lines again
+	};
+	FindIndex& ClaimFindIndex();
+	FindIndex& mFindIndex = ClaimFindIndex();
+	bool& mFindIndexValid = mFindIndex.mValid;
+	std::string& mFindIndexPattern = mFindIndex.mPattern;
+	bool& mFindIndexCaseSensitive = mFindIndex.mCaseSensitive;
+	bool& mFindLinesDirty = mFindIndex.mLinesDirty;
+	int& mFindDirtyFromLine = mFindIndex.mDirtyFromLine;
+	int& mFindDirtyToLine = mFindIndex.mDirtyToLine;
+	uint32_t& mFindIndexUpdates = mFindIndex.mUpdates;
+	struct RegexFindJob;
+	std::shared_ptr<RegexFindJob> mRegexFindJob; // regex search still streaming matches into mFindResults
+	struct RegexFindWorker;
+	std::shared_ptr<RegexFindWorker> mRegexFindWorker; // started by the first regex search
+
+public:
+	// The text and what is derived from it alone, shared by every view of it
+	struct Document
+	{
+		LineStore mLines;
+		std::deque<UndoRecord> mUndoBuffer;
+		int mUndoIndex = 0;
+		size_t mUndoMemoryUsage = 0; // sum of mMemorySize over mUndoBuffer
+		size_t mUndoMemoryBudget = 0; // unbounded unless the host sets one
+
+		int mColorRangeMin = 0;
+		int mColorRangeMax = 0;
+		bool mCheckComments = true;
+		int mCheckCommentsFromLine = 0; // pending comment rescan range, lines in between were edited
+		int mCheckCommentsToLine = 0;
+		uint32_t mDocumentVersion = 0;
+		uint32_t mLineLayoutVersion = 0; // bumped when lines are inserted, removed or moved, see ApplyColorizeResults
+		std::vector<std::pair<int, EditListener>> mEditListeners;
+		int mNextEditListenerId = 0;
+		std::vector<TextEditor*> mViews; // each follows the edits made through the others, see FollowEdit
+		LanguageDefinitionId mLanguageDefinitionId = LanguageDefinitionId::None;
+		const LanguageDefinition* mLanguageDefinition = nullptr;
+		int mTabSize = 4;
+		std::shared_ptr<RegexList> mRegexList;
+		std::shared_ptr<ColorizeWorker> mColorizeWorker;
+
+		bool mDocumentWordCompletion = false;
+		DocumentWords mDocumentWords;
+
+		std::deque<FindIndex> mFindIndexes; // by slot, a deque so views can keep references to theirs
+	};
 };
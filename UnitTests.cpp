@@ -94,6 +94,106 @@ void TextEditor::UnitTests()
 		assert(GetCharacterIndexR({ 2, 2 }) == -1);
 	}
 
+	// --- Column cache --- //
+	{
+		// built on the first query, rebuilt after an edit or a tab size change
+		SetText("ab\xc3\xa9" "c");
+		assert(GetLineMaxColumn(0) == 4 && GetCharacterIndexR({ 0, 3 }) == 4 && GetCharacterColumn(0, 4) == 3);
+		assert(!mLines[0].mPlainColumns);
+		// an index inside a character is past it, as stepping character by character from the start gets
+		assert(GetCharacterColumn(0, 2) == 2 && GetCharacterColumn(0, 3) == 3);
+		DeleteRange({ 0, 2 }, { 0, 3 });
+		assert(GetLineMaxColumn(0) == 3 && mLines[0].mPlainColumns && GetCharacterIndexR({ 0, 2 }) == 2);
+		AddGlyphToLine(0, 1, '\t');
+		assert(GetLineMaxColumn(0) == 6 && GetCharacterIndexL({ 0, 2 }) == 1 && GetCharacterIndexR({ 0, 2 }) == 2);
+		SetTabSize(2);
+		assert(GetLineMaxColumn(0) == 4 && GetCharacterColumn(0, 2) == 2);
+		SetTabSize(4);
+
+		// a plain line keeps its columns through edits that leave it plain
+		SetText("abc");
+		assert(GetLineMaxColumn(0) == 3 && mLines[0].mPlainColumns && mLines[0].mColumnsTabSize == 4);
+		const char* plain = "xyz";
+		mLines[0].Insert(1, plain, plain + 3);
+		mLines[0].Erase(0, 1);
+		assert(mLines[0].mColumnsTabSize == 4 && GetLineMaxColumn(0) == 5);
+		const char* accented = "\xc3\xa9";
+		mLines[0].Insert(1, accented, accented + 2);
+		assert(mLines[0].mColumnsTabSize == 0 && GetLineMaxColumn(0) == 6 && !mLines[0].mPlainColumns);
+
+		// only tabs and multi-byte characters are kept, the columns in between follow from them; the
+		// same columns and indices as stepping through the line character by character
+		SetText("\tab\xc3\xa9" "c\xe2\x82\xac\t" "d");
+		assert(GetLineMaxColumn(0) == 13 && mLines[0].mColumnBreaks.size() == 4);
+		const char* pieces[] = { "a", "\t", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80" };
+		for (int round = 0; round < 200; round++)
+		{
+			std::string text;
+			for (int i = 0; i < round % 23; i++)
+				text += pieces[(round * 7 + i * 13 + i * i) % 5];
+			SetText(text);
+			std::vector<int> columns; // of every byte and the end of the line
+			int column = 0;
+			for (size_t i = 0; i < text.size();)
+			{
+				size_t length = text[i] == '\t' || (text[i] & 0x80) == 0 ? 1 : (text[i] & 0xE0) == 0xC0 ? 2 : (text[i] & 0xF0) == 0xE0 ? 3 : 4;
+				columns.insert(columns.end(), length, column);
+				column = text[i] == '\t' ? (column / mTabSize + 1) * mTabSize : column + 1;
+				i += length;
+			}
+			columns.push_back(column);
+			auto& line = mLines[0];
+			line.EnsureColumns(mTabSize);
+			for (int i = 0; i <= (int)text.size(); i++)
+				assert(line.ColumnAt(i) == columns[i]);
+			for (int c = -1; c <= column + 2; c++)
+				assert(line.IndexAtColumn(c) == std::min((int)(std::lower_bound(columns.begin(), columns.end(), c) - columns.begin()), (int)text.size()));
+		}
+
+		// find results do not keep the tables of lines out of view
+		SetText("foo\n\tfoo\n\xc3\xa9 foo");
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "foo");
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 3 && mFindResults[1].mStart == Coordinates(1, 4) && mFindResults[2].mStart == Coordinates(2, 2));
+		assert(!mLines[1].HasColumnBreaks() && !mLines[2].HasColumnBreaks());
+		mFindBuffer[0] = '\0';
+		RefreshFindResults(false);
+		SetText(" \t  \t   \t \t\n");
+	}
+
+	// --- LoadFromMemory / SaveTo --- //
+	{
+		// '\r' is dropped, SaveTo writes what GetText returns
+		std::string text = "int a;\r\n\tb = \"x\r\";\n\n0123456789abcdef0123456789\n";
+		LoadFromMemory(text.data(), text.size());
+		assert(mLines.size() == 5 && mLines[1].mText == "\tb = \"x\";" && mLines[3].size() == 26);
+		std::string saved;
+		auto append = [](const char* aData, size_t aSize, void* aOut) { ((std::string*)aOut)->append(aData, aSize); return true; };
+		assert(SaveTo(append, &saved) && saved == GetText() && saved == "int a;\n\tb = \"x\";\n\n0123456789abcdef0123456789\n");
+
+		// regions and lines read where they are stored, stopping when asked to
+		saved.clear();
+		assert(ReadText(1, 1, 3, 4, append, &saved) && saved == "b = \"x\";\n\n0123");
+		saved.clear();
+		assert(ReadText(3, 20, 99, 0, append, &saved) && saved == "456789\n");
+		assert(!ReadText(0, 0, 3, 0, [](const char*, size_t, void*) { return false; }, nullptr));
+		std::vector<int> lines;
+		auto collect = [](int aLine, std::string_view aText, void* aOut) { ((std::vector<int>*)aOut)->push_back(aLine * 100 + (int)aText.size()); return aLine < 2; };
+		assert(!ForEachLine(collect, &lines, 1) && lines == std::vector<int>({ 109, 200 }));
+		lines.clear();
+		assert(ForEachLine(collect, &lines, 0, 2) && lines.size() == 2);
+
+		// large enough for the threaded line break scan, lines longer than the save buffer
+		std::string big;
+		for (int i = 0; i < 40000; i++)
+			big += std::string(i % 1000 == 0 ? 70000 : i % 97, 'a' + i % 26) + "\n";
+		LoadFromMemory(big.data(), big.size());
+		assert(mLines.size() == 40001 && mLines[1000].size() == 70000 && mLines[1001].size() == 1001 % 97);
+		saved.clear();
+		assert(SaveTo(append, &saved) && saved == big);
+		SetText(" \t  \t   \t \t\n");
+	}
+
 	// --- GetText --- //
 	{
 		// Gets text from aStart to aEnd, tabs are counted on the start position
@@ -185,6 +285,984 @@ void TextEditor::UnitTests()
 		assert(FindNextOccurrence("asdf", 4, { 3, 3 }, outStart, outEnd) && outStart == Coordinates(0, 0) && outEnd == Coordinates(0, 4)); // go to line 0 if reach end of file
 		assert(FindNextOccurrence("zxcv", 4, { 3, 10 }, outStart, outEnd) && outStart == Coordinates(3, 1) && outEnd == Coordinates(3, 5)); // from behind in same line
 		assert(!FindNextOccurrence("lalal", 4, { 3, 5 }, outStart, outEnd)); // not found
+		assert(FindNextOccurrence("ZXCV", 4, { 3, 3 }, outStart, outEnd, false) && outStart == Coordinates(3, 6) && outEnd == Coordinates(3, 10));
+		assert(!FindNextOccurrence("ZXCV", 4, { 3, 3 }, outStart, outEnd));
+		assert(FindNextOccurrence("asdf\nasdf", 9, { 0, 1 }, outStart, outEnd) && outStart == Coordinates(0, 5) && outEnd == Coordinates(1, 4)); // across lines
+	}
+	SetText("0123456789abcdef0123456789ab_Needle_cdef0123456789abcdef012needle");
+	{
+		// matches found by the wide compare, the fold and the scalar tail agree with a plain scan
+		Coordinates outStart, outEnd;
+		assert(FindNextOccurrence("needle", 6, { 0, 0 }, outStart, outEnd) && outStart == Coordinates(0, 59));
+		assert(FindNextOccurrence("NEEDLE", 6, { 0, 0 }, outStart, outEnd, false) && outStart == Coordinates(0, 29) && outEnd == Coordinates(0, 35));
+		assert(FindNextOccurrence("f012n", 5, { 0, 0 }, outStart, outEnd) && outStart == Coordinates(0, 55));
+		assert(!FindNextOccurrence("needle!", 7, { 0, 0 }, outStart, outEnd));
+	}
+
+	// --- LineStore --- //
+	{
+		// Line container keeps order across chunk splits and merges
+		LineStore store;
+		std::vector<int> reference;
+		auto makeLine = [](int aValue) { char text[2] = { (char)(aValue & 0x7f), (char)(aValue >> 7) }; return Line(text, text + 2); };
+		auto lineValue = [](const Line& aLine) { return (int)aLine[0] | ((int)aLine[1] << 7); };
+		auto matches = [&]() {
+			if (store.size() != reference.size())
+				return false;
+			for (size_t i = 0; i < reference.size(); i++) // forward
+				if (lineValue(store[i]) != reference[i])
+					return false;
+			for (size_t i = reference.size(); i-- > 0;) // backward
+				if (lineValue(store[i]) != reference[i])
+					return false;
+			size_t i = 0;
+			for (auto& line : store)
+				if (lineValue(line) != reference[i++])
+					return false;
+			return i == reference.size();
+		};
+		for (int i = 0; i < 2000; i++)
+		{
+			store.emplace_back(makeLine(i));
+			reference.push_back(i);
+		}
+		assert(matches());
+		for (int i = 0; i < 1000; i++) // insert at the top and in the middle, forcing splits
+		{
+			size_t where = i % 2 == 0 ? 0 : reference.size() / 2;
+			store.insert(where, makeLine(2000 + i));
+			reference.insert(reference.begin() + where, 2000 + i);
+		}
+		assert(matches());
+		assert(lineValue(store[1234]) == reference[1234] && lineValue(store[17]) == reference[17] && lineValue(store[2999]) == reference[2999]);
+		store.erase(100, 1700); // spans several chunks
+		reference.erase(reference.begin() + 100, reference.begin() + 1700);
+		assert(matches());
+		for (int i = 0; i < 1300; i++) // single line removal, forcing merges
+		{
+			size_t where = (i * 7) % reference.size();
+			store.erase(where);
+			reference.erase(reference.begin() + where);
+		}
+		assert(matches());
+		store.erase(0, store.size());
+		assert(store.empty());
+		store.resize(3);
+		assert(store.size() == 3 && store[2].empty());
+	}
+
+	// --- ColorizeInternal --- //
+	{
+		// Comment state is rescanned from the edited line until it converges with the cached entry states
+		auto languageDefinitionId = mLanguageDefinitionId;
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		SetText("int a;\nint b;\nint c; // x\n\"s\\\nt\" d;\nint e;");
+		ColorizeInternal();
+		assert(!mCheckComments);
+		assert(!mLines[1].mGlyphs[0].mMultiLineComment && mLines[2].mGlyphs[7].mComment && !mLines[2].mGlyphs[0].mComment);
+		assert(mLines[4].mEntryState != 0 && mLines[5].mEntryState == 0); // string continued past the line end
+		Coordinates where(0, 0);
+		InsertTextAt(where, "/*");
+		ColorizeInternal();
+		assert(mLines[1].mGlyphs[0].mMultiLineComment && mLines[4].mGlyphs[4].mMultiLineComment);
+		DeleteRange({ 0, 0 }, { 0, 2 });
+		ColorizeInternal();
+		assert(!mLines[1].mGlyphs[0].mMultiLineComment && !mLines[4].mGlyphs[4].mMultiLineComment);
+		where = Coordinates(1, 6);
+		InsertTextAt(where, " */"); // closes nothing, state below must not change
+		ColorizeInternal();
+		assert(!mLines[2].mGlyphs[0].mMultiLineComment && mLines[2].mGlyphs[7].mComment && mLines[5].mEntryState == 0);
+
+		// long runs without quotes or comment characters are filled in one go, the stops still count
+		SetText("int value = 1234567890 + 1234567890; /* still in a comment, then */ x = \"a long string with \\\" and /* inside\" + y;");
+		ColorizeInternal();
+		const auto& text = mLines[0].mText;
+		const auto& glyphs = mLines[0].mGlyphs;
+		assert(!glyphs[text.find("1234")].mMultiLineComment && glyphs[text.find("comment")].mMultiLineComment);
+		assert(glyphs[text.find("*/") + 1].mMultiLineComment && !glyphs[text.find("x =")].mMultiLineComment);
+		assert(!glyphs[text.find("inside")].mMultiLineComment && !glyphs[text.find("y;")].mMultiLineComment);
+		SetLanguageDefinition(languageDefinitionId);
+	}
+
+	// --- Colorization budget --- //
+	{
+		// visible lines first; with no budget each call does a single chunk
+		auto languageDefinitionId = mLanguageDefinitionId;
+		SetLanguageDefinition(LanguageDefinitionId::Sql);
+		std::string text;
+		for (int i = 0; i < 2000; i++)
+			text += "SELECT a FROM t;\n";
+		SetText(text);
+		SetColorizationBudget(0);
+		mFirstVisibleLine = 1000;
+		mLastVisibleLine = 1030;
+		auto colored = [this](int aLine) { return mLines[aLine].mColorizedRevision == mLines[aLine].mRevision; };
+		int calls = 0;
+		while (!colored(1000) || !colored(1030))
+		{
+			ColorizeInternal();
+			calls++;
+		}
+		assert(calls > 1 && !colored(0) && !colored(1999) && mColorRangeMin == 0);
+		SetColorizationBudget(1000000);
+		ColorizeInternal();
+		assert(colored(0) && colored(1999) && !IsColorizationPending());
+		SetColorizationBudget(4000);
+		mFirstVisibleLine = 0;
+		mLastVisibleLine = 0;
+		SetLanguageDefinition(languageDefinitionId);
+	}
+
+	// --- Parallel colorization --- //
+	{
+		// same colors as one thread, whichever slice a line falls in
+		auto languageDefinitionId = mLanguageDefinitionId;
+		SetLanguageDefinition(LanguageDefinitionId::Sql);
+		std::string text;
+		for (int i = 0; i < 5000; i++)
+			text += i % 3 == 0 ? "SELECT a, 'x' FROM t WHERE b = 12;\n" : "insert into t values (1.5, \"y\");\n";
+		SetText(text);
+		ColorizeRange(0, GetLineCount());
+		std::vector<Line> expected;
+		for (const auto& line : mLines)
+			expected.push_back(line);
+		SetParallelColorizationEnabled(true);
+		SetText(text);
+		ColorizeRange(0, GetLineCount());
+		for (int i = 0; i < (int)expected.size(); i++)
+		{
+			assert(mLines[i].mColorizedRevision == mLines[i].mRevision);
+			for (int j = 0; j < (int)expected[i].size(); j++)
+				assert(mLines[i].mGlyphs[j].GetColorIndex() == expected[i].mGlyphs[j].GetColorIndex());
+		}
+
+		// the threads stay for the next range, and go with the setting
+		auto pool = mColorizePool;
+		SetText(text);
+		ColorizeRange(0, GetLineCount());
+		assert(mColorizePool == pool);
+		for (int i = 0; i < (int)expected.size(); i++)
+			assert(mLines[i].mColorizedRevision == mLines[i].mRevision);
+
+		// budgeted steps are sized from the measured rate and still cover every line
+		SetText(text);
+		while (mColorRangeMin < mColorRangeMax)
+			ColorizeInternal();
+		assert(mColorizeLinesPerMicrosecond > 0.0f);
+		for (int i = 0; i < (int)expected.size(); i++)
+			assert(mLines[i].mColorizedRevision == mLines[i].mRevision);
+		SetParallelColorizationEnabled(false);
+		assert(mColorizePool == nullptr);
+		SetLanguageDefinition(languageDefinitionId);
+	}
+
+	// --- Background colorization --- //
+	{
+		// Worker results must match synchronous tokenizing, and results for edited lines are dropped
+		auto languageDefinitionId = mLanguageDefinitionId;
+		SetLanguageDefinition(LanguageDefinitionId::Sql);
+		std::string text;
+		for (int i = 0; i < 3000; i++)
+			text += i % 3 == 0 ? "SELECT a, 'x' FROM t WHERE b = 12;\n" : "insert into t values (1.5, \"y\");\n";
+		SetText(text);
+		while (mColorRangeMin < mColorRangeMax)
+			ColorizeInternal();
+		std::vector<Line> expected;
+		for (const auto& line : mLines)
+			expected.push_back(line);
+
+		auto settle = [this]() {
+			do
+				ColorizeInternal();
+			while (IsColorizationPending());
+		};
+		SetBackgroundColorizationEnabled(true);
+		assert(IsBackgroundColorizationEnabled());
+		SetText(text);
+		ColorizeInternal();
+		Coordinates where(2, 0);
+		InsertTextAt(where, "select 7 "); // edit while the first job is most likely still queued
+		Colorize(2, 1);
+		settle();
+		assert(mLines[2].mGlyphs[0].GetColorIndex() == PaletteIndex::Keyword && mLines[2].mGlyphs[7].GetColorIndex() == PaletteIndex::Number);
+		DeleteRange({ 2, 0 }, { 2, 9 });
+		Colorize(2, 1);
+		settle();
+		for (int i = 0; i < (int)expected.size(); i++)
+		{
+			assert(mLines[i].mText == expected[i].mText);
+			for (int j = 0; j < (int)expected[i].size(); j++)
+				assert(mLines[i].mGlyphs[j].mColorIndex == expected[i].mGlyphs[j].mColorIndex);
+		}
+
+		// loaded lines share a revision, one removed under the jobs moves others into copied indices
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		text.clear();
+		for (int i = 0; i < 3500; i++)
+			text += i % 2 == 0 ? "int x;\n" : "foo y;\n";
+		text.pop_back();
+		SetText(text);
+		ColorizeInternal();
+		DeleteRange({ 2999, 0 }, { 3000, 0 });
+		settle();
+		for (int i = 0; i < (int)mLines.size(); i++)
+			assert(mLines[i].mGlyphs[0].GetColorIndex() == (mLines[i].mText[0] == 'i' ? PaletteIndex::Keyword : PaletteIndex::Identifier));
+
+		// lines of the same length swapped under the jobs do not take each other's colors
+		SetText(text);
+		ColorizeInternal();
+		SetCursorPosition(Coordinates(1, 0));
+		MoveUpCurrentLines();
+		SetCursorPosition(Coordinates(2000, 0));
+		MoveDownCurrentLines();
+		settle();
+		assert(mLines[0].mText[0] == 'f' && mLines[2001].mText[0] == 'i');
+		for (int i = 0; i < (int)mLines.size(); i++)
+			assert(mLines[i].mGlyphs[0].GetColorIndex() == (mLines[i].mText[0] == 'i' ? PaletteIndex::Keyword : PaletteIndex::Identifier));
+		SetBackgroundColorizationEnabled(false);
+		SetLanguageDefinition(languageDefinitionId);
+	}
+
+	// --- Native tokenizers --- //
+	{
+		// Built-in languages tokenize these without regexes, results follow the old token patterns
+		auto languageDefinitionId = mLanguageDefinitionId;
+		auto colorAt = [this](int aIndex) { return mLines[0].mGlyphs[aIndex].GetColorIndex(); };
+		SetLanguageDefinition(LanguageDefinitionId::Sql);
+		SetText("select 'a' -1.5e3f x");
+		ColorizeRange(0, 1);
+		assert(colorAt(0) == PaletteIndex::Keyword && colorAt(7) == PaletteIndex::String && colorAt(9) == PaletteIndex::String);
+		assert(colorAt(11) == PaletteIndex::Number && colorAt(17) == PaletteIndex::Number && colorAt(19) == PaletteIndex::Identifier);
+		SetLanguageDefinition(LanguageDefinitionId::Hlsl);
+		SetText("  #define s \"a\\\"b\" 0x1");
+		ColorizeRange(0, 1);
+		assert(colorAt(0) == PaletteIndex::Preprocessor && colorAt(8) == PaletteIndex::Preprocessor && colorAt(10) == PaletteIndex::Identifier);
+		assert(colorAt(12) == PaletteIndex::String && colorAt(17) == PaletteIndex::String && colorAt(19) == PaletteIndex::Number && colorAt(20) == PaletteIndex::Identifier);
+		SetLanguageDefinition(LanguageDefinitionId::Python);
+		SetText("x = b'\\'");
+		ColorizeRange(0, 1);
+		assert(colorAt(4) == PaletteIndex::String && colorAt(7) == PaletteIndex::String); // escaped quote closes the unterminated string
+		SetLanguageDefinition(LanguageDefinitionId::Json);
+		SetText("{\"k\": true}");
+		ColorizeRange(0, 1);
+		assert(colorAt(1) == PaletteIndex::String && colorAt(4) == PaletteIndex::Punctuation && colorAt(6) == PaletteIndex::Keyword);
+		SetLanguageDefinition(languageDefinitionId);
+	}
+
+	// --- KeywordTable --- //
+	{
+		// Every word of a definition is found in one probe, anything else misses
+		for (const LanguageDefinition* definition : { &LanguageDefinition::Cpp(), &LanguageDefinition::Sql(), &LanguageDefinition::Hlsl() })
+		{
+			const auto& table = definition->mKeywordTable;
+			for (const auto& k : definition->mKeywords)
+				assert(table.Lookup(k) & LanguageDefinition::KeywordTable::Keyword);
+			for (const auto& i : definition->mIdentifiers)
+				assert(table.Lookup(i.first) & LanguageDefinition::KeywordTable::KnownIdentifier);
+			assert(table.Lookup("notAKeyword_") == 0 && table.Lookup("x") == 0);
+		}
+		assert(LanguageDefinition::Sql().mKeywordTable.Lookup("sElEcT") == LanguageDefinition::KeywordTable::Keyword);
+		assert(LanguageDefinition::Sql().mKeywordTable.Lookup("SELECTS") == 0);
+		assert(LanguageDefinition::Cpp().mKeywordTable.Lookup("Int") == 0);
+	}
+
+	// --- Incremental find index --- //
+	{
+		SetText("foo bar\nfoofoo\nbar foo\nfoo");
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "foo");
+		mFindWholeWord = true;
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 3 && mFindResults[1].mStart == Coordinates(2, 4));
+		mFindWholeWord = false;
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 5 && mLines[1].mFindOccurrences.size() == 2);
+
+		// an edit searches the lines it touched again, results below keep theirs and move with their lines;
+		// the same as searching everything again
+		auto searchedAgain = [this]()
+		{
+			std::vector<SearchResult> spliced = mFindResults;
+			mFindResultsBasis.mValid = false;
+			RefreshFindResults(false);
+			if (spliced.size() != mFindResults.size())
+				return false;
+			for (size_t i = 0; i < spliced.size(); i++)
+				if (spliced[i].mStart != mFindResults[i].mStart || spliced[i].mEnd != mFindResults[i].mEnd)
+					return false;
+			return true;
+		};
+		Coordinates where(0, 0);
+		InsertTextAt(where, "foo");
+		RefreshFindResults(false);
+		assert(mFindResultsBasis.mValid && mFindResults.size() == 6 && mFindResults[0].mEnd == Coordinates(0, 3) && mFindResults[1].mStart == Coordinates(0, 3));
+		where = Coordinates(1, 3);
+		InsertTextAt(where, "\nx\n");
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 6 && mFindResults[4].mStart == Coordinates(4, 4) && mFindResults[5].mStart == Coordinates(5, 0));
+		assert(GetFindHighlightsForLine(4) != nullptr && (*GetFindHighlightsForLine(4))[0].mResultIndex == 4);
+		assert(searchedAgain());
+		DeleteRange(Coordinates(1, 0), Coordinates(3, 0));
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 5 && mFindResults[2].mStart == Coordinates(1, 0) && searchedAgain());
+
+		// a match carried over a line break decides where the search picks up below the edit
+		SetText("a\na\na\na\na");
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "a\na");
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 2);
+		DeleteRange(Coordinates(0, 0), Coordinates(1, 0));
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 2 && mFindResults[1].mStart == Coordinates(2, 0) && searchedAgain());
+		where = Coordinates(0, 0);
+		InsertTextAt(where, "a\n");
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 2 && mFindResults[1].mStart == Coordinates(2, 0) && searchedAgain());
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "foo");
+		SetText("foofoo bar\nfoofoo\nbar foo\nfoo");
+
+		// a match spanning lines goes away when the line it ends on is edited
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "foo\nbar");
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 1 && mFindResults[0].mStart == Coordinates(1, 3) && mFindResults[0].mEnd == Coordinates(2, 3));
+		assert(GetFindHighlightsForLine(1) != nullptr && GetFindHighlightsForLine(2) != nullptr && GetFindHighlightsForLine(0) == nullptr);
+		where = Coordinates(2, 0);
+		InsertTextAt(where, "x");
+		RefreshFindResults(false);
+		assert(mFindResults.empty());
+
+		// moved lines are searched again
+		SetText("one\ntwo\nthree");
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "two");
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 1 && mFindResults[0].mStart == Coordinates(1, 0));
+		SetCursorPosition(Coordinates(1, 0));
+		MoveUpCurrentLines();
+		EnsureFindResultsUpToDate();
+		assert(mFindResults.size() == 1 && mFindResults[0].mStart == Coordinates(0, 0));
+		MoveDownCurrentLines();
+		MoveDownCurrentLines();
+		EnsureFindResultsUpToDate();
+		assert(mFindResults.size() == 1 && mFindResults[0].mStart == Coordinates(2, 0) && searchedAgain());
+		mFindBuffer[0] = '\0';
+		RefreshFindResults(false);
+	}
+
+	// --- ReplaceAll --- //
+	{
+		// every match replaced in one undo step, text brought in by a replacement is not matched again
+		SetText("a\tfoo foo\nfoo\nbar");
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "foo");
+		snprintf(mReplaceBuffer, sizeof(mReplaceBuffer), "%s", "foo\tfoo");
+		MarkFindResultsDirty(false);
+		int undoSize = (int)mUndoBuffer.size();
+		assert(ReplaceAll() == 3 && GetText() == "a\tfoo\tfoo foo\tfoo\nfoo\tfoo\nbar");
+		assert((int)mUndoBuffer.size() == undoSize + 1 && mFindResults.size() == 6);
+		Undo();
+		assert(GetText() == "a\tfoo foo\nfoo\nbar");
+		Redo();
+		assert(GetText() == "a\tfoo\tfoo foo\tfoo\nfoo\tfoo\nbar");
+
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "foo\nfoo");
+		snprintf(mReplaceBuffer, sizeof(mReplaceBuffer), "%s", "-\n-\n-");
+		MarkFindResultsDirty(false);
+		assert(ReplaceAll() == 1 && GetText() == "a\tfoo\tfoo foo\t-\n-\n-\tfoo\nbar");
+		Undo();
+		assert(GetText() == "a\tfoo\tfoo foo\tfoo\nfoo\tfoo\nbar");
+		mFindBuffer[0] = '\0';
+		mReplaceBuffer[0] = '\0';
+		RefreshFindResults(false);
+	}
+
+	// --- Undo history --- //
+	{
+		// typed characters become one step, so do backspaced ones, anything else starts a new step
+		SetText("ab\ncd");
+		SetCursorPosition(Coordinates(0, 2));
+		EnterCharacter('x', false);
+		EnterCharacter('y', false);
+		EnterCharacter('z', false);
+		assert(mUndoBuffer.size() == 1 && GetText() == "abxyz\ncd");
+		Backspace();
+		Backspace();
+		assert(mUndoBuffer.size() == 2 && GetText() == "abx\ncd");
+		EnterCharacter('\n', false);
+		EnterCharacter('w', false);
+		assert(mUndoBuffer.size() == 4);
+		Undo(2);
+		assert(GetText() == "abx\ncd");
+		Undo();
+		assert(GetText() == "abxyz\ncd" && GetSanitizedCursorCoordinates() == Coordinates(0, 5));
+		Undo();
+		assert(GetText() == "ab\ncd" && GetSanitizedCursorCoordinates() == Coordinates(0, 2));
+		Redo(2);
+		assert(GetText() == "abx\ncd" && GetSanitizedCursorCoordinates() == Coordinates(0, 3));
+
+		// one cursor per line, typing moves them all by the same amount
+		SetText("a\nb\nc");
+		SetCursorPosition(Coordinates(0, 1));
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(1, 1), 1);
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(2, 1), 2);
+		EnterCharacter('1', false);
+		EnterCharacter('2', false);
+		assert(mUndoBuffer.size() == 1 && GetText() == "a12\nb12\nc12");
+		assert(mUndoBuffer[0].mAfter.mRuns.size() == 1 && mUndoBuffer[0].mAfter.mCursors.empty());
+		Undo();
+		assert(GetText() == "a\nb\nc" && mState.mCurrentCursor == 2 && GetSanitizedCursorCoordinates(1) == Coordinates(1, 1));
+		Redo();
+		assert(GetText() == "a12\nb12\nc12" && GetSanitizedCursorCoordinates(2) == Coordinates(2, 3));
+		ClearExtraCursors();
+
+		// the oldest steps go once the budget is exceeded, the last one always stays
+		SetText("");
+		SetUndoMemoryBudget(1);
+		EnterCharacter('a', false);
+		EnterCharacter('\n', false);
+		EnterCharacter('b', false);
+		assert(mUndoBuffer.size() == 1 && mUndoIndex == 1 && mUndoMemoryUsage == mUndoBuffer[0].mMemorySize);
+		Undo();
+		assert(GetText() == "a\n" && !CanUndo());
+		SetUndoMemoryBudget(0);
+	}
+
+	// --- Auto-complete --- //
+	{
+		// prefix ranges of the sorted sources, same case first, then shorter words
+		SetLanguageDefinition(LanguageDefinitionId::Sql);
+		SetExtraKeywords({ "orders", "Customer_id", "customers", "custom", "Orders" });
+		SetText("select custo");
+		SetCursorPosition(Coordinates(0, 12));
+		UpdateAutoComplete();
+		assert(mAutoCompleteSuggestions == std::vector<std::string>({ "custom", "customers", "Customer_id" }));
+		SetText("select ord");
+		SetCursorPosition(Coordinates(0, 10));
+		UpdateAutoComplete();
+		assert(mAutoCompleteSuggestions == std::vector<std::string>({ "orders", "ORDER", "Orders" }));
+
+		// identifiers of the document, given back when their line goes
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		SetExtraKeywords({});
+		SetDocumentWordCompletionEnabled(true);
+		SetText("int row_count = 0;\nrow_co");
+		ColorizeRange(0, 2);
+		SetCursorPosition(Coordinates(1, 6));
+		UpdateAutoComplete();
+		assert(mAutoCompleteSuggestions == std::vector<std::string>({ "row_count" }));
+		DeleteRange(Coordinates(0, 0), Coordinates(1, 0));
+		ColorizeRange(0, 1);
+		SetCursorPosition(Coordinates(0, 6));
+		UpdateAutoComplete();
+		assert(mAutoCompleteSuggestions.empty() && mDocumentWords.mByKey.size() == 1);
+		SetDocumentWordCompletionEnabled(false);
+		mShowAutoComplete = false;
+	}
+
+	// --- Shared document --- //
+	{
+		// one copy of the lines and the undo history, cursors per view
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		SetText("int a;\nint b;\nint c;");
+		TextEditor view(GetDocument());
+		assert(&view.mLines == &mLines && view.GetText() == GetText() && view.GetLanguageDefinition() == LanguageDefinitionId::Cpp);
+		view.SetCursorPosition(Coordinates(2, 6));
+		Coordinates where(0, 0);
+		view.InsertTextAt(where, "// ");
+		assert(GetText() == "// int a;\nint b;\nint c;");
+		ColorizeRange(0, 3);
+		assert(view.mLines[1].mGlyphs[0].GetColorIndex() == PaletteIndex::Keyword);
+
+		// lines removed through this view, the other clamps its cursor when it catches up
+		SetSelection(Coordinates(1, 0), Coordinates(2, 6));
+		Delete();
+		view.SyncWithDocument();
+		assert(view.mState.mCursors[0].mInteractiveEnd == Coordinates(1, 0));
+		view.Undo();
+		assert(GetText() == "// int a;\nint b;\nint c;");
+
+		// one tab size for the document, so an undo step counts columns the same in every view
+		SetText("\tab");
+		view.SetTabSize(8);
+		assert(GetTabSize() == 8);
+		SetTabSize(4);
+		SetCursorPosition(Coordinates(0, 5));
+		EnterCharacter('X', false);
+		assert(GetText() == "\taXb");
+		view.Undo();
+		assert(GetText() == "\tab");
+
+		// API calls catch up with edits from other views, without a frame in between
+		SetText("a\nb\nc");
+		view.SetSelection(Coordinates(1, 0), Coordinates(2, 1));
+		SelectAll();
+		Delete();
+		view.ClearSelections();
+		assert(view.mState.mCursors[0].mInteractiveStart == Coordinates(0, 0) && view.mState.mCursors[0].mInteractiveEnd == Coordinates(0, 0));
+		view.Cut();
+		assert(GetText().empty());
+
+		// edits through one view move the other's cursors along with the text after them
+		SetText("one\ntwo\nthree");
+		view.SetCursorPosition(Coordinates(2, 2));
+		SetCursorPosition(Coordinates(0, 0));
+		EnterCharacter('\n', false);
+		EnterCharacter('\n', false);
+		assert(view.GetSanitizedCursorCoordinates() == Coordinates(4, 2));
+		SetCursorPosition(Coordinates(4, 0));
+		EnterCharacter('x', false);
+		assert(view.GetSanitizedCursorCoordinates() == Coordinates(4, 3));
+		SetSelection(Coordinates(0, 0), Coordinates(3, 1));
+		Delete();
+		assert(view.GetSanitizedCursorCoordinates() == Coordinates(1, 3) && view.GetText(view.mState.mCursors[0].mInteractiveEnd, Coordinates(1, 5)) == "re");
+
+		// each view keeps its own find index, an edit only has both search the edited lines again
+		SetText("ab\ncd\nab cd\nx");
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "ab");
+		snprintf(view.mFindBuffer, sizeof(view.mFindBuffer), "%s", "cd");
+		RefreshFindResults(false);
+		view.RefreshFindResults(false);
+		assert(mFindResults.size() == 2 && view.mFindResults.size() == 2 && mLines[2].mFindOccurrences.size() == 2);
+		where = Coordinates(3, 0);
+		view.InsertTextAt(where, "ab cd ");
+		int fromLine, toLine;
+		assert(UpdateFindIndex("ab", false, fromLine, toLine) && fromLine == 3 && toLine == 3);
+		assert(view.UpdateFindIndex("cd", false, fromLine, toLine) && fromLine == 3 && toLine == 3);
+		RefreshFindResults(false);
+		view.RefreshFindResults(false);
+		assert(mFindResults.size() == 3 && mFindResults[2].mStart == Coordinates(3, 0));
+		assert(view.mFindResults.size() == 3 && view.mFindResults[2].mStart == Coordinates(3, 3));
+		mFindBuffer[0] = '\0';
+		RefreshFindResults(false);
+	}
+
+	// --- Edit events --- //
+	{
+		// applied in order to a copy, the events give the same text whichever way it was edited
+		TextEditor replica;
+		replica.SetText(GetText());
+		std::vector<uint32_t> versions;
+		int listener = AddEditListener([&](const EditEvent& aEvent)
+			{
+				Coordinates where = aEvent.mStart;
+				replica.DeleteRange(aEvent.mStart, aEvent.mEnd);
+				replica.InsertTextAt(where, std::string(aEvent.mText).c_str());
+				versions.push_back(aEvent.mVersion);
+			});
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		SetText("int a;\r\n\tb = 1;\nc();");
+		assert(replica.GetText() == GetText() && versions.back() == GetDocumentVersion());
+
+		SetCursorPosition(Coordinates(1, 4));
+		EnterCharacter('x', false);
+		EnterCharacter('\n', false);
+		SetCursorPosition(Coordinates(0, 1));
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(3, 2), 1);
+		EnterCharacter('y', false);
+		ImGui::SetClipboardText("p\nq");
+		Paste();
+		ClearExtraCursors();
+		SetSelection(Coordinates(0, 0), Coordinates(2, 1));
+		ChangeCurrentLinesIndentation(true);
+		ToggleLineComment();
+		size_t eventsBefore = versions.size();
+		uint32_t versionBefore = GetDocumentVersion();
+		MoveDownCurrentLines();
+		assert(versions.size() == eventsBefore + 2 && GetDocumentVersion() > versionBefore);
+		assert(versions[eventsBefore] == GetDocumentVersion() && versions.back() == GetDocumentVersion());
+		Backspace();
+		RemoveCurrentLines();
+		assert(replica.GetText() == GetText());
+
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "y");
+		snprintf(mReplaceBuffer, sizeof(mReplaceBuffer), "%s", "zz\n");
+		RefreshFindResults(false);
+		ReplaceAll();
+		mFindBuffer[0] = '\0';
+		mReplaceBuffer[0] = '\0';
+		RefreshFindResults(false);
+		assert(replica.GetText() == GetText());
+		while (CanUndo())
+			Undo();
+		assert(replica.GetText() == GetText() && GetText() == "int a;\n\tb = 1;\nc();");
+		Redo(100);
+		assert(replica.GetText() == GetText());
+		assert(std::is_sorted(versions.begin(), versions.end()) && versions.back() == GetDocumentVersion());
+
+		// nothing once removed, a view of the same document sees the listeners of the document
+		size_t eventCount = versions.size();
+		TextEditor view(GetDocument());
+		Coordinates where(0, 0);
+		view.InsertTextAt(where, "v");
+		assert(versions.size() == eventCount + 1 && replica.GetText() == GetText());
+		RemoveEditListener(listener);
+		EnterCharacter('w', false);
+		assert(versions.size() == eventCount + 1 && mEditListeners.empty());
+	}
+
+	// --- Snapshots --- //
+	{
+		// colors, comment state, cursors and history come back without tokenizing again
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		SetText("int a; /* one\ntwo */ b = \"s\";\n\tc();");
+		SetCursorPosition(Coordinates(2, 7));
+		EnterCharacter('x', false);
+		mState.AddCursor();
+		SetSelection(Coordinates(0, 0), Coordinates(0, 3), 1);
+		do
+			ColorizeInternal();
+		while (IsColorizationPending());
+		std::string snapshot;
+		auto append = [](const char* aData, size_t aSize, void* aOut) { ((std::string*)aOut)->append(aData, aSize); return true; };
+		assert(SaveSnapshot(append, &snapshot));
+		std::string text = GetText();
+		std::vector<Line> lines;
+		for (const auto& line : mLines)
+			lines.push_back(line);
+		EditorState state = mState;
+
+		TextEditor restored;
+		restored.SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		assert(restored.LoadSnapshot(snapshot.data(), snapshot.size()));
+		assert(restored.GetText() == text && !restored.IsColorizationPending());
+		for (int i = 0; i < (int)lines.size(); i++)
+			assert(restored.mLines[i].mGlyphs == lines[i].mGlyphs && restored.mLines[i].mEntryState == lines[i].mEntryState &&
+				restored.mLines[i].mColorizedRevision == restored.mLines[i].mRevision);
+		assert(restored.mState.mCurrentCursor == 1 && restored.mState.mCursors[1].mInteractiveEnd == state.mCursors[1].mInteractiveEnd);
+		assert(restored.CanUndo());
+		restored.Undo();
+		assert(restored.GetText() == "int a; /* one\ntwo */ b = \"s\";\n\tc();" && !restored.CanUndo() && restored.CanRedo());
+		restored.Redo();
+		assert(restored.GetText() == text);
+
+		// another language tokenizes again, without history nothing to undo
+		std::string withoutUndo;
+		assert(SaveSnapshot(append, &withoutUndo, false) && withoutUndo.size() < snapshot.size());
+		restored.SetLanguageDefinition(LanguageDefinitionId::Python);
+		assert(restored.LoadSnapshot(withoutUndo.data(), withoutUndo.size()));
+		assert(restored.GetText() == text && restored.IsColorizationPending() && !restored.CanUndo());
+
+		// anything damaged or cut short is refused and the editor keeps what it had
+		std::string damaged = snapshot;
+		damaged[0] = 'X';
+		assert(!restored.LoadSnapshot(damaged.data(), damaged.size()));
+		for (size_t size : { (size_t)0, (size_t)10, snapshot.size() / 2, snapshot.size() - 1 })
+			assert(!restored.LoadSnapshot(snapshot.data(), size));
+		damaged = snapshot + "!";
+		assert(!restored.LoadSnapshot(damaged.data(), damaged.size()));
+		assert(restored.GetText() == text && restored.GetLanguageDefinition() == LanguageDefinitionId::Python);
+
+		// so is a well formed one with colors or undo steps the editor could not have written
+		TextEditor source;
+		source.SetText("\tab");
+		source.SetCursorPosition(Coordinates(0, 5));
+		source.EnterCharacter('X', false);
+		std::string tampered;
+		source.mLines[0].mGlyphs[0].mColorIndex = (uint8_t)PaletteIndex::Background;
+		assert(source.SaveSnapshot(append, &tampered) && !restored.LoadSnapshot(tampered.data(), tampered.size()));
+		source.mLines[0].mGlyphs[0].mColorIndex = (uint8_t)PaletteIndex::Default;
+		source.mUndoBuffer.back().mOperations[0].mStart.mLine = 5;
+		tampered.clear();
+		assert(source.SaveSnapshot(append, &tampered) && !restored.LoadSnapshot(tampered.data(), tampered.size()));
+		assert(restored.GetText() == text);
+
+		// the tab size comes along, undo columns count tabs with it
+		source.mUndoBuffer.back().mOperations[0].mStart.mLine = 0;
+		tampered.clear();
+		assert(source.SaveSnapshot(append, &tampered));
+		restored.SetTabSize(8);
+		assert(restored.LoadSnapshot(tampered.data(), tampered.size()) && restored.GetTabSize() == 4);
+		restored.Undo();
+		assert(restored.GetText() == "\tab");
+
+		// a history of edits that add, remove and move lines checks out on the line count alone, one whose
+		// text lacks the line breaks its range spans does not
+		source.SetText("a\nb\nc\nd");
+		source.SetCursorPosition(Coordinates(1, 1));
+		source.EnterCharacter('\n', false);
+		source.MoveDownCurrentLines();
+		ImGui::SetClipboardText("p\nq\n");
+		source.Paste();
+		source.SetSelection(Coordinates(0, 0), Coordinates(4, 0));
+		source.ChangeCurrentLinesIndentation(true);
+		source.SetSelection(Coordinates(1, 0), Coordinates(3, 0));
+		source.Delete();
+		source.Undo(2);
+		std::string edited = source.GetText();
+		tampered.clear();
+		assert(source.SaveSnapshot(append, &tampered) && restored.LoadSnapshot(tampered.data(), tampered.size()));
+		while (restored.CanUndo())
+			restored.Undo();
+		assert(restored.GetText() == "a\nb\nc\nd");
+		restored.Redo(3);
+		assert(restored.GetText() == edited);
+		source.mUndoBuffer[0].mOperations[0].mText = "x";
+		tampered.clear();
+		assert(source.SaveSnapshot(append, &tampered) && !restored.LoadSnapshot(tampered.data(), tampered.size()));
+		ClearExtraCursors();
+	}
+
+	// --- Bracket matching --- //
+	{
+		// brackets in strings and comments do not count, lines between are stepped over on their summary
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		SetText("void f() {\n\tg(\"}\"); // }\n\t{ h(); }\n\t/* { */\n}");
+		ColorizeInternal();
+		ColorizeRange(0, GetLineCount());
+		Coordinates match;
+		assert(FindMatchingBracket(0, 9, match) && match == Coordinates(4, 0));
+		assert(FindMatchingBracket(4, 0, match) && match == Coordinates(0, 9));
+		assert(FindMatchingBracket(2, 1, match) && match == Coordinates(2, 11)); // character index in, column out
+		assert(!FindMatchingBracket(1, 4, match)); // in the string
+		assert(mLines[1].mBracketsRevision == mLines[1].mRevision && mLines[1].mBracketDelta[2] == 0);
+
+		// an edit leaves the summary stale, it is rebuilt when a match needs it
+		Coordinates where(2, 4);
+		InsertTextAt(where, "}");
+		assert(FindMatchingBracket(0, 9, match) && match == Coordinates(2, 4));
+	}
+
+	// --- Compiled regex lists --- //
+	{
+		// compiled once per language, whichever editor asks
+		TextEditor other;
+		other.SetLanguageDefinition(LanguageDefinitionId::Sql);
+		SetLanguageDefinition(LanguageDefinitionId::Sql);
+		assert(mRegexList == other.mRegexList);
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		assert(mRegexList != other.mRegexList && mRegexList == GetRegexList(mLanguageDefinition));
+	}
+
+	// --- Performance stats --- //
+	{
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		SetText("int a = 0;\nint b = 1;\nint c = 2;");
+		mFrameStats = PerformanceStats();
+		ColorizeRange(0, 3);
+		assert(mFrameStats.mLinesColorized == 3);
+		ColorizeRange(0, 3);
+		assert(mFrameStats.mLinesColorized == 3);
+		size_t lines = EstimateMemoryUsage().mLines;
+		Coordinates end(2, 10);
+		InsertTextAt(end, "\nint d = 3;");
+		assert(EstimateMemoryUsage().mLines > lines);
+		mFrameStats = PerformanceStats();
+	}
+
+	// --- InsertTextAt --- //
+	{
+		// one insert per line, '\r' dropped, cursors after the insertion point move with the rest of the line
+		SetText("abc\nd");
+		SetCursorPosition(Coordinates(0, 2));
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(1, 1), 1);
+		Coordinates where(0, 1);
+		assert(InsertTextAt(where, "x\r\n\t\r\nyz") == 2 && where == Coordinates(2, 2));
+		assert(GetText() == "ax\n\t\nyzbc\nd");
+		assert(GetSanitizedCursorCoordinates(0) == Coordinates(2, 3) && GetSanitizedCursorCoordinates(1) == Coordinates(3, 1));
+		where = Coordinates(2, 0);
+		assert(InsertTextAt(where, "\t") == 0 && where == Coordinates(2, 4) && GetSanitizedCursorCoordinates(0) == Coordinates(2, 7));
+		ClearExtraCursors();
+	}
+
+	// --- Many cursors --- //
+	{
+		// several cursors on a line, each line rebuilt once
+		SetText("ab\ncd");
+		SetCursorPosition(Coordinates(0, 0));
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(0, 1), 1);
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(0, 2), 2);
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(1, 1), 3);
+		EnterCharacter('\t', false);
+		assert(GetText() == "\ta\tb\t\nc\td");
+		assert(GetSanitizedCursorCoordinates(1) == Coordinates(0, 8) && GetSanitizedCursorCoordinates(2) == Coordinates(0, 12));
+		Undo();
+		assert(GetText() == "ab\ncd" && GetSanitizedCursorCoordinates(2) == Coordinates(0, 2));
+		Redo();
+		ClearExtraCursors();
+
+		// line breaks, every cursor lands on its own new line with the indentation
+		SetText("  ab\ncd");
+		SetCursorPosition(Coordinates(0, 3));
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(0, 4), 1);
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(1, 1), 2);
+		EnterCharacter('\n', false);
+		assert(GetText() == "  a\n  b\n  \nc\nd");
+		assert(GetSanitizedCursorCoordinates(0) == Coordinates(1, 2) && GetSanitizedCursorCoordinates(1) == Coordinates(2, 2) && GetSanitizedCursorCoordinates(2) == Coordinates(4, 0));
+		Undo();
+		assert(GetText() == "  ab\ncd");
+		ClearExtraCursors();
+
+		// selections within a line, cursors after them move left
+		SetText("abcdef");
+		SetSelection(Coordinates(0, 0), Coordinates(0, 2), 0);
+		mState.AddCursor();
+		SetSelection(Coordinates(0, 3), Coordinates(0, 5), 1);
+		mState.AddCursor();
+		SetCursorPosition(Coordinates(0, 6), 2);
+		Delete();
+		assert(GetText() == "cf" && GetSanitizedCursorCoordinates(1) == Coordinates(0, 1) && GetSanitizedCursorCoordinates(2) == Coordinates(0, 2));
+		Undo();
+		assert(GetText() == "abcdef");
+
+		// overlapping selections merge into one in a single pass
+		SetSelection(Coordinates(0, 0), Coordinates(0, 3), 0);
+		SetSelection(Coordinates(0, 1), Coordinates(0, 2), 1);
+		SetSelection(Coordinates(0, 2), Coordinates(0, 5), 2);
+		MergeCursorsIfPossible();
+		assert(mState.mCurrentCursor == 0 && GetSanitizedCursorCoordinates(0, true) == Coordinates(0, 0) && GetSanitizedCursorCoordinates(0) == Coordinates(0, 5));
+		ClearSelections();
+	}
+
+	// --- Find result choice --- //
+	{
+		// the result under or after the cursor, or the selection being preserved
+		std::string text;
+		for (int i = 0; i < 1000; i++)
+			text += "foo bar foo\n";
+		SetText(text);
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "foo");
+		SetCursorPosition(Coordinates(500, 5));
+		RefreshFindResults(false);
+		assert(mFindResults.size() == 2000 && mFindResultIndex == 1001);
+		SetCursorPosition(Coordinates(500, 2));
+		RefreshFindResults(false);
+		assert(mFindResultIndex == 1000);
+		SetSelection(Coordinates(700, 8), Coordinates(700, 11));
+		RefreshFindResults(true);
+		assert(mFindResultIndex == 1401);
+		mFindBuffer[0] = '\0';
+		RefreshFindResults(false);
+	}
+
+	// --- Recolorizing after edits --- //
+	{
+		SetLanguageDefinition(LanguageDefinitionId::Cpp);
+		SetText("int a;\nb\nc\nint d;");
+		do
+			ColorizeInternal();
+		while (IsColorizationPending());
+
+		// ColorizeRange skips lines not edited since they were last tokenized
+		mLines[0].mGlyphs[0].mColorIndex = (uint8_t)PaletteIndex::Default;
+		ColorizeRange(0, GetLineCount());
+		assert(mLines[0].mGlyphs[0].mColorIndex == (uint8_t)PaletteIndex::Default);
+		DeleteRange(Coordinates(0, 5), Coordinates(0, 6));
+		ColorizeRange(0, GetLineCount());
+		assert(mLines[0].mGlyphs[0].mColorIndex == (uint8_t)PaletteIndex::Keyword);
+
+		// lines waiting to be tokenized again move down with lines inserted above them
+		do
+			ColorizeInternal();
+		while (IsColorizationPending());
+		Colorize(3, 1);
+		Coordinates where(0, 0);
+		InsertTextAt(where, "x\ny\n");
+		assert(mColorRangeMin <= 5 && mColorRangeMax > 5);
+
+		// redo marks the lines it changed like undo does, the edited line included
+		SetCursorPosition(Coordinates(5, 0));
+		EnterCharacter('u', false);
+		Undo();
+		do
+			ColorizeInternal();
+		while (IsColorizationPending());
+		Redo();
+		assert(mColorRangeMin <= 5 && mColorRangeMax > 5);
+	}
+
+	// --- Regex find --- //
+	{
+		SetText("int a = 10;\nint bb = 200;\n\nfloat c = 3;");
+		mFindUseRegex = true;
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "[0-9]+");
+		RefreshFindResults(false);
+		WaitForFindResults();
+		assert(mRegexFindJob == nullptr && mFindResults.size() == 3);
+		assert(mFindResults[1].mStart == Coordinates(1, 9) && mFindResults[1].mEnd == Coordinates(1, 12));
+		assert(GetFindHighlightsForLine(3) != nullptr && GetFindHighlightsForLine(2) == nullptr);
+
+		// matches may span lines, '.' stops at line ends
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", ";\\s+f");
+		RefreshFindResults(false);
+		WaitForFindResults();
+		assert(mFindResults.size() == 1 && mFindResults[0].mStart == Coordinates(1, 12) && mFindResults[0].mEnd == Coordinates(3, 1));
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "a.*b");
+		RefreshFindResults(false);
+		WaitForFindResults();
+		assert(mFindResults.empty());
+
+		// an edit drops the running search, the next refresh starts over on the new text
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "int");
+		RefreshFindResults(false);
+		Coordinates where(2, 0);
+		InsertTextAt(where, "int");
+		RefreshFindResults(false);
+		WaitForFindResults();
+		assert(mFindResults.size() == 3 && mFindResults[2].mStart == Coordinates(2, 0));
+
+		// every search runs on the one worker, searches replaced before they start are dropped
+		auto worker = mRegexFindWorker;
+		for (int i = 0; i < 50; i++)
+			RefreshFindResults(false);
+		WaitForFindResults();
+		assert(mRegexFindWorker == worker && mFindResults.size() == 3);
+
+		snprintf(mFindBuffer, sizeof(mFindBuffer), "%s", "(");
+		RefreshFindResults(false);
+		assert(mRegexFindJob == nullptr && mFindResults.empty() && mFindStatusMessage == "Invalid regex");
+		mFindStatusMessage.clear();
+		mFindUseRegex = false;
+		mFindBuffer[0] = '\0';
+		RefreshFindResults(false);
+	}
+
+	// --- Retained rendering --- //
+	{
+		// a line drawn again from its cached geometry gives the vertices drawing it anew would, moved
+		ImDrawList drawList(ImGui::GetDrawListSharedData());
+		drawList._ResetForNewFrame();
+		drawList.PushClipRect(ImVec2(0.0f, 0.0f), ImVec2(4000.0f, 4000.0f));
+		ImFont* font = ImGui::GetFont();
+		drawList.PushTextureID(font->ContainerAtlas->TexID);
+		SetText("int x = 1;\n\tfoo(\"bar\"); // call");
+		mFirstVisibleColumn = 0;
+		mLastVisibleColumn = 80;
+		float fontHeight = ImGui::GetTextLineHeightWithSpacing();
+		RenderLineTextRetained(&drawList, 1, ImVec2(10.0f, 20.0f), fontHeight, 7.0f);
+		int drawn = drawList.VtxBuffer.Size;
+		assert(mLineDrawCache[1].mValid && (int)mLineDrawCache[1].mVertices.size() == drawn);
+		uint64_t key = mLineDrawCache[1].mKey;
+		RenderLineTextRetained(&drawList, 1, ImVec2(10.0f, 60.0f), fontHeight, 7.0f);
+		assert(mLineDrawCache[1].mKey == key && drawList.VtxBuffer.Size == 2 * drawn);
+		for (int i = 0; i < drawn; i++)
+			assert(drawList.VtxBuffer[drawn + i].pos.y == drawList.VtxBuffer[i].pos.y + 40.0f && drawList.VtxBuffer[drawn + i].uv.x == drawList.VtxBuffer[i].uv.x);
+		DeleteRange(Coordinates(1, 4), Coordinates(1, 5));
+		RenderLineTextRetained(&drawList, 1, ImVec2(10.0f, 60.0f), fontHeight, 7.0f);
+		assert(mLineDrawCache[1].mKey != key);
+
+		// the cached UVs belong to the font and its atlas texture
+		ImFont otherFont;
+		ImTextureID texture = font->ContainerAtlas->TexID;
+		uint64_t settings = HashLineDrawSettings(font, texture, fontHeight, 7.0f);
+		assert(HashLineDrawSettings(font, texture, fontHeight, 7.0f) == settings);
+		assert(HashLineDrawSettings(&otherFont, texture, fontHeight, 7.0f) != settings);
+		assert(HashLineDrawSettings(font, (ImTextureID)(intptr_t)1234, fontHeight, 7.0f) != settings);
+		mLineDrawCache.clear();
+	}
+
+	// --- Benchmarks --- //
+	{
+		// on an editor of its own, the clipboard is put back
+		ImGui::SetClipboardText("kept");
+		TextEditor benchmarkEditor;
+		std::string json = benchmarkEditor.Benchmarks(1000);
+		assert(json.find("\"Paste\"") != std::string::npos && std::string(ImGui::GetClipboardText()) == "kept");
 	}
 
 	SetText("\t\t\nasd\t\n");